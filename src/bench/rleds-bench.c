@@ -0,0 +1,338 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Benchmark harness for network interface handlers and LED drivers
+**
+** Loads a single plugin the way rleds does and calls its per-tick functions in a
+** tight loop, reporting time, heap allocations and system calls per call as one JSON
+** object per line.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+#include "../common/netifhandlers.h"
+#include "../rleds/plugins.h"
+#include "../rleds/profile.h"
+
+/* Default number of calls per measurement */
+#define DEF_ITERATIONS 100000
+
+/* Fraction of the iterations run unmeasured beforehand to warm up caches */
+#define WARMUP_DIV 100
+
+/* Maximum number of interfaces resp. pins to exercise */
+#define MAX_ITEMS 4096
+
+/* Function benchmarked: performs call number "i" */
+typedef RC (*BENCHFUNC)(uint64_t i);
+
+/* Global error message variable (see plugins.h) */
+char _errmsg[MAX_ERRMSG_LEN];
+
+const char *_help =
+        "Usage: %s [-n <iterations>] handler <plugin> <netif> [<netif> ...]\n"
+        "       %s [-n <iterations>] driver <plugin> <device> <pin> [<pin> ...]\n\n"
+
+        "Benchmarks the col() (and col_batch()) function of a network interface\n"
+        "handler resp. the set_frame() and commit() functions of a LED driver, given\n"
+        "as the path to its shared object.\n";
+
+/* Plugin under test and its state */
+char *_plugin_name;
+NETIFHANDLER *_netifh;
+NETIF *_netifs[MAX_ITEMS];
+LEDSTATE _ledstates[MAX_ITEMS], *_ledstate_ptrs[MAX_ITEMS];
+LEDDRIVER *_leddrvr;
+PORT *_port;
+uint64_t *_masks[2], *_valid;
+int _num_items;
+
+/* Heap allocation accounting: the plugins' malloc() calls resolve to ours */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+BOOL _counting = FALSE;
+uint64_t _allocs;
+
+void *malloc(size_t size)
+{
+	if (_counting)
+		_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (_counting)
+		_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (_counting)
+		_allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+/*
+** Calls "func" "iterations" times and prints the results for "op".
+*/
+void bench(char *op, BENCHFUNC func, uint64_t iterations)
+{
+	uint64_t i, t, sc_start = 0, sc_end = 0;
+	int sc_fd;
+
+	for (i = 0; i < iterations / WARMUP_DIV; i++)
+	{
+		if (func(i) != OK)
+			goto failed;
+	}
+
+	sc_fd = profile_counter_open(PERFCTR_SYSCALLS);
+	if (sc_fd != -1 && profile_counter_read(sc_fd, &sc_start) != OK)
+	{
+		close(sc_fd);
+		sc_fd = -1;
+	}
+
+	_allocs = 0;
+	_counting = TRUE;
+	t = profile_now();
+	for (i = 0; i < iterations; i++)
+	{
+		if (func(i) != OK)
+			goto failed;
+	}
+	t = profile_now() - t;
+	_counting = FALSE;
+
+	printf("{\"plugin\": \"%s\", \"op\": \"%s\", \"iterations\": %llu, "
+	       "\"ns_per_op\": %.1f, \"allocs_per_op\": %.3f, ",
+	       _plugin_name, op, (unsigned long long)iterations,
+	       (double)t / iterations, (double)_allocs / iterations);
+
+	/* The read() fetching the final count counts itself */
+	if (sc_fd != -1 && profile_counter_read(sc_fd, &sc_end) == OK)
+		printf("\"syscalls_per_op\": %.3f}\n",
+		       (double)(sc_end - sc_start - 1) / iterations);
+	else
+		printf("\"syscalls_per_op\": null}\n");
+	if (sc_fd != -1)
+		close(sc_fd);
+
+	fflush(stdout);
+	return;
+
+failed:
+	_counting = FALSE;
+	if (_netifh)
+		fprintf(stderr, "%s: %s() failed: %s\n", _plugin_name, op,
+		        _netifh->errmsg(_netifh->col_batch ? NULL : _netifs[i % _num_items]));
+	else
+		fprintf(stderr, "%s: %s() failed: %s\n", _plugin_name, op,
+		        _leddrvr->errmsg(_port));
+	exit(1);
+}
+
+/* The functions benchmarked */
+RC bench_col(uint64_t i)
+{
+	int n = i % _num_items;
+
+	return _netifh->col(_netifs[n], &_ledstates[n]);
+}
+
+RC bench_col_batch(uint64_t i)
+{
+	return _netifh->col_batch(_netifs, _ledstate_ptrs, _num_items);
+}
+
+RC bench_set_frame(uint64_t i)
+{
+	return _leddrvr->set_frame(_port, _masks[i & 1], _valid);
+}
+
+RC bench_set_frame_commit(uint64_t i)
+{
+	if (_leddrvr->set_frame(_port, _masks[i & 1], _valid) != OK)
+		return ERR;
+
+	return _leddrvr->commit(_port);
+}
+
+/*
+** Benchmarks the network interface handler at "path" on the interfaces "names".
+*/
+void bench_handler(char *path, char **names, uint64_t iterations)
+{
+	int i;
+
+	_netifh = (NETIFHANDLER *)load_shobj(path);
+	if (_netifh == (void *)-1 || !_netifh)
+	{
+		fprintf(stderr, "%s", _netifh ? _errmsg : "No NETIFHANDLER structure found!\n");
+		exit(1);
+	}
+	if (_netifh->api_ver != NETIFHANDLER_API_VER)
+	{
+		fprintf(stderr, "Wrong API version (%d != ours: %d)\n",
+		        _netifh->api_ver, NETIFHANDLER_API_VER);
+		exit(1);
+	}
+
+	for (i = 0; i < _num_items; i++)
+	{
+		_netifs[i] = _netifh->init(names[i]);
+		if (!_netifs[i])
+		{
+			fputs(_netifh->errmsg(NULL), stderr);
+			exit(1);
+		}
+		_ledstate_ptrs[i] = &_ledstates[i];
+	}
+
+	bench("col", bench_col, iterations);
+	if (_netifh->col_batch)
+		bench("col_batch", bench_col_batch, iterations);
+
+	for (i = 0; i < _num_items; i++)
+		_netifh->shutdown(_netifs[i]);
+}
+
+/*
+** Benchmarks the LED driver at "path" on "device" with the pins "pins".
+*/
+void bench_driver(char *path, char *device, char **pins, uint64_t iterations)
+{
+	uint bits[MAX_ITEMS], max_bit = 0, words;
+	int i;
+
+	_leddrvr = (LEDDRIVER *)load_shobj(path);
+	if (_leddrvr == (void *)-1 || !_leddrvr)
+	{
+		fprintf(stderr, "%s", _leddrvr ? _errmsg : "No LEDDRIVER structure found!\n");
+		exit(1);
+	}
+	if (_leddrvr->api_ver != LEDDRIVER_API_VER)
+	{
+		fprintf(stderr, "Wrong API version (%d != ours: %d)\n",
+		        _leddrvr->api_ver, LEDDRIVER_API_VER);
+		exit(1);
+	}
+
+	_port = _leddrvr->init(device);
+	if (!_port)
+	{
+		fputs(_leddrvr->errmsg(NULL), stderr);
+		exit(1);
+	}
+
+	for (i = 0; i < _num_items; i++)
+	{
+		if (_leddrvr->alloc(_port, pins[i], &bits[i]) < 0)
+		{
+			fputs(_leddrvr->errmsg(_port), stderr);
+			exit(1);
+		}
+		if (bits[i] >= max_bit)
+			max_bit = bits[i] + 1;
+	}
+
+	/* Alternate between all pins on and all pins off, so that every commit()
+	   has something to do */
+	words = (max_bit + 63) / 64;
+	_masks[0] = calloc(words, sizeof(uint64_t));
+	_masks[1] = calloc(words, sizeof(uint64_t));
+	_valid = calloc(words, sizeof(uint64_t));
+	if (!_masks[0] || !_masks[1] || !_valid)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+	for (i = 0; i < _num_items; i++)
+		_masks[1][bits[i] / 64] |= _valid[bits[i] / 64] |= (uint64_t)1 << (bits[i] % 64);
+
+	bench("set_frame", bench_set_frame, iterations);
+	bench("set_frame+commit", bench_set_frame_commit, iterations);
+
+	(void)_leddrvr->reset(_port);
+	_leddrvr->shutdown(_port);
+}
+
+/*
+** Main routine.
+*/
+int main(int argc, char **argv)
+{
+	uint64_t iterations = DEF_ITERATIONS;
+	char *p;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				iterations = strtoull(optarg, NULL, 10);
+				break;
+			case 'h':
+				printf(_help, argv[0], argv[0]);
+				return 0;
+			default:
+				fprintf(stderr, _help, argv[0], argv[0]);
+				return 1;
+		}
+	}
+
+	/* Name the plugin in the results the way rleds names its structure */
+	if (argc - optind >= 3)
+	{
+		p = strrchr(argv[optind + 1], '/');
+		_plugin_name = strdup(p ? p + 1 : argv[optind + 1]);
+		p = strstr(_plugin_name, ".so");
+		if (p)
+			*p = '\0';
+	}
+
+	if (argc - optind >= 3 && strcmp(argv[optind], "handler") == 0)
+	{
+		_num_items = argc - optind - 2;
+		if (_num_items <= MAX_ITEMS && iterations)
+		{
+			bench_handler(argv[optind + 1], &argv[optind + 2], iterations);
+			return 0;
+		}
+	}
+	else if (argc - optind >= 4 && strcmp(argv[optind], "driver") == 0)
+	{
+		_num_items = argc - optind - 3;
+		if (_num_items <= MAX_ITEMS && iterations)
+		{
+			bench_driver(argv[optind + 1], argv[optind + 2], &argv[optind + 3], iterations);
+			return 0;
+		}
+	}
+
+	fprintf(stderr, _help, argv[0], argv[0]);
+	return 1;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+#
+# rleds - Router LED control program
+# Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+#
+# This software is licensed under the GNU General Public License, version 2,
+# as published by the Free Software Foundation and available in the file
+# COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.
+#
+# Runs the benchmark suite against the build tree and prints the results as one
+# JSON object per line:
+# - the plugin harness (rleds-bench) on each handler and on the capture driver
+# - the whole daemon for <duration> seconds with each of the given numbers of LEDs,
+#   watching fake interfaces from rleds-netgen and writing to the capture driver
+#
+# Usage: run-bench.sh <top build dir> <duration> <iterations> <LED count> ...
+#
+
+TOP=$1
+DURATION=$2
+ITERATIONS=$3
+shift 3
+LEDS="$*"
+
+WORK=`mktemp -d /tmp/rleds-bench.XXXXXX` || exit 1
+NETGEN_PID=
+cleanup()
+{
+	[ -n "$NETGEN_PID" ] && kill $NETGEN_PID 2>/dev/null && wait $NETGEN_PID
+	rm -rf $WORK
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Each LED watched by the generic handler holds two files open
+ulimit -n `ulimit -Hn` 2>/dev/null
+
+# Gather the plugins from the build tree
+mkdir $WORK/plugins
+ln -s $TOP/src/leddrivers/*.so $TOP/src/netifhandlers/*.so $WORK/plugins/ || exit 1
+
+# Fake interfaces for the largest run
+MAX_LEDS=1
+for n in $LEDS; do
+	[ $n -gt $MAX_LEDS ] && MAX_LEDS=$n
+done
+$TOP/src/tools/rleds-netgen -n $MAX_LEDS -r 20 -i 20 $WORK/net &
+NETGEN_PID=$!
+sleep 1
+RLEDS_SYSFS_NET=$WORK/net
+export RLEDS_SYSFS_NET
+
+printf '{"bench": "meta", "version": "%s", "host": "%s", "kernel": "%s", "date": "%s"}\n' \
+	"`sed -n 's/^#define PACKAGE_VERSION "\(.*\)"/\1/p' $TOP/config.h`" \
+	"`uname -n`" "`uname -r`" "`date -u +%Y-%m-%dT%H:%M:%SZ`"
+
+# Plugin benchmarks
+BENCH=$TOP/src/bench/rleds-bench
+$BENCH -n $ITERATIONS handler $WORK/plugins/netifh_generic.so vlan0
+$BENCH -n $ITERATIONS handler $WORK/plugins/netifh_procnetdev.so lo
+$BENCH -n $ITERATIONS handler $WORK/plugins/netifh_netlink.so lo
+$BENCH -n $ITERATIONS driver $WORK/plugins/leddrvr_capture.so $WORK/capture 0 1 2 3
+
+# Daemon benchmarks
+HZ=`getconf CLK_TCK`
+for n in $LEDS; do
+	SPECS=
+	i=0
+	while [ $i -lt $n ]; do
+		SPECS="$SPECS vlan$i:capture[$WORK/capture$n]:$i"
+		i=`expr $i + 1`
+	done
+
+	# Only the profile summary is of interest on stderr
+	mkfifo $WORK/stderr$n
+	grep -a -e '^ticks ' -e '^tick \[ns\]' <$WORK/stderr$n >$WORK/profile$n &
+	GREP_PID=$!
+
+	$TOP/src/rleds/rleds -P $WORK/plugins --profile $SPECS >/dev/null 2>$WORK/stderr$n &
+	PID=$!
+	sleep $DURATION
+
+	CPU=`awk '{ print $14 + $15 }' /proc/$PID/stat`
+	RSS=`awk '/^VmRSS:/ { print $2 }' /proc/$PID/status`
+	kill -USR2 $PID
+	sleep 1
+	kill -INT $PID
+	wait $PID
+	wait $GREP_PID
+
+	TICKS=`sed -n 's/^ticks \([0-9]*\),.*/\1/p' $WORK/profile$n | tail -n 1`
+	TICK_NS=`sed -n 's/^tick \[ns\]:.* avg \([0-9]*\),.*/\1/p' $WORK/profile$n | tail -n 1`
+	OUTPUT=`$TOP/src/tools/rleds-capdump -j $WORK/capture$n`
+
+	printf '{"bench": "daemon", "leds": %d, "duration_s": %d, "ticks": %d, "cpu_us_per_tick": %s, "tick_wall_ns_avg": %s, "rss_kb": %d, "output": %s}\n' \
+		$n $DURATION ${TICKS:-0} \
+		`awk "BEGIN { t = ${TICKS:-0}; printf \"%.1f\", t ? $CPU * 1000000 / $HZ / t : 0 }"` \
+		${TICK_NS:-null} ${RSS:-0} "${OUTPUT:-null}"
+done
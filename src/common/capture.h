@@ -0,0 +1,67 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Layout of the ring buffer files written by the capture LED driver
+*/
+
+#ifndef _RLEDS_CAPTURE_H
+#define _RLEDS_CAPTURE_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+/*
+** A capture file consists of a CAPTURE_HEADER followed by "num_records" fixed-size
+** CAPTURE_RECORDs. Frame number n (counting from 0) is stored in record n %
+** "num_records", so the file always holds the last "num_records" frames committed.
+** All values are in host byte order.
+**
+** A record is complete once its "seq" field equals the frame's number plus one. The
+** writer zeroes "seq" before filling in a record and sets it last, so readers looking
+** at the file while it is being written can tell torn records apart.
+*/
+
+/* Identifies capture files */
+#define CAPTURE_MAGIC "RLEDSCAP"
+
+/* Current version of the file layout */
+#define CAPTURE_VERSION 1
+
+/* Number of 64-bit words in a frame and thus maximum number of pins */
+#define CAPTURE_FRAME_WORDS 64
+#define CAPTURE_MAX_PINS (CAPTURE_FRAME_WORDS * 64)
+
+typedef struct _capture_header
+{
+	char		magic[8];			/* CAPTURE_MAGIC (not terminated) */
+	uint32_t	version,			/* CAPTURE_VERSION */
+			header_size,			/* sizeof(CAPTURE_HEADER) */
+			record_size,			/* sizeof(CAPTURE_RECORD) */
+			num_records;			/* Number of records in the ring */
+	uint32_t	num_pins,			/* Highest pin allocated plus one */
+			reserved;
+	uint64_t	frames;				/* Number of frames committed so far */
+	uint64_t	pad[4];
+} CAPTURE_HEADER;
+
+typedef struct _capture_record
+{
+	uint64_t	seq;				/* Frame number plus one (0 = incomplete) */
+	uint64_t	timestamp;			/* CLOCK_MONOTONIC time of the commit in
+							   nanoseconds */
+	uint64_t	frame[CAPTURE_FRAME_WORDS];	/* Pins enabled, bit n standing for pin n */
+} CAPTURE_RECORD;
+
+#endif /* _RLEDS_CAPTURE_H */
@@ -21,11 +21,14 @@
 #endif
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #include "base.h"
+#include "offload.h"
+#include "pluginnote.h"
 
 /* Current version of the LED driver API */
-#define LEDDRIVER_API_VER 1
+#define LEDDRIVER_API_VER 5
 
 /* Common filename prefix for LED drivers */
 #define LEDDRIVER_PREFIX "leddrvr_"
@@ -92,25 +95,29 @@ typedef struct _leddriver
 	** mark it as in use).
 	**
 	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
-	** "pin" is one of the pins listed in the LED driver's "pins" array.
+	** "pin" is one of the pins listed in the LED driver's "pins" array. "bit" receives the
+	** position of the pin in the masks passed to set_frame().
 	**
-	** Returns OK on success and ERR on failure.
+	** Returns an opaque, non-negative pin handle on success and ERR on failure.
 	*/
-	RC		(*alloc)(PORT *port, char *pin);
+	int		(*alloc)(PORT *port, char *pin, uint *bit);
 
 	/*
-	** Specifies a pin to be enabled by an upcoming commit() call.
+	** Specifies the state of the pins to be established by an upcoming commit() call.
 	**
 	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
-	** "pin" is one of the pins listed in the LED driver's "pins" array which additionally
-	** must have been allocated beforehand using the alloc() function above.
+	** "set_mask" and "valid_mask" are bitmasks in the form of arrays of 64-bit words, where
+	** bit n (bit n % 64 of word n / 64) stands for the pin allocated with bit position n.
+	** Pins set in "valid_mask" are the ones the caller controls; of these, the ones also
+	** set in "set_mask" are to be enabled and the others disabled. Both arrays must be
+	** large enough to hold the highest bit position handed out by alloc().
 	**
 	** Returns OK on success and ERR on failure.
 	*/
-	RC		(*enable)(PORT *port, char *pin);
+	RC		(*set_frame)(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask);
 
 	/*
-	** Commits the changes made by calls to enable() before to the actual hardware.
+	** Commits the frame specified by set_frame() to the actual hardware.
 	**
 	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
 	**
@@ -135,6 +142,85 @@ typedef struct _leddriver
 	** Returns the last error message associated with the specified PORT handle.
 	*/
 	char		*(*errmsg)(PORT *port);
+
+	/*
+	** Asynchronous commit function (since API version 3; optional, may be NULL, but
+	** must be present if complete() is).
+	**
+	** Starts committing the frame specified by set_frame() to the actual hardware
+	** without waiting for it to finish. Until the file descriptor returned becomes
+	** readable and complete() has been called, the main program will not call
+	** set_frame(), commit() or submit() for this port again. Drivers without this
+	** function get their commit() called from a separate thread per port instead.
+	**
+	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
+	**
+	** Returns a file descriptor that becomes readable once the commit has finished
+	** on success and ERR on failure.
+	*/
+	int		(*submit)(PORT *port);
+
+	/*
+	** Completion function (since API version 3; optional, may be NULL, but must be
+	** present if submit() is).
+	**
+	** Finishes a commit started by submit() whose file descriptor became readable,
+	** which it must no longer be afterwards.
+	**
+	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
+	**
+	** Returns OK if the frame was committed and ERR on failure.
+	*/
+	RC		(*complete)(PORT *port);
+
+	/*
+	** Offload function (since API version 4; optional, may be NULL).
+	**
+	** Hands a pin over to the kernel, which is to drive it as described by
+	** "offload". From then on, the main program leaves the pin out of the frames it
+	** passes to set_frame(); reset() takes the pin back from the kernel.
+	**
+	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
+	** "pinh" is a pin handle as returned by alloc().
+	**
+	** Returns OK on success and ERR if the pin cannot be offloaded, in which case it
+	** remains in the state it was before.
+	*/
+	RC		(*offload)(PORT *port, int pinh, const OFFLOAD *offload);
+
+	/*
+	** Release function (since API version 5; optional, may be NULL).
+	**
+	** Frees a pin allocated by alloc(), e.g. because the LED connected to it was
+	** removed from the configuration, so that it can be allocated again later. The
+	** main program turns the pin off and leaves it out of the frames it passes to
+	** set_frame() before; offloaded pins are taken back from the kernel. The pin's
+	** bit position may be handed out again by alloc(). Without this function, pins
+	** stay allocated until shutdown().
+	**
+	** "port" is a PORT handle as obtained by a call to this LED driver's init() function.
+	** "pinh" is a pin handle as returned by alloc().
+	**
+	** Returns OK on success and ERR on failure.
+	*/
+	RC		(*release)(PORT *port, int pinh);
 } LEDDRIVER;
 
+/*
+** Describes a LED driver in its ELF note (see pluginnote.h), for listing it without
+** loading it. "pins" is a macro taking a macro to apply to each pin name, eg.
+**
+**   #define PINNAMES(PIN) PIN("D0") PIN("D1")
+**   static char *_pinnames[] = { PINNAMES(PIN_NAME) NULL };
+**   LEDDRIVER_NOTE("drives LEDs...", LEDDRVR_FOO_VERSION, DEFAULT_DEVICE, PINNAMES);
+*/
+#define PIN_NAME(name) name,
+#define LEDDRIVER_NOTE(desc, ver, def_dev, pins) \
+	PLUGIN_NOTE(NOTE_FIELD("kind", "leddriver") \
+	            NOTE_FIELD("api", NOTE_STR(LEDDRIVER_API_VER)) \
+	            NOTE_FIELD("desc", desc) \
+	            NOTE_FIELD("ver", ver) \
+	            NOTE_FIELD("dev", def_dev) \
+	            pins(NOTE_PIN))
+
 #endif /* _RLEDS_LEDDRIVERS_H */
@@ -20,10 +20,14 @@
 #include "../../config.h"
 #endif
 
+#include <stdint.h>
+
 #include "base.h"
+#include "offload.h"
+#include "pluginnote.h"
 
 /* Current version of the network interface handler API */
-#define NETIFHANDLER_API_VER 1
+#define NETIFHANDLER_API_VER 5
 
 /* Common filename prefix for network interface handlers */
 #define NETIFHANDLER_PREFIX "netifh_"
@@ -40,6 +44,55 @@ typedef enum _ledstate
 	LEDSTATE_BOTH					/* Both LED pins are turned on */
 } LEDSTATE;
 
+/*
+** Brightness levels as returned by a network interface handler's brightness()
+** function: from off to full, with LEDs of idle interfaces glowing at
+** BRIGHTNESS_IDLE.
+*/
+#define BRIGHTNESS_MAX 255
+#define BRIGHTNESS_IDLE 32
+
+/*
+** Maps the number of packets an interface saw during a sampling period to a
+** brightness. Each doubling of the packet count adds the same amount, reaching
+** BRIGHTNESS_MAX at 2^BRIGHTNESS_BITS packets.
+*/
+#define BRIGHTNESS_BITS 16
+static inline uint activity_brightness(unsigned long long packets)
+{
+	uint bits = packets ? 64 - __builtin_clzll(packets) : 0;
+
+	if (bits > BRIGHTNESS_BITS)
+		bits = BRIGHTNESS_BITS;
+	return BRIGHTNESS_IDLE + (BRIGHTNESS_MAX - BRIGHTNESS_IDLE) * bits / BRIGHTNESS_BITS;
+}
+
+/*
+** Returns by how much a packet counter grew from "last" to "cur". A counter that
+** went backwards (reset, or the interface was recreated between two samples)
+** counts as no growth at all rather than wrapping around.
+*/
+static inline unsigned long long counter_delta(unsigned long long cur, unsigned long long last)
+{
+	return cur > last ? cur - last : 0;
+}
+
+/*
+** Interface statistics as returned by a network interface handler's stats() function.
+*/
+typedef struct _netifstats
+{
+	BOOL		up;				/* Whether the interface is up (if not,
+							   the counters are meaningless) */
+	unsigned long long
+			rx_packets,			/* Packets received */
+			tx_packets,			/* Packets transmitted */
+			rx_bytes,			/* Bytes received */
+			tx_bytes;			/* Bytes transmitted */
+	uint64_t	timestamp;			/* CLOCK_MONOTONIC time in nanoseconds at
+							   which the counters were sampled */
+} NETIFSTATS;
+
 /*
 ** Network interface handlers usually need to keep state information about the network
 ** interfaces they watch. For this purpose they must declare a NETIF structure, whose actual
@@ -117,7 +170,81 @@ typedef struct _netifhandler
 	** Returns the last error message associated with the specified NETIF handle.
 	*/
 	char		*(*errmsg)(NETIF *netif);
+
+	/*
+	** Batch LED color function (since API version 2; optional, may be NULL).
+	**
+	** Does the same as col() for a number of interfaces at once, so that handlers
+	** that can fetch the state of all interfaces in one go only need to do so once
+	** per sampling round. If present, the main program will call this function
+	** instead of col() with all interfaces watched by this handler.
+	**
+	** "netifs" is an array of "count" NETIF handles as obtained by calls to this
+	** network interface handler's init() function. "ledstates" is an array of
+	** "count" pointers to LEDSTATE variables, "ledstates[i]" holding the desired
+	** state of the LED for "netifs[i]".
+	**
+	** Returns OK on success and ERR if errors occured, in which case errmsg(NULL)
+	** will return the error message.
+	*/
+	RC		(*col_batch)(NETIF **netifs, LEDSTATE **ledstates, int count);
+
+	/*
+	** Statistics function (since API version 3; optional, may be NULL).
+	**
+	** Returns the interface's counters as sampled by the last col() resp. col_batch()
+	** call, so that the main program can derive rates from them without sampling the
+	** interface again. Handlers may fetch counters not needed by col() here.
+	**
+	** "netif" is a NETIF handle as obtained by a call to this network interface
+	** handler's init() function. "stats" receives the statistics.
+	**
+	** Returns OK on success and ERR if errors occured.
+	*/
+	RC		(*stats)(NETIF *netif, NETIFSTATS *stats);
+
+	/*
+	** Offload description function (since API version 4; optional, may be NULL).
+	**
+	** Describes the LED behavior col() implements for the interface in terms of the
+	** kernel's netdev LED trigger, so that LED drivers capable of it can leave the
+	** LED to the kernel. Handlers whose behavior the trigger cannot reproduce return
+	** ERR.
+	**
+	** "netif" is a NETIF handle as obtained by a call to this network interface
+	** handler's init() function. "offload" receives the description; its "interval"
+	** is filled in by the main program.
+	**
+	** Returns OK if the behavior can be offloaded and ERR if not.
+	*/
+	RC		(*offload)(NETIF *netif, OFFLOAD *offload);
+
+	/*
+	** Brightness function (since API version 5; optional, may be NULL).
+	**
+	** Returns how bright the LED should be as of the last col() resp. col_batch()
+	** call, for LEDs that are dimmed rather than just switched. Handlers without
+	** this function get their LEDs lit at full brightness.
+	**
+	** "netif" is a NETIF handle as obtained by a call to this network interface
+	** handler's init() function. "brightness" receives a value between 0 and
+	** BRIGHTNESS_MAX.
+	**
+	** Returns OK on success and ERR if errors occured.
+	*/
+	RC		(*brightness)(NETIF *netif, uint *brightness);
 } NETIFHANDLER;
 
+/*
+** Describes a network interface handler in its ELF note (see pluginnote.h), for
+** listing it without loading it.
+*/
+#define NETIFHANDLER_NOTE(desc, ver, tricol_desc) \
+	PLUGIN_NOTE(NOTE_FIELD("kind", "netifhandler") \
+	            NOTE_FIELD("api", NOTE_STR(NETIFHANDLER_API_VER)) \
+	            NOTE_FIELD("desc", desc) \
+	            NOTE_FIELD("ver", ver) \
+	            NOTE_FIELD("tricol", tricol_desc))
+
 #endif /* _RLEDS_NETIFHANDLERS_H */
 
@@ -0,0 +1,47 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file defining the description of LED behavior handed over to the kernel
+*/
+
+#ifndef _RLEDS_OFFLOAD_H
+#define _RLEDS_OFFLOAD_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "base.h"
+
+/*
+** How a LED reflects its interface, in terms of the kernel's "netdev" LED trigger
+** (ledtrig-netdev). A network interface handler fills this in if its LED behavior
+** can be expressed this way; a LED driver that can program the trigger then takes
+** over the LED, which needs no more sampling from then on.
+**
+** The trigger's "link" mode follows the interface's carrier, while the bundled
+** handlers keep a sampled LED on for as long as the interface exists. So an
+** offloaded LED goes dark while its interface is administratively down or has no
+** carrier, where a sampled one stays lit, as the --offload help text says.
+*/
+typedef struct _offload
+{
+	char		*if_name;			/* Interface name */
+	BOOL		link,				/* LED is on while the interface has carrier */
+			rx,				/* LED blinks on received packets... */
+			tx;				/* ...resp. on transmitted packets */
+	uint		interval;			/* Blink interval in milliseconds */
+} OFFLOAD;
+
+#endif /* _RLEDS_OFFLOAD_H */
@@ -0,0 +1,68 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Plugin metadata in ELF notes
+*/
+
+#ifndef _RLEDS_PLUGINNOTE_H
+#define _RLEDS_PLUGINNOTE_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+/*
+** Besides their defining structure, LED drivers and network interface handlers
+** carry a description of themselves in an ELF note section, so that it can be
+** listed without loading them, ie. without running any of their code. Use the
+** LEDDRIVER_NOTE() resp. NETIFHANDLER_NOTE() macros to create it.
+**
+** The note's descriptor is a sequence of '\0'-terminated "<key>=<value>" fields,
+** terminated by an empty one. Keys may repeat ("pin" does). Unknown keys must be
+** ignored.
+*/
+
+/* Section the note is placed in */
+#define PLUGIN_NOTE_SECTION ".note.rleds"
+
+/* Owner name and type of the note */
+#define PLUGIN_NOTE_OWNER "rleds"
+#define PLUGIN_NOTE_TYPE 1
+
+/* Creates a field of the note's descriptor */
+#define NOTE_FIELD(key, value) key "=" value "\0"
+
+/* Creates a "pin" field (for use with the LED drivers' pin lists) */
+#define NOTE_PIN(name) NOTE_FIELD("pin", name)
+
+/* Turns a numeric macro into a string */
+#define NOTE_STR(x) NOTE_STR2(x)
+#define NOTE_STR2(x) #x
+
+/* Places a note with the descriptor "fields" in PLUGIN_NOTE_SECTION. Owner name
+   and descriptor are padded to multiples of four bytes as required by the ELF
+   specification. */
+#define PLUGIN_NOTE(fields) \
+	static const struct \
+	{ \
+		uint32_t	namesz, descsz, type; \
+		char		name[(sizeof(PLUGIN_NOTE_OWNER) + 3) & ~3]; \
+		char		desc[(sizeof(fields) + 3) & ~3]; \
+	} _plugin_note __attribute__((section(PLUGIN_NOTE_SECTION), aligned(4), used)) = \
+	{ \
+		sizeof(PLUGIN_NOTE_OWNER), sizeof(fields), PLUGIN_NOTE_TYPE, \
+		PLUGIN_NOTE_OWNER, fields \
+	}
+
+#endif /* _RLEDS_PLUGINNOTE_H */
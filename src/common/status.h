@@ -0,0 +1,95 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Layout of the shared memory status page
+*/
+
+#ifndef _RLEDS_STATUS_H
+#define _RLEDS_STATUS_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+/*
+** The status page is a POSIX shared memory object consisting of a STATUS_HEADER
+** followed by one fixed-size STATUS_RECORD per LED, in the order the LEDs were
+** specified on the command line. rleds updates it in place as it samples, readers
+** map it read-only and may look at it as often as they like. All values are in
+** host byte order, all times are CLOCK_MONOTONIC nanoseconds.
+**
+** Each record is guarded by a seqlock: "seq" is odd while the record is being
+** updated. Readers load "seq", copy the fields with atomic loads and retry if
+** "seq" was odd or changed meanwhile. The names never change once "magic" is set,
+** which happens last when the page is created.
+**
+** Reloading the configuration file keeps the page if every LED still has the same
+** interface and handler. Otherwise rleds clears the old page's "magic", unlinks it
+** and creates a new page under the same name. A stale mapping never changes "pid"
+** or "started", so readers that keep the page mapped should check "magic" each
+** time. They should also shm_open() the name again from time to time and map the
+** new object when fstat() shows a different st_dev/st_ino, as rleds-status --watch
+** does.
+*/
+
+/* Identifies status pages */
+#define STATUS_MAGIC "RLEDSSTA"
+
+/* Current version of the layout */
+#define STATUS_VERSION 1
+
+/* Name of the shared memory object used by default */
+#define STATUS_DEFAULT_NAME "/rleds.status"
+
+/* Size of the name fields, including the terminating '\0' */
+#define STATUS_NAME_LEN 32
+
+/* Record flags */
+#define STATUS_UP		0x01		/* Interface is up */
+#define STATUS_OFFLOADED	0x02		/* LED is driven by the kernel, the record
+						   is not updated */
+
+typedef struct _status_header
+{
+	char		magic[8];			/* STATUS_MAGIC (not terminated) */
+	uint32_t	version,			/* STATUS_VERSION */
+			header_size,			/* sizeof(STATUS_HEADER) */
+			record_size,			/* sizeof(STATUS_RECORD) */
+			num_records;			/* Number of LEDs */
+	uint32_t	pid,				/* Process ID of the writer */
+			reserved;
+	uint64_t	started,			/* When the page was created */
+			ticks,				/* Number of ticks so far... */
+			updated;			/* ...and when the last one happened */
+	uint64_t	pad[3];
+} STATUS_HEADER;
+
+typedef struct _status_record
+{
+	uint32_t	seq;				/* Seqlock sequence counter */
+	uint32_t	ledstate,			/* LEDSTATE as of the last sample */
+			flags,				/* STATUS_* flags */
+			reserved;
+	uint64_t	samples,			/* Number of samples so far */
+			sampled,			/* When the last one happened (0 = never) */
+			stats_sampled;			/* When the counters below were sampled */
+	uint64_t	rx_packets,			/* Interface counters as of the last sample */
+			tx_packets,			/* (0 if the handler cannot provide them) */
+			rx_bytes,
+			tx_bytes;
+	char		netif_name[STATUS_NAME_LEN],	/* Network interface name... */
+			netifh_name[STATUS_NAME_LEN];	/* ...and its handler's */
+} STATUS_RECORD;
+
+#endif /* _RLEDS_STATUS_H */
@@ -0,0 +1,276 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Capture LED driver
+**
+** Drives no hardware at all. Instead, every frame committed is appended, along with a
+** timestamp, to a ring buffer in a memory-mapped file (the "device"), whose layout is
+** described in ../common/capture.h. Use rleds-capdump to decode it.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/mman.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+#include "../common/capture.h"
+
+#include "leddrvr_capture.h"
+
+/* Description of this driver */
+#define DESCRIPTION "records frames in a memory-mapped ring buffer file"
+
+/* Pins supported by this driver: any number below CAPTURE_MAX_PINS */
+#define PINNAMES(PIN) \
+	PIN("0")	PIN("1")	PIN("...")	PIN("4095")
+static char *_pinnames[] = {
+	PINNAMES(PIN_NAME)
+	NULL
+};
+
+/* LEDDRIVER structure required by the main program */
+LEDDRIVER leddrvr_capture =
+{
+	LEDDRIVER_API_VER,				/* API version implemented by this LED driver */
+
+	DESCRIPTION,					/* Description for the LED driver */
+	LEDDRVR_CAPTURE_VERSION,			/* Version of the LED driver */
+
+	DEFAULT_DEVICE,					/* Default device */
+	_pinnames,					/* Array of pins controlled by this driver */
+
+	leddrvr_capture_init,				/* Init function */
+	leddrvr_capture_shutdown,			/* Shutdown function */
+	leddrvr_capture_alloc,				/* Allocates a pin */
+	leddrvr_capture_set_frame,			/* Sets pins to be enabled */
+	leddrvr_capture_commit,				/* Commit changes made by set_frame() to the capture file */
+	leddrvr_capture_reset,				/* Resets all pins */
+	leddrvr_capture_errmsg,				/* Returns driver-internal error messages */
+	NULL,						/* Asynchronous commit function (not needed) */
+	NULL,						/* Completion function (not needed) */
+	NULL,						/* Offload function (not supported) */
+	leddrvr_capture_release				/* Frees a pin */
+};
+
+/* Description for listing this driver without loading it */
+LEDDRIVER_NOTE(DESCRIPTION, LEDDRVR_CAPTURE_VERSION, DEFAULT_DEVICE, PINNAMES);
+
+/* Buffer for error messages */
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/* Initialization function */
+PORT *leddrvr_capture_init(char *dev_name)
+{
+	PORT *port;
+	void *map;
+
+	/* If no device name was specified, use the default */
+	if (!dev_name)
+		dev_name = DEFAULT_DEVICE;
+
+	/* Initialize error message buffer */
+	*_errmsg = '\0';
+
+	/* Allocate PORT structure for this device */
+	port = calloc(1, sizeof(PORT));
+	if (!port)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for PORT structure!\n");
+		return NULL;
+	}
+	port->map_len = sizeof(CAPTURE_HEADER) + CAPTURE_RECORDS * sizeof(CAPTURE_RECORD);
+
+	/* Create the capture file, discarding any previous contents... */
+	port->fd = open(dev_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (port->fd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not create capture file \"%s\":\n%s!\n",
+		         dev_name, strerror(errno));
+		free(port);
+		return NULL;
+	}
+
+	/* ...and map it */
+	if (ftruncate(port->fd, port->map_len) == -1 ||
+	    (map = mmap(NULL, port->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                port->fd, 0)) == MAP_FAILED)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not map capture file \"%s\":\n%s!\n",
+		         dev_name, strerror(errno));
+		close(port->fd);
+		free(port);
+		return NULL;
+	}
+	port->header = map;
+	port->records = (CAPTURE_RECORD *)(port->header + 1);
+
+	/* The file is all zeroes now, so only the header needs filling in */
+	memcpy(port->header->magic, CAPTURE_MAGIC, sizeof(port->header->magic));
+	port->header->version = CAPTURE_VERSION;
+	port->header->header_size = sizeof(CAPTURE_HEADER);
+	port->header->record_size = sizeof(CAPTURE_RECORD);
+	port->header->num_records = CAPTURE_RECORDS;
+
+	/* Remember device name for error messages */
+	port->dev_name = strdup(dev_name);
+
+	/* Finally, initialize it */
+	if (leddrvr_capture_reset(port) != OK)
+	{
+		/* Preserve error message */
+		strncpy(_errmsg, port->errmsg, sizeof(_errmsg));
+
+		(void)leddrvr_capture_shutdown(port);
+		return NULL;
+	}
+
+	return port;
+}
+
+/* Shutdown function */
+RC leddrvr_capture_shutdown(PORT *port)
+{
+	assert(port);
+
+	munmap(port->header, port->map_len);
+	close(port->fd);
+
+	if (port->dev_name)
+		free(port->dev_name);
+	free(port);
+
+	return OK;
+}
+
+/* Allocate the specified pin */
+int leddrvr_capture_alloc(PORT *port, char *pin, uint *bit)
+{
+	unsigned long i;
+	char *end;
+
+	assert(port && pin && bit);
+
+	/* Pins are simply numbered */
+	i = strtoul(pin, &end, 10);
+	if (!*pin || *end || i >= CAPTURE_MAX_PINS)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "The \"capture\" LED driver only knows pins 0 to %d, not \"%s\"!\n",
+		         CAPTURE_MAX_PINS - 1, pin);
+		return ERR;
+	}
+
+	if (port->allocated[i / 64] & ((uint64_t)1 << (i % 64)))
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Pin \"%s\" of device \"%s\" already in use -- specified twice?\n",
+		         pin, port->dev_name);
+		return ERR;
+	}
+	port->allocated[i / 64] |= (uint64_t)1 << (i % 64);
+
+	if (i / 64 >= port->words)
+		port->words = i / 64 + 1;
+	if (i >= port->header->num_pins)
+		port->header->num_pins = i + 1;
+
+	/* Pins are identified by their number */
+	*bit = i;
+	return i;
+}
+
+/* Free the specified pin */
+RC leddrvr_capture_release(PORT *port, int pinh)
+{
+	assert(port && pinh >= 0 && pinh < CAPTURE_MAX_PINS);
+
+	/* The pin still counts for "words" and "num_pins", which never shrink */
+	port->allocated[pinh / 64] &= ~((uint64_t)1 << (pinh % 64));
+
+	return OK;
+}
+
+/* Set pins to be enabled */
+RC leddrvr_capture_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask)
+{
+	uint i;
+
+	assert(port && set_mask && valid_mask);
+
+	/* The masks only cover the pins allocated */
+	for (i = 0; i < port->words; i++)
+		port->frame[i] = set_mask[i] & valid_mask[i] & port->allocated[i];
+
+	return OK;
+}
+
+/* Commit changes made by set_frame() to the capture file */
+RC leddrvr_capture_commit(PORT *port)
+{
+	CAPTURE_RECORD *rec;
+	struct timespec ts;
+	uint64_t n;
+
+	assert(port && port->header);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	n = port->header->frames;
+	rec = &port->records[n % CAPTURE_RECORDS];
+
+	/* Mark the record incomplete while we overwrite it. The fence keeps the stores
+	   below from becoming visible before that. */
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->timestamp = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	memcpy(rec->frame, port->frame, sizeof(rec->frame));
+	__atomic_store_n(&rec->seq, n + 1, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&port->header->frames, n + 1, __ATOMIC_RELEASE);
+
+	return OK;
+}
+
+/* Reset (i.e. turn off all pins) */
+RC leddrvr_capture_reset(PORT *port)
+{
+	assert(port);
+
+	/* Record the empty frame, too */
+	memset(port->frame, 0, sizeof(port->frame));
+
+	return leddrvr_capture_commit(port);
+}
+
+/* Returns LED driver-internal error messages */
+char *leddrvr_capture_errmsg(PORT *port)
+{
+	if (port)
+		return port->errmsg;
+	else
+		return _errmsg;
+}
@@ -0,0 +1,69 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for capture LED driver
+*/
+
+#ifndef _RLEDS_DRVR_CAPTURE_H
+#define _RLEDS_DRVR_CAPTURE_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include "../common/base.h"
+#include "../common/capture.h"
+
+/* Since drvr_capture is part of the main rleds package, we use the same version
+   number */
+#define LEDDRVR_CAPTURE_VERSION PACKAGE_VERSION
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN 100
+
+/* Default device, i.e. the capture file */
+#define DEFAULT_DEVICE "/tmp/rleds.capture"
+
+/* Number of records in the capture file's ring (about 2 MB worth) */
+#define CAPTURE_RECORDS 4096
+
+/* Our private PORT structure */
+struct _port
+{
+	char		*dev_name;			/* Device name */
+	int		fd;				/* The file descriptor for this port */
+
+	CAPTURE_HEADER	*header;			/* The mmap()ed capture file... */
+	CAPTURE_RECORD	*records;			/* ...and its ring of records */
+	size_t		map_len;			/* Length of the mapping */
+
+	uint64_t	frame[CAPTURE_FRAME_WORDS],	/* Pins to be enabled by commit() */
+			allocated[CAPTURE_FRAME_WORDS];	/* Pins that have been allocated */
+	uint		words;				/* Number of words covering all allocated
+							   pins */
+
+	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
+};
+
+/* Prototypes for the functions implemented in this LED driver */
+PORT *leddrvr_capture_init(char *dev_name);
+RC leddrvr_capture_shutdown(PORT *port);
+int leddrvr_capture_alloc(PORT *port, char *pin, uint *bit);
+RC leddrvr_capture_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask);
+RC leddrvr_capture_commit(PORT *port);
+RC leddrvr_capture_reset(PORT *port);
+char *leddrvr_capture_errmsg(PORT *port);
+RC leddrvr_capture_release(PORT *port, int pinh);
+
+#endif
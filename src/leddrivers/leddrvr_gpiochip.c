@@ -0,0 +1,429 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** GPIO character device LED driver
+**
+** Drives LEDs attached to GPIO lines through the GPIO character device uAPI v2
+** (/dev/gpiochipN). Pins are either line offsets or line names as shown by gpioinfo.
+** Lines are requested as outputs by the first commit() after they were allocated,
+** all lines allocated since in a single request per word of the frame masks, so
+** that commit() updates up to 64 LEDs with a single ioctl(). Lines allocated later
+** on, e.g. on a reload, get requests of their own and leave the others alone.
+** Without real hardware, the gpio-sim kernel module provides chips to test with.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+
+#include "leddrvr_gpiochip.h"
+
+/* Description of this driver */
+#define DESCRIPTION "drives LEDs attached to GPIO lines via /dev/gpiochipN"
+
+/* Pins supported by this driver: line offsets or line names */
+#define PINNAMES(PIN) \
+	PIN("0")	PIN("1")	PIN("...")	PIN("<line name>")
+static char *_pinnames[] = {
+	PINNAMES(PIN_NAME)
+	NULL
+};
+
+/* LEDDRIVER structure required by the main program */
+LEDDRIVER leddrvr_gpiochip =
+{
+	LEDDRIVER_API_VER,				/* API version implemented by this LED driver */
+
+	DESCRIPTION,					/* Description for the LED driver */
+	LEDDRVR_GPIOCHIP_VERSION,			/* Version of the LED driver */
+
+	DEFAULT_DEVICE,					/* Default device */
+	_pinnames,					/* Array of pins controlled by this driver */
+
+	leddrvr_gpiochip_init,				/* Init function */
+	leddrvr_gpiochip_shutdown,			/* Shutdown function */
+	leddrvr_gpiochip_alloc,				/* Allocates a pin */
+	leddrvr_gpiochip_set_frame,			/* Sets pins to be enabled */
+	leddrvr_gpiochip_commit,			/* Commit changes made by set_frame() to actual hardware */
+	leddrvr_gpiochip_reset,				/* Resets all pins */
+	leddrvr_gpiochip_errmsg,			/* Returns driver-internal error messages */
+	NULL,						/* Asynchronous commit function (not needed) */
+	NULL,						/* Completion function (not needed) */
+	NULL,						/* Offload function (not supported) */
+	leddrvr_gpiochip_release			/* Frees a pin */
+};
+
+/* Description for listing this driver without loading it */
+LEDDRIVER_NOTE(DESCRIPTION, LEDDRVR_GPIOCHIP_VERSION, DEFAULT_DEVICE, PINNAMES);
+
+/* Buffer for error messages */
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/* Word of the frame masks and bit within it of pin "pin" */
+#define WORD(pin) ((pin) / GPIO_V2_LINES_MAX)
+#define BIT(pin) ((pin) % GPIO_V2_LINES_MAX)
+
+/*
+** Returns the mask of the pins of request "req" within their word.
+*/
+static uint64_t request_mask(const REQUEST *req)
+{
+	if (req->count == GPIO_V2_LINES_MAX)
+		return ~(uint64_t)0;
+	return (((uint64_t)1 << req->count) - 1) << BIT(req->first);
+}
+
+/*
+** rc = request_pending(port)
+**
+** Requests the lines of the pins allocated since the last call as outputs, set to
+** the values in "frame". Requests already made are not touched, so the lines they
+** cover don't glitch.
+**
+** Returns OK on success and ERR on failure, in which case the pins not requested
+** yet are tried again next time.
+*/
+static RC request_pending(PORT *port)
+{
+	while (port->num_requested < port->num_pins)
+	{
+		struct gpio_v2_line_request lr;
+		REQUEST *req = &port->reqs[port->num_reqs];
+		uint first = port->num_requested, i;
+
+		memset(&lr, 0, sizeof(lr));
+		for (i = 0; first + i < port->num_pins && WORD(first + i) == WORD(first); i++)
+			lr.offsets[i] = port->offsets[first + i];
+		lr.num_lines = i;
+		strncpy(lr.consumer, CONSUMER, sizeof(lr.consumer) - 1);
+
+		req->first = first;
+		req->count = i;
+
+		lr.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		lr.config.num_attrs = 1;
+		lr.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		lr.config.attrs[0].attr.values = port->frame[WORD(first)] >> BIT(first);
+		lr.config.attrs[0].mask = request_mask(req) >> BIT(first);
+
+		if (ioctl(port->fd, GPIO_V2_GET_LINE_IOCTL, &lr) == -1)
+		{
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "Could not request lines of GPIO chip \"%s\":\n%s!\n",
+			         port->dev_name, strerror(errno));
+			return ERR;
+		}
+		req->fd = lr.fd;
+		port->num_reqs++;
+		port->num_requested += i;
+
+		port->shadow[WORD(first)] &= ~request_mask(req);
+		port->shadow[WORD(first)] |= port->frame[WORD(first)] & request_mask(req);
+	}
+
+	return OK;
+}
+
+/*
+** Looks up the offset of the line named "name".
+**
+** Returns the offset on success and ERR if there is no such line.
+*/
+static int find_line(PORT *port, char *name)
+{
+	struct gpio_v2_line_info info;
+	uint i;
+
+	for (i = 0; i < port->num_lines; i++)
+	{
+		memset(&info, 0, sizeof(info));
+		info.offset = i;
+		if (ioctl(port->fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == -1)
+			break;
+		if (strncmp(info.name, name, sizeof(info.name)) == 0)
+			return i;
+	}
+
+	return ERR;
+}
+
+/* Initialization function */
+PORT *leddrvr_gpiochip_init(char *dev_name)
+{
+	struct gpiochip_info info;
+	PORT *port;
+
+	/* If no device name was specified, use the default */
+	if (!dev_name)
+		dev_name = DEFAULT_DEVICE;
+
+	/* Initialize error message buffer */
+	*_errmsg = '\0';
+
+	/* Allocate PORT structure for this device */
+	port = calloc(1, sizeof(PORT));
+	if (!port)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for PORT structure!\n");
+		return NULL;
+	}
+	/* Open the chip and find out how many lines it has */
+	port->fd = open(dev_name, O_RDWR | O_CLOEXEC);
+	if (port->fd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not open GPIO chip \"%s\":\n%s!\n",
+		         dev_name, strerror(errno));
+		free(port);
+		return NULL;
+	}
+	memset(&info, 0, sizeof(info));
+	if (ioctl(port->fd, GPIO_GET_CHIPINFO_IOCTL, &info) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "\"%s\" is not a GPIO chip:\n%s!\n",
+		         dev_name, strerror(errno));
+		close(port->fd);
+		free(port);
+		return NULL;
+	}
+	port->num_lines = info.lines;
+
+	/* Remember device name for error messages */
+	port->dev_name = strdup(dev_name);
+
+	return port;
+}
+
+/* Shutdown function */
+RC leddrvr_gpiochip_shutdown(PORT *port)
+{
+	uint i;
+
+	assert(port);
+
+	/* Releasing the lines leaves them as they are */
+	for (i = 0; i < port->num_reqs; i++)
+		close(port->reqs[i].fd);
+	close(port->fd);
+
+	if (port->dev_name)
+		free(port->dev_name);
+	free(port);
+
+	return OK;
+}
+
+/* Allocate the specified pin */
+int leddrvr_gpiochip_alloc(PORT *port, char *pin, uint *bit)
+{
+	struct gpio_v2_line_info info;
+	unsigned long offset;
+	char *end;
+	uint i, n;
+
+	assert(port && pin && bit);
+
+	/* Pins are line offsets or, failing that, line names */
+	offset = strtoul(pin, &end, 10);
+	if (!*pin || *end)
+	{
+		int found = find_line(port, pin);
+
+		if (found == ERR)
+		{
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "GPIO chip \"%s\" has no line named \"%s\"!\n",
+			         port->dev_name, pin);
+			return ERR;
+		}
+		offset = found;
+	}
+	if (offset >= port->num_lines)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "GPIO chip \"%s\" only has lines 0 to %u, not \"%s\"!\n",
+		         port->dev_name, port->num_lines - 1, pin);
+		return ERR;
+	}
+
+	for (i = 0; i < port->num_pins; i++)
+	{
+		if (port->offsets[i] == offset)
+		{
+			uint64_t mask = (uint64_t)1 << BIT(i);
+
+			/* A released line is still requested, so just take it back */
+			if (port->released[WORD(i)] & mask)
+			{
+				port->released[WORD(i)] &= ~mask;
+				*bit = i;
+				return i;
+			}
+
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "Pin \"%s\" of device \"%s\" already in use -- specified twice?\n",
+			         pin, port->dev_name);
+			return ERR;
+		}
+	}
+	if (port->num_pins == MAX_PINS)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "The \"gpiochip\" LED driver supports at most %d pins per device!\n",
+		         MAX_PINS);
+		return ERR;
+	}
+
+	/* The line is only requested by the next commit(), so check now that no one
+	   else has it to fail early */
+	memset(&info, 0, sizeof(info));
+	info.offset = offset;
+	if (ioctl(port->fd, GPIO_V2_GET_LINEINFO_IOCTL, &info) == 0 &&
+	    (info.flags & GPIO_V2_LINE_FLAG_USED))
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Pin \"%s\" of device \"%s\" is in use by \"%s\"!\n",
+		         pin, port->dev_name, info.consumer);
+		return ERR;
+	}
+
+	/* Pins are numbered in the order of allocation */
+	n = port->num_pins++;
+	port->offsets[n] = offset;
+
+	*bit = n;
+	return n;
+}
+
+/* Free the specified pin */
+RC leddrvr_gpiochip_release(PORT *port, int pinh)
+{
+	assert(port && pinh >= 0 && pinh < port->num_pins);
+
+	/* Re-requesting the other lines without this one would glitch them, so the
+	   line stays requested, and off, until it is allocated again or we shut down */
+	port->released[WORD(pinh)] |= (uint64_t)1 << BIT(pinh);
+
+	return OK;
+}
+
+/* Set pins to be enabled */
+RC leddrvr_gpiochip_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask)
+{
+	uint i;
+
+	assert(port && set_mask && valid_mask);
+
+	/* Bits beyond the last pin are left zero */
+	for (i = 0; i < WORD(port->num_pins + GPIO_V2_LINES_MAX - 1); i++)
+		port->frame[i] = set_mask[i] & valid_mask[i] & ~port->released[i];
+	if (BIT(port->num_pins))
+		port->frame[i - 1] &= ((uint64_t)1 << BIT(port->num_pins)) - 1;
+
+	return OK;
+}
+
+/*
+** Sets the lines of request "req" selected by "mask", a mask within their word, to
+** the values in "frame".
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC set_values(PORT *port, const REQUEST *req, uint64_t mask)
+{
+	struct gpio_v2_line_values lv;
+	uint word = WORD(req->first);
+
+	lv.bits = port->frame[word] >> BIT(req->first);
+	lv.mask = (mask & request_mask(req)) >> BIT(req->first);
+	if (ioctl(req->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv) == -1)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Could not set lines of GPIO chip \"%s\":\n%s!\n",
+		         port->dev_name, strerror(errno));
+		return ERR;
+	}
+	port->shadow[word] &= ~(mask & request_mask(req));
+	port->shadow[word] |= port->frame[word] & mask & request_mask(req);
+
+	return OK;
+}
+
+/* Commit changes made by set_frame() to actual hardware */
+RC leddrvr_gpiochip_commit(PORT *port)
+{
+	uint i;
+
+	assert(port);
+
+	/* Lines allocated since the last commit() come up with their values right away */
+	if (request_pending(port) != OK)
+		return ERR;
+
+	/* Touch only the lines that changed, and requests without changes not at all */
+	for (i = 0; i < port->num_reqs; i++)
+	{
+		REQUEST *req = &port->reqs[i];
+		uint64_t changed = (port->frame[WORD(req->first)] ^ port->shadow[WORD(req->first)]) &
+		                   request_mask(req);
+
+		if (changed && set_values(port, req, changed) != OK)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/* Reset (i.e. turn off all pins) */
+RC leddrvr_gpiochip_reset(PORT *port)
+{
+	uint i;
+
+	assert(port);
+
+	/* Don't trust the shadow values here */
+	memset(port->frame, 0, sizeof(port->frame));
+	if (request_pending(port) != OK)
+		return ERR;
+	for (i = 0; i < port->num_reqs; i++)
+	{
+		if (set_values(port, &port->reqs[i], request_mask(&port->reqs[i])) != OK)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/* Returns LED driver-internal error messages */
+char *leddrvr_gpiochip_errmsg(PORT *port)
+{
+	if (port)
+		return port->errmsg;
+	else
+		return _errmsg;
+}
@@ -0,0 +1,89 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for GPIO character device LED driver
+*/
+
+#ifndef _RLEDS_DRVR_GPIOCHIP_H
+#define _RLEDS_DRVR_GPIOCHIP_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include <linux/gpio.h>
+
+#include "../common/base.h"
+
+/* Since drvr_gpiochip is part of the main rleds package, we use the same version
+   number */
+#define LEDDRVR_GPIOCHIP_VERSION PACKAGE_VERSION
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN 100
+
+/* Default device */
+#define DEFAULT_DEVICE "/dev/gpiochip0"
+
+/* Consumer label shown for our lines, e.g. by gpioinfo */
+#define CONSUMER "rleds"
+
+/* Pins map to the bits of the frame masks in the order of allocation, so a
+   port has at most MAX_WORDS words of GPIO_V2_LINES_MAX (64) pins */
+#define MAX_WORDS 4
+#define MAX_PINS (MAX_WORDS * GPIO_V2_LINES_MAX)
+
+/* A line request, for "count" consecutive pins from "first" on. It never spans
+   two words, so that one ioctl() sets all of its lines. */
+typedef struct _request
+{
+	int		fd;				/* File descriptor of the request */
+	uint		first,				/* First pin... */
+			count;				/* ...and number of pins */
+} REQUEST;
+
+/* Our private PORT structure */
+struct _port
+{
+	char		*dev_name;			/* Device name */
+	int		fd;				/* The file descriptor for the chip */
+	uint		num_lines;			/* Number of lines the chip has */
+
+	uint		offsets[MAX_PINS];		/* Line offset per allocated pin, in
+							   the order of allocation */
+	uint		num_pins;			/* Number of pins allocated */
+
+	REQUEST		reqs[MAX_PINS];			/* Line requests... */
+	uint		num_reqs,			/* ...how many there are... */
+			num_requested;			/* ...and the pins they cover, the
+							   rest is requested by commit() */
+	uint64_t	frame[MAX_WORDS],		/* Line values to be set by commit()... */
+			shadow[MAX_WORDS],		/* ...and the ones last set */
+			released[MAX_WORDS];		/* Pins released, their lines still
+							   requested */
+
+	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
+};
+
+/* Prototypes for the functions implemented in this LED driver */
+PORT *leddrvr_gpiochip_init(char *dev_name);
+RC leddrvr_gpiochip_shutdown(PORT *port);
+int leddrvr_gpiochip_alloc(PORT *port, char *pin, uint *bit);
+RC leddrvr_gpiochip_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask);
+RC leddrvr_gpiochip_commit(PORT *port);
+RC leddrvr_gpiochip_reset(PORT *port);
+char *leddrvr_gpiochip_errmsg(PORT *port);
+RC leddrvr_gpiochip_release(PORT *port, int pinh);
+
+#endif
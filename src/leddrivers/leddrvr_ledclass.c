@@ -0,0 +1,424 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** LED class LED driver
+**
+** Drives LEDs registered with the kernel's LED class, i.e. the ones found in
+** /sys/class/leds. The device is the directory to look up LEDs in, pins are LED
+** names. Each LED's "brightness" file is opened once when the pin is allocated;
+** commit() then only pwrite()s to the files of the LEDs that changed.
+**
+** LEDs can also be handed over to the kernel's netdev trigger, which then blinks
+** them on its own.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+
+#include "leddrvr_ledclass.h"
+
+/* Description of this driver */
+#define DESCRIPTION "drives LEDs registered with the kernel's LED class"
+
+/* Pins supported by this driver: the names of the LEDs in the device directory */
+#define PINNAMES(PIN) \
+	PIN("<led name>")
+static char *_pinnames[] = {
+	PINNAMES(PIN_NAME)
+	NULL
+};
+
+/* LEDDRIVER structure required by the main program */
+LEDDRIVER leddrvr_ledclass =
+{
+	LEDDRIVER_API_VER,				/* API version implemented by this LED driver */
+
+	DESCRIPTION,					/* Description for the LED driver */
+	LEDDRVR_LEDCLASS_VERSION,			/* Version of the LED driver */
+
+	DEFAULT_DEVICE,					/* Default device */
+	_pinnames,					/* Array of pins controlled by this driver */
+
+	leddrvr_ledclass_init,				/* Init function */
+	leddrvr_ledclass_shutdown,			/* Shutdown function */
+	leddrvr_ledclass_alloc,				/* Allocates a pin */
+	leddrvr_ledclass_set_frame,			/* Sets pins to be enabled */
+	leddrvr_ledclass_commit,			/* Commit changes made by set_frame() to actual hardware */
+	leddrvr_ledclass_reset,				/* Resets all pins */
+	leddrvr_ledclass_errmsg,			/* Returns driver-internal error messages */
+	NULL,						/* Asynchronous commit function (not needed) */
+	NULL,						/* Completion function (not needed) */
+	leddrvr_ledclass_offload,			/* Hands a pin over to the netdev trigger */
+	leddrvr_ledclass_release			/* Frees a pin */
+};
+
+/* Description for listing this driver without loading it */
+LEDDRIVER_NOTE(DESCRIPTION, LEDDRVR_LEDCLASS_VERSION, DEFAULT_DEVICE, PINNAMES);
+
+/* Buffer for error messages */
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/*
+** Reads the maximum brightness of the LED "name".
+**
+** Returns the maximum brightness, or 1 if it cannot be determined.
+*/
+static unsigned long max_brightness(PORT *port, char *name)
+{
+	char path[FILENAME_MAX], buf[MAX_VALUE_LEN];
+	unsigned long val = 0;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/max_brightness", name);
+	fd = openat(port->dir_fd, path, O_RDONLY | O_CLOEXEC);
+	if (fd != -1)
+	{
+		len = read(fd, buf, sizeof(buf) - 1);
+		if (len > 0)
+		{
+			buf[len] = '\0';
+			val = strtoul(buf, NULL, 10);
+		}
+		close(fd);
+	}
+
+	return val ? val : 1;
+}
+
+/*
+** Writes "val" to the attribute "attr" of the LED "p".
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC write_attr(PORT *port, PIN *p, char *attr, char *val)
+{
+	char path[FILENAME_MAX];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", p->name, attr);
+	fd = openat(port->dir_fd, path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	if (fd == -1)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Could not open \"%s\" of LED \"%s\":\n%s!\n",
+		         attr, p->name, strerror(errno));
+		return ERR;
+	}
+	len = write(fd, val, strlen(val));
+	if (len == -1)
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Could not write \"%s\" of LED \"%s\":\n%s!\n",
+		         attr, p->name, strerror(errno));
+	close(fd);
+
+	return len == -1 ? ERR : OK;
+}
+
+/* Initialization function */
+PORT *leddrvr_ledclass_init(char *dev_name)
+{
+	PORT *port;
+
+	/* If no device name was specified, use the default */
+	if (!dev_name)
+		dev_name = DEFAULT_DEVICE;
+
+	/* Initialize error message buffer */
+	*_errmsg = '\0';
+
+	/* Allocate PORT structure for this device */
+	port = calloc(1, sizeof(PORT));
+	if (!port)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for PORT structure!\n");
+		return NULL;
+	}
+
+	/* LEDs will be looked up relative to the directory */
+	port->dir_fd = open(dev_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (port->dir_fd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not open LED directory \"%s\":\n%s!\n",
+		         dev_name, strerror(errno));
+		free(port);
+		return NULL;
+	}
+
+	/* Remember device name for error messages */
+	port->dev_name = strdup(dev_name);
+
+	return port;
+}
+
+/* Shutdown function */
+RC leddrvr_ledclass_shutdown(PORT *port)
+{
+	uint i;
+
+	assert(port);
+
+	for (i = 0; i < port->num_pins; i++)
+	{
+		if (!port->pins[i].name)
+			continue;
+		close(port->pins[i].fd);
+		free(port->pins[i].name);
+	}
+	close(port->dir_fd);
+
+	if (port->dev_name)
+		free(port->dev_name);
+	free(port);
+
+	return OK;
+}
+
+/* Allocate the specified pin */
+int leddrvr_ledclass_alloc(PORT *port, char *pin, uint *bit)
+{
+	char path[FILENAME_MAX];
+	PIN *p;
+	uint i, n;
+
+	assert(port && pin && bit);
+
+	/* Pins are LED names, i.e. entries of the directory */
+	if (!*pin || strchr(pin, '/') || strcmp(pin, ".") == 0 || strcmp(pin, "..") == 0)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "\"%s\" is not a valid LED name!\n", pin);
+		return ERR;
+	}
+
+	for (i = 0; i < port->num_pins; i++)
+	{
+		if (port->pins[i].name && strcmp(port->pins[i].name, pin) == 0)
+		{
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "Pin \"%s\" of device \"%s\" already in use -- specified twice?\n",
+			         pin, port->dev_name);
+			return ERR;
+		}
+	}
+
+	/* Reuse the entry of a LED released, if any */
+	for (n = 0; n < port->num_pins; n++)
+	{
+		if (!port->pins[n].name)
+			break;
+	}
+	if (n == MAX_PINS)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "The \"ledclass\" LED driver supports at most %d pins per device!\n",
+		         MAX_PINS);
+		return ERR;
+	}
+
+	p = &port->pins[n];
+	snprintf(path, sizeof(path), "%s/brightness", pin);
+	p->fd = openat(port->dir_fd, path, O_WRONLY | O_CLOEXEC);
+	if (p->fd == -1)
+	{
+		snprintf(port->errmsg, sizeof(port->errmsg),
+		         "Could not open LED \"%s\" in \"%s\":\n%s!\n",
+		         pin, port->dev_name, strerror(errno));
+		return ERR;
+	}
+	p->name = strdup(pin);
+
+	/* "On" means full brightness. "Off" is padded with zeroes to the same length,
+	   so that each write replaces the previous value entirely even if the device
+	   is a plain file rather than sysfs. */
+	p->len = snprintf(p->on, sizeof(p->on), "%lu\n", max_brightness(port, pin));
+	memset(p->off, '0', p->len - 1);
+	p->off[p->len - 1] = '\n';
+
+	/* Pins are numbered in the order of allocation. Their state is unknown until
+	   written first. */
+	*bit = n;
+	if (n == port->num_pins)
+		port->num_pins++;
+	port->released[n / 64] &= ~((uint64_t)1 << (n % 64));
+	port->stale[n / 64] |= (uint64_t)1 << (n % 64);
+
+	return *bit;
+}
+
+/* Set pins to be enabled */
+RC leddrvr_ledclass_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask)
+{
+	uint i;
+
+	assert(port && set_mask && valid_mask);
+
+	/* The masks only cover the pins allocated */
+	for (i = 0; i < (port->num_pins + 63) / 64; i++)
+	{
+		port->frame[i] = set_mask[i] & valid_mask[i] & ~port->offloaded[i] & ~port->released[i];
+		if (port->num_pins < (i + 1) * 64)
+			port->frame[i] &= ((uint64_t)1 << (port->num_pins % 64)) - 1;
+	}
+
+	return OK;
+}
+
+/* Commit changes made by set_frame() to actual hardware */
+RC leddrvr_ledclass_commit(PORT *port)
+{
+	uint64_t changed, bit;
+	uint i, n;
+
+	assert(port);
+
+	for (i = 0; i < (port->num_pins + 63) / 64; i++)
+	{
+		/* Visit only the LEDs that need to be written */
+		changed = ((port->frame[i] ^ port->shadow[i]) | port->stale[i]) &
+		          ~port->offloaded[i] & ~port->released[i];
+		while (changed)
+		{
+			PIN *p;
+
+			n = __builtin_ctzll(changed);
+			changed &= changed - 1;
+			p = &port->pins[i * 64 + n];
+
+			bit = (uint64_t)1 << n;
+
+			if (pwrite(p->fd, port->frame[i] & bit ? p->on : p->off, p->len, 0) == -1)
+			{
+				snprintf(port->errmsg, sizeof(port->errmsg),
+				         "Could not set LED \"%s\" in \"%s\":\n%s!\n",
+				         p->name, port->dev_name, strerror(errno));
+				return ERR;
+			}
+			port->shadow[i] = (port->shadow[i] & ~bit) | (port->frame[i] & bit);
+			port->stale[i] &= ~bit;
+		}
+	}
+
+	return OK;
+}
+
+/* Reset (i.e. turn off all pins) */
+RC leddrvr_ledclass_reset(PORT *port)
+{
+	uint i;
+
+	assert(port);
+
+	/* Take LEDs back from the kernel and write all of them, whatever we think their
+	   state is */
+	memset(port->frame, 0, sizeof(port->frame));
+	for (i = 0; i < port->num_pins; i++)
+	{
+		if (port->offloaded[i / 64] & ((uint64_t)1 << (i % 64)))
+			(void)write_attr(port, &port->pins[i], "trigger", "none");
+		port->stale[i / 64] |= (uint64_t)1 << (i % 64);
+	}
+	memset(port->offloaded, 0, sizeof(port->offloaded));
+
+	return leddrvr_ledclass_commit(port);
+}
+
+/* Returns LED driver-internal error messages */
+char *leddrvr_ledclass_errmsg(PORT *port)
+{
+	if (port)
+		return port->errmsg;
+	else
+		return _errmsg;
+}
+
+/* Hands a pin over to the netdev trigger */
+RC leddrvr_ledclass_offload(PORT *port, int pinh, const OFFLOAD *offload)
+{
+	char interval[MAX_VALUE_LEN];
+	uint64_t bit;
+	PIN *p;
+
+	assert(port && pinh >= 0 && pinh < port->num_pins && offload);
+
+	p = &port->pins[pinh];
+	bit = (uint64_t)1 << (pinh % 64);
+
+	/* The trigger's attributes only appear once it is active */
+	snprintf(interval, sizeof(interval), "%u", offload->interval);
+	if (write_attr(port, p, "trigger", "netdev") != OK)
+		return ERR;
+	if (write_attr(port, p, "device_name", offload->if_name) != OK ||
+	    write_attr(port, p, "link", offload->link ? "1" : "0") != OK ||
+	    write_attr(port, p, "rx", offload->rx ? "1" : "0") != OK ||
+	    write_attr(port, p, "tx", offload->tx ? "1" : "0") != OK ||
+	    write_attr(port, p, "interval", interval) != OK)
+	{
+		char errmsg[MAX_ERRMSG_LEN];
+
+		/* Back to manual control. The next commit restores the LED's state. */
+		strcpy(errmsg, port->errmsg);
+		(void)write_attr(port, p, "trigger", "none");
+		strcpy(port->errmsg, errmsg);
+		port->stale[pinh / 64] |= bit;
+		return ERR;
+	}
+
+	port->offloaded[pinh / 64] |= bit;
+	port->stale[pinh / 64] &= ~bit;
+
+	return OK;
+}
+
+/* Frees a pin */
+RC leddrvr_ledclass_release(PORT *port, int pinh)
+{
+	uint64_t bit;
+	PIN *p;
+
+	assert(port && pinh >= 0 && pinh < port->num_pins);
+
+	p = &port->pins[pinh];
+	bit = (uint64_t)1 << (pinh % 64);
+
+	/* Take the LED back from the kernel and leave it off */
+	if (port->offloaded[pinh / 64] & bit)
+	{
+		(void)write_attr(port, p, "trigger", "none");
+		(void)pwrite(p->fd, p->off, p->len, 0);
+		port->offloaded[pinh / 64] &= ~bit;
+	}
+
+	close(p->fd);
+	free(p->name);
+	p->name = NULL;
+	port->shadow[pinh / 64] &= ~bit;
+	port->stale[pinh / 64] &= ~bit;
+	port->released[pinh / 64] |= bit;
+
+	return OK;
+}
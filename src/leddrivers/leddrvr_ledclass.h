@@ -0,0 +1,84 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for LED class LED driver
+*/
+
+#ifndef _RLEDS_DRVR_LEDCLASS_H
+#define _RLEDS_DRVR_LEDCLASS_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include "../common/base.h"
+#include "../common/offload.h"
+
+/* Since drvr_ledclass is part of the main rleds package, we use the same version
+   number */
+#define LEDDRVR_LEDCLASS_VERSION PACKAGE_VERSION
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN 100
+
+/* Default device, i.e. the directory holding the LEDs */
+#define DEFAULT_DEVICE "/sys/class/leds"
+
+/* Maximum number of pins per device and words of the frame masks covering them */
+#define MAX_PINS 256
+#define MAX_WORDS (MAX_PINS / 64)
+
+/* Maximum length of a brightness value written, including the newline */
+#define MAX_VALUE_LEN 12
+
+/* An allocated LED */
+typedef struct _pin
+{
+	char		*name;				/* LED name, i.e. directory name */
+	int		fd;				/* Open "brightness" file */
+	char		on[MAX_VALUE_LEN],		/* Values to write to turn it on... */
+			off[MAX_VALUE_LEN];		/* ...resp. off */
+	int		len;				/* Length of both */
+} PIN;
+
+/* Our private PORT structure */
+struct _port
+{
+	char		*dev_name;			/* Device name */
+	int		dir_fd;				/* The directory holding the LEDs */
+
+	PIN		pins[MAX_PINS];			/* LEDs in the order of allocation */
+	uint		num_pins;			/* Number of LEDs allocated */
+
+	uint64_t	frame[MAX_WORDS],		/* LEDs to be turned on by commit()... */
+			shadow[MAX_WORDS],		/* ...and the ones last turned on */
+			stale[MAX_WORDS],		/* LEDs whose state is unknown */
+			offloaded[MAX_WORDS],		/* LEDs driven by the netdev trigger */
+			released[MAX_WORDS];		/* Unused entries of "pins" */
+
+	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
+};
+
+/* Prototypes for the functions implemented in this LED driver */
+PORT *leddrvr_ledclass_init(char *dev_name);
+RC leddrvr_ledclass_shutdown(PORT *port);
+int leddrvr_ledclass_alloc(PORT *port, char *pin, uint *bit);
+RC leddrvr_ledclass_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask);
+RC leddrvr_ledclass_commit(PORT *port);
+RC leddrvr_ledclass_reset(PORT *port);
+char *leddrvr_ledclass_errmsg(PORT *port);
+RC leddrvr_ledclass_release(PORT *port, int pinh);
+RC leddrvr_ledclass_offload(PORT *port, int pinh, const OFFLOAD *offload);
+
+#endif
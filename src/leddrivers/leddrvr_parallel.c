@@ -32,19 +32,24 @@
 
 #include "leddrvr_parallel.h"
 
+/* Description of this driver */
+#define DESCRIPTION "drives LEDs attached to a parallel port"
+
 /* Pins supported by this driver */
-char *_pinnames[] = {
-	"Strobe",	"AutoFeed",	"Init",		"SelIn",
-	"D0",		"D1",		"D2",		"D3",
-	"D4",		"D5",		"D6",		"D7",
+#define PINNAMES(PIN) \
+	PIN("Strobe")	PIN("AutoFeed")	PIN("Init")	PIN("SelIn") \
+	PIN("D0")	PIN("D1")	PIN("D2")	PIN("D3") \
+	PIN("D4")	PIN("D5")	PIN("D6")	PIN("D7")
+static char *_pinnames[] = {
+	PINNAMES(PIN_NAME)
 	NULL
 };
-REG _pinregs[] = {
+static REG _pinregs[] = {
 	CONTROL_REG,	CONTROL_REG,	CONTROL_REG,	CONTROL_REG,
 	DATA_REG,	DATA_REG,	DATA_REG,	DATA_REG,
 	DATA_REG,	DATA_REG,	DATA_REG,	DATA_REG
 };
-uint _pinvals[] = {
+static uint _pinvals[] = {
 	1,		2,		4,		8,
 	1,		2,		4,		8,
 	16,		32,		64,		128
@@ -56,7 +61,7 @@ LEDDRIVER leddrvr_parallel =
 {
 	LEDDRIVER_API_VER,				/* API version implemented by this LED driver */
 
-	"drives LEDs attached to a parallel port",	/* Description for the LED driver */
+	DESCRIPTION,					/* Description for the LED driver */
 	LEDDRVR_PARALLEL_VERSION,			/* Version of the LED driver */
 
 	DEFAULT_DEVICE,					/* Default device */
@@ -65,14 +70,21 @@ LEDDRIVER leddrvr_parallel =
 	leddrvr_parallel_init,				/* Init function */
 	leddrvr_parallel_shutdown,			/* Shutdown function */
 	leddrvr_parallel_alloc,				/* Allocates a pin */
-	leddrvr_parallel_enable,			/* Set pin to be enabled */
-	leddrvr_parallel_commit,			/* Commit changes made by enable() to actual hardware */
+	leddrvr_parallel_set_frame,			/* Sets pins to be enabled */
+	leddrvr_parallel_commit,			/* Commit changes made by set_frame() to actual hardware */
 	leddrvr_parallel_reset,				/* Resets all pins */
-	leddrvr_parallel_errmsg				/* Returns driver-internal error messages */
+	leddrvr_parallel_errmsg,			/* Returns driver-internal error messages */
+	NULL,						/* Asynchronous commit function (not needed) */
+	NULL,						/* Completion function (not needed) */
+	NULL,						/* Offload function (not supported) */
+	leddrvr_parallel_release			/* Frees a pin */
 };
 
+/* Description for listing this driver without loading it */
+LEDDRIVER_NOTE(DESCRIPTION, LEDDRVR_PARALLEL_VERSION, DEFAULT_DEVICE, PINNAMES);
+
 /* Buffer for error messages */
-char _errmsg[MAX_ERRMSG_LEN];
+static char _errmsg[MAX_ERRMSG_LEN];
 
 /* Initialization function */
 PORT *leddrvr_parallel_init(char *dev_name)
@@ -129,8 +141,6 @@ PORT *leddrvr_parallel_init(char *dev_name)
 	/* Remember device name for error messages */
 	port->dev_name = strdup(dev_name);
 
-	fprintf(stderr, "Will initialize %s (%d) (allocated=%p)\n", port->dev_name, port->fd, port->allocated);
-
 	/* Finally, initialize it */
 	if (leddrvr_parallel_reset(port) != OK)
 	{
@@ -169,12 +179,12 @@ RC leddrvr_parallel_shutdown(PORT *port)
 }
 
 /* Allocate the specified pin */
-RC leddrvr_parallel_alloc(PORT *port, char *pin)
+int leddrvr_parallel_alloc(PORT *port, char *pin, uint *bit)
 {
 	char **p;
 	int i;
 
-	assert(port && port->allocated && pin);
+	assert(port && port->allocated && pin && bit);
 
 	/* Lookup specified pin */
 	for (i=0, p=_pinnames; i<NUM_PINS; i++, p++)
@@ -185,7 +195,10 @@ RC leddrvr_parallel_alloc(PORT *port, char *pin)
 			if (!port->allocated[i])
 			{
 				port->allocated[i] = TRUE;
-				return OK;
+
+				/* Pins are identified by their index in _pinnames */
+				*bit = i;
+				return i;
 			}
 
 			/* Nope, already in use */
@@ -203,65 +216,82 @@ RC leddrvr_parallel_alloc(PORT *port, char *pin)
 	return ERR;
 }
 
-/* Set pin to be enabled */
-RC leddrvr_parallel_enable(PORT *port, char *pin)
+/* Free the specified pin */
+RC leddrvr_parallel_release(PORT *port, int pinh)
 {
-	char **p;
-	int i;
+	assert(port && port->allocated && pinh >= 0 && pinh < NUM_PINS);
 
-	assert(port && port->allocated && pin);
+	port->allocated[pinh] = FALSE;
 
-	/* Lookup specified pin */
-	for (i=0, p=_pinnames; i<NUM_PINS; i++, p++)
+	return OK;
+}
+
+/* Set pins to be enabled */
+RC leddrvr_parallel_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask)
+{
+	uint64_t bits;
+
+	assert(port && set_mask && valid_mask);
+
+	/* All of our pins fit into the first word */
+	bits = set_mask[0] & valid_mask[0];
+
+	/* Add up the regvals of all pins to be enabled */
+	port->cval = CONTROL_INIT;
+	port->dval = DATA_INIT;
+	while (bits)
 	{
-		if (strcasecmp(*p, pin) == 0)
-		{
-			/* Found, now check if not allocated */
-			if (!port->allocated[i])
-			{
-				snprintf(port->errmsg, sizeof(port->errmsg),
-				         "Pin \"%s\" of device \"%s\" was not allocated!\n",
-				         pin, port->dev_name);
-				return ERR;
-			}
+		int i = __builtin_ctzll(bits);
 
-			/* It was, so add the its regval to reg */
-			if (_pinregs[i] == CONTROL_REG)
-				port->cval -= _pinvals[i];
-			else
-				port->dval += _pinvals[i];
+		bits &= bits - 1;
+		if (i >= NUM_PINS)
+			break;
 
-			return OK;
-		}
+		if (_pinregs[i] == CONTROL_REG)
+			port->cval -= _pinvals[i];
+		else
+			port->dval += _pinvals[i];
 	}
 
-	/* Pin not found */
-	snprintf(port->errmsg, sizeof(port->errmsg),
-	         "The \"parallel\" LED driver does not know about a pin named \"%s\"!\n",
-	         pin);
-	return ERR;
+	return OK;
 }
 
-/* Commit changes made by calls to enable() to actual hardware */
+/* Commit changes made by set_frame() to actual hardware */
 RC leddrvr_parallel_commit(PORT *port)
 {
 	assert(port && port->fd);
 
-	fprintf(stderr, "[%s] Writing to control: %d, to data: %d\n", port->dev_name, port->cval, port->dval);
-
-	/* Write out values */
-	if (ioctl(port->fd, PPWCONTROL, &port->cval) == -1 ||
-	    ioctl(port->fd, PPWDATA, &port->dval)    == -1)
+	/* Only touch the registers whose value changed. For the control register, we
+	   frob just the bits that changed. */
+	if (port->cval != port->cshadow)
 	{
-		snprintf(port->errmsg, sizeof(port->errmsg),
-		         "ioctl() on parallel port device \"%s\" failed:\n%s!\n",
-			 port->dev_name, strerror(errno));
-		return ERR;
+		struct ppdev_frob_struct frob;
+
+		frob.mask = port->cval ^ port->cshadow;
+		frob.val = port->cval & frob.mask;
+		if (ioctl(port->fd, PPFCONTROL, &frob) == -1)
+		{
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "ioctl() on parallel port device \"%s\" failed:\n%s!\n",
+				 port->dev_name, strerror(errno));
+			return ERR;
+		}
+		port->cshadow = port->cval;
 	}
 
-	/* Reset values */
-	port->cval = CONTROL_INIT;
-	port->dval = DATA_INIT;
+	if (port->dval != port->dshadow)
+	{
+		unsigned char dval = port->dval;
+
+		if (ioctl(port->fd, PPWDATA, &dval) == -1)
+		{
+			snprintf(port->errmsg, sizeof(port->errmsg),
+			         "ioctl() on parallel port device \"%s\" failed:\n%s!\n",
+				 port->dev_name, strerror(errno));
+			return ERR;
+		}
+		port->dshadow = dval;
+	}
 
 	return OK;
 }
@@ -272,14 +302,12 @@ RC leddrvr_parallel_reset(PORT *port)
 	assert(port && port->fd);
 
 	/* Reset values... */
-	port->cval = CONTROL_INIT;
-	port->dval = DATA_INIT;
-
-	fprintf(stderr, "[%s/%d] Reset cval to %d and dval to %d\n", port->dev_name, port->fd, port->cval, port->dval);
+	port->cval = port->cshadow = CONTROL_INIT;
+	port->dval = port->dshadow = DATA_INIT;
 
-	/* ..and write out */
-	if (ioctl(port->fd, PPWCONTROL, port->cval) == -1 ||
-	    ioctl(port->fd, PPWDATA, port->dval)    == -1)
+	/* ..and write out both registers, as we don't know their previous state */
+	if (ioctl(port->fd, PPWCONTROL, &port->cshadow) == -1 ||
+	    ioctl(port->fd, PPWDATA, &port->dshadow)    == -1)
 	{
 		snprintf(port->errmsg, sizeof(port->errmsg),
 		         "ioctl() on parallel port device \"%s\" failed:\n%s!\n",
@@ -42,11 +42,11 @@ typedef enum _reg  {
 
 /* Initialization values for control and data registers (all writeable
    control register pins are active low) */
-const int CONTROL_INIT = PARPORT_CONTROL_STROBE |
-                         PARPORT_CONTROL_AUTOFD |
-                         PARPORT_CONTROL_INIT   |
-                         PARPORT_CONTROL_SELECT;
-const int DATA_INIT    = 0;
+static const int CONTROL_INIT = PARPORT_CONTROL_STROBE |
+                                PARPORT_CONTROL_AUTOFD |
+                                PARPORT_CONTROL_INIT   |
+                                PARPORT_CONTROL_SELECT;
+static const int DATA_INIT    = 0;
 
 /* Our private PORT structure */
 struct _port
@@ -56,6 +56,8 @@ struct _port
 
 	int		cval,				/* Control register value to be written */
 			dval;				/* Data register value to be written */
+	unsigned char	cshadow,			/* Control register value last written */
+			dshadow;			/* Data register value last written */
 
 	BOOL		*allocated;			/* Tracks which pins of the port have been
 							   allocated */
@@ -66,10 +68,11 @@ struct _port
 /* Prototypes for the functions implemented in this LED driver */
 PORT *leddrvr_parallel_init(char *dev_name);
 RC leddrvr_parallel_shutdown(PORT *port);
-RC leddrvr_parallel_alloc(PORT *port, char *pin);
-RC leddrvr_parallel_enable(PORT *port, char *pin);
+int leddrvr_parallel_alloc(PORT *port, char *pin, uint *bit);
+RC leddrvr_parallel_set_frame(PORT *port, const uint64_t *set_mask, const uint64_t *valid_mask);
 RC leddrvr_parallel_commit(PORT *port);
 RC leddrvr_parallel_reset(PORT *port);
 char *leddrvr_parallel_errmsg(PORT *port);
+RC leddrvr_parallel_release(PORT *port, int pinh);
 
 #endif
@@ -22,7 +22,10 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
-#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
 
 #include "../common/base.h"
 #include "../common/netifhandlers.h"
@@ -30,29 +33,155 @@
 #include "netifh_generic.h"
 
 /* Buffer for global error messages */
-char _errmsg[MAX_ERRMSG_LEN];
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/* Description of this handler and its tri-color LED support */
+#define DESCRIPTION "generic interface handler"
+#define TRICOL_DESCRIPTION "unsupported"
 
 /* NETIFHANDLER structure required by the main program */
 NETIFHANDLER netifh_generic =
 {
 	NETIFHANDLER_API_VER,				/* API version implemented by this interface handler */
 
-	"generic interface handler",			/* Description of the interface handler */
+	DESCRIPTION,					/* Description of the interface handler */
 	NETIFH_GENERIC_VERSION,				/* Version of the interface handler */
 
-	"unsupported",					/* Description text for this handler's tri-color LED support */
+	TRICOL_DESCRIPTION,				/* Description text for this handler's tri-color LED support */
 
 	netifh_generic_init,				/* Initialization function */
 	netifh_generic_shutdown,			/* Shutdown function */
 	netifh_generic_col,				/* LED color function */
-	netifh_generic_errmsg				/* Returns interface handler-internal error messages */	
+	netifh_generic_errmsg,				/* Returns interface handler-internal error messages */
+	NULL,						/* Batch LED color function (not needed) */
+	netifh_generic_stats,				/* Statistics function */
+	netifh_generic_offload,				/* Offload description function */
+	netifh_generic_brightness			/* Brightness function */
 };
 
+/* Description for listing this handler without loading it */
+NETIFHANDLER_NOTE(DESCRIPTION, NETIFH_GENERIC_VERSION, TRICOL_DESCRIPTION);
+
+/*
+** Closes the statistics files of "netif", if open.
+*/
+static void close_counters(NETIF *netif)
+{
+	if (netif->rx_fd != -1)
+		close(netif->rx_fd);
+	if (netif->tx_fd != -1)
+		close(netif->tx_fd);
+	if (netif->rx_bytes_fd != -1)
+		close(netif->rx_bytes_fd);
+	if (netif->tx_bytes_fd != -1)
+		close(netif->tx_bytes_fd);
+	netif->rx_fd = netif->tx_fd = netif->rx_bytes_fd = netif->tx_bytes_fd = -1;
+}
+
+/*
+** Opens the statistics file "path" of "netif" into "fd".
+**
+** Returns OK on success and ERR on failure. "gone" is set if the interface does not
+** exist (which is not an error).
+*/
+static RC open_counter(NETIF *netif, char *path, int *fd, BOOL *gone)
+{
+	*fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (*fd == -1)
+	{
+		if (errno == ENOENT || errno == ENODEV)
+		{
+			*gone = TRUE;
+			return OK;
+		}
+
+		snprintf(netif->errmsg, sizeof(netif->errmsg),
+		         "Could not open \"%s\":\n%s\n",
+		         path, strerror(errno));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** Opens the packet statistics files of "netif". They are kept open for as long as
+** the interface exists, so that each sample is a single pread() per counter.
+**
+** Returns OK on success and ERR on failure. "gone" is set if the interface does not
+** exist (which is not an error).
+*/
+static RC open_counters(NETIF *netif, BOOL *gone)
+{
+	if (open_counter(netif, netif->rx_path, &netif->rx_fd, gone) != OK ||
+	    (!*gone && open_counter(netif, netif->tx_path, &netif->tx_fd, gone) != OK))
+	{
+		close_counters(netif);
+		return ERR;
+	}
+	if (*gone)
+		close_counters(netif);
+
+	return OK;
+}
+
+/*
+** Reads the counter value from the already open statistics file "fd" (whose name is
+** "path") into "val".
+**
+** Returns OK on success and ERR on failure. "gone" is set if the interface has
+** disappeared since the file was opened (which is not an error).
+*/
+static RC read_counter(NETIF *netif, int fd, char *path, unsigned long long *val, BOOL *gone)
+{
+	char buf[SYSFS_BUFLEN];
+	unsigned long long v = 0;
+	ssize_t len, i;
+
+	len = pread(fd, buf, sizeof(buf), 0);
+	if (len == -1)
+	{
+		/* Attributes of an unregistered network device return ENODEV */
+		if (errno == ENODEV || errno == ENOENT)
+		{
+			*gone = TRUE;
+			return OK;
+		}
+
+		snprintf(netif->errmsg, sizeof(netif->errmsg),
+		         "Could not read \"%s\":\n%s\n",
+			 path, strerror(errno));
+		return ERR;
+	}
+
+	/* sysfs never returns an empty attribute, so an empty read means the file we
+	   hold was removed behind our back */
+	if (len == 0)
+	{
+		*gone = TRUE;
+		return OK;
+	}
+
+	for (i = 0; i < len && buf[i] >= '0' && buf[i] <= '9'; i++)
+		v = v * 10 + (buf[i] - '0');
+	if (i == 0)
+	{
+		snprintf(netif->errmsg, sizeof(netif->errmsg),
+		         "Unexpected contents in \"%s\"\n",
+			 path);
+		return ERR;
+	}
+
+	*val = v;
+	return OK;
+}
+
 /* Initialization function */
 NETIF *netifh_generic_init(char *if_name)
 {
 	NETIF *netif;
 	char filenamebuf[PATH_MAX];
+	char *prefix, *sep;
 
 	assert(if_name);
 
@@ -60,7 +189,7 @@ NETIF *netifh_generic_init(char *if_name)
 	*_errmsg = '\0';
 
 	/* Allocate NETIF structure for this interface */
-	netif = malloc(sizeof(NETIF));
+	netif = calloc(1, sizeof(NETIF));
 	if (!netif)
 	{
 		snprintf(_errmsg, sizeof(_errmsg),
@@ -68,15 +197,44 @@ NETIF *netifh_generic_init(char *if_name)
 		return NULL;
 	}
 
-	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s", SYSFS_PREFIX, if_name);
-	netif->if_path = strdup(filenamebuf);
+	/* Use an alternative root for the interface directories, if configured */
+	prefix = getenv(SYSFS_PREFIX_ENV);
+	if (!prefix || !*prefix)
+		prefix = SYSFS_PREFIX;
+	sep = prefix[strlen(prefix) - 1] == '/' ? "" : "/";
+
+	/* The kernel only knows the interfaces in the real sysfs */
+	if (strcmp(prefix, SYSFS_PREFIX) == 0)
+		netif->if_name = strdup(if_name);
 
-	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s", SYSFS_PREFIX, if_name, SYSFS_RX_SUFFIX);
+	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s%s", prefix, sep, if_name, SYSFS_RX_SUFFIX);
 	netif->rx_path = strdup(filenamebuf);
 
-	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s", SYSFS_PREFIX, if_name, SYSFS_TX_SUFFIX);
+	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s%s", prefix, sep, if_name, SYSFS_TX_SUFFIX);
 	netif->tx_path = strdup(filenamebuf);
 
+	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s%s", prefix, sep, if_name, SYSFS_RX_BYTES_SUFFIX);
+	netif->rx_bytes_path = strdup(filenamebuf);
+
+	snprintf(filenamebuf, sizeof(filenamebuf), "%s%s%s%s", prefix, sep, if_name, SYSFS_TX_BYTES_SUFFIX);
+	netif->tx_bytes_path = strdup(filenamebuf);
+
+	if (!netif->rx_path || !netif->tx_path || !netif->rx_bytes_path || !netif->tx_bytes_path)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for NETIF structure!\n");
+		free(netif->if_name);
+		free(netif->rx_path);
+		free(netif->tx_path);
+		free(netif->rx_bytes_path);
+		free(netif->tx_bytes_path);
+		free(netif);
+		return NULL;
+	}
+
+	/* The statistics files are opened on first use */
+	netif->rx_fd = netif->tx_fd = netif->rx_bytes_fd = netif->tx_bytes_fd = -1;
+
 	return netif;
 }
 
@@ -85,6 +243,12 @@ RC netifh_generic_shutdown(NETIF *netif)
 {
 	assert(netif);
 
+	close_counters(netif);
+	free(netif->if_name);
+	free(netif->rx_path);
+	free(netif->tx_path);
+	free(netif->rx_bytes_path);
+	free(netif->tx_bytes_path);
 	free(netif);
 
 	return OK;
@@ -93,49 +257,29 @@ RC netifh_generic_shutdown(NETIF *netif)
 /* LED color function */
 RC netifh_generic_col(NETIF *netif, LEDSTATE *ledstate)
 {
-	DIR *dir;
+	unsigned long long rx_packets = 0, tx_packets = 0;
+	struct timespec ts;
+	BOOL gone = FALSE;
 
 	assert(netif && ledstate);
 
-	/* Check whether interface is up (= sysfs path exists) */
-	dir = opendir(netif->if_path);
-	if (dir)
-	{
-		FILE *file;
-		char buf[SYSFS_BUFLEN];
-		long int rx_packets, tx_packets;
+	/* (Re)open the statistics files if the interface was gone before */
+	if (netif->rx_fd == -1 && open_counters(netif, &gone) != OK)
+		return ERR;
 
-		/* Fetch current rx_packets value */
-		file = fopen(netif->rx_path, "r");
-		if (file)
-		{
-			fgets(buf, sizeof(buf), file);
-			rx_packets = atol(buf);
-			fclose(file);
-		}
-		else
-		{
-			snprintf(netif->errmsg, sizeof(netif->errmsg),
-			         "Could not open \"%s\":\n%s\n",
-				 netif->rx_path, strerror(errno));
-			return ERR;
-		}
+	/* Fetch current rx_packets and tx_packets values */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	netif->sampled = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	if (!gone &&
+	    (read_counter(netif, netif->rx_fd, netif->rx_path, &rx_packets, &gone) != OK ||
+	     read_counter(netif, netif->tx_fd, netif->tx_path, &tx_packets, &gone) != OK))
+		return ERR;
 
-		/* Fetch current tx_packets value */
-		file = fopen(netif->tx_path, "r");
-		if (file)
-		{
-			fgets(buf, sizeof(buf), file);
-			tx_packets = atol(buf);
-			fclose(file);
-		}
-		else
-		{
-			snprintf(netif->errmsg, sizeof(netif->errmsg),
-			         "Could not open \"%s\":\n%s\n",
-				 netif->tx_path, strerror(errno));
-			return ERR;
-		}
+	/* Check whether interface is up (= statistics files are there) */
+	if (!gone)
+	{
+		netif->rx_cur = rx_packets;
+		netif->tx_cur = tx_packets;
 
 		/* If the interface just went up (and during startup), turn on the LED */
 		if (!netif->up)
@@ -146,44 +290,113 @@ RC netifh_generic_col(NETIF *netif, LEDSTATE *ledstate)
 			/* Store initial values */
 			netif->rx_packets = rx_packets;
 			netif->tx_packets = tx_packets;
+			netif->activity = 0;
 		}
 		/* Otherwise compare rx_packets and tx_packets values */
 		else
 		{
-			/* Was there a change in any of the values? */
-			if (rx_packets > netif->rx_packets ||
-			    tx_packets > netif->tx_packets)
+			unsigned long long rx = counter_delta(rx_packets, netif->rx_packets),
+			                   tx = counter_delta(tx_packets, netif->tx_packets);
+
+			/* Did any of the values grow? */
+			if (rx || tx)
 			{
 				/* If yes, toggle the LED */
 				if (*ledstate == LEDSTATE_PRIM)
 					*ledstate = LEDSTATE_OFF;
 				else
 					*ledstate = LEDSTATE_PRIM;
-
-				/* And remember the new values */
-				netif->rx_packets = rx_packets;
-				netif->tx_packets = tx_packets;
+				netif->activity = rx + tx;
 			}
 			/* Otherwise turn the LED back on */
 			else
+			{
 				*ledstate = LEDSTATE_PRIM;
-		}
+				netif->activity = 0;
+			}
 
-		closedir(dir);
+			/* Remember the new values, which also starts over from counters
+			   that went backwards */
+			netif->rx_packets = rx_packets;
+			netif->tx_packets = tx_packets;
+		}
 	}
-	else if (errno == ENOENT)
+	else
 	{
+		/* Drop the descriptors so they get reopened once the interface is back */
+		close_counters(netif);
+
 		netif->up = 0;
 		*ledstate = LEDSTATE_OFF;
 	}
-	else
-	{
-		snprintf(netif->errmsg, sizeof(netif->errmsg),
-		         "Could not open \"%s\":\n%s\n",
-			 netif->if_path, strerror(errno));
+
+	return OK;
+}
+
+/* Statistics function */
+RC netifh_generic_stats(NETIF *netif, NETIFSTATS *stats)
+{
+	BOOL gone = FALSE;
+
+	assert(netif && stats);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->timestamp = netif->sampled;
+	if (!netif->up)
+		return OK;
+
+	/* col() doesn't need the byte counters, so we read them here */
+	if (netif->rx_bytes_fd == -1 &&
+	    (open_counter(netif, netif->rx_bytes_path, &netif->rx_bytes_fd, &gone) != OK ||
+	     (!gone && open_counter(netif, netif->tx_bytes_path, &netif->tx_bytes_fd, &gone) != OK)))
 		return ERR;
+
+	if (!gone &&
+	    (read_counter(netif, netif->rx_bytes_fd, netif->rx_bytes_path, &stats->rx_bytes, &gone) != OK ||
+	     read_counter(netif, netif->tx_bytes_fd, netif->tx_bytes_path, &stats->tx_bytes, &gone) != OK))
+		return ERR;
+
+	/* Just gone? col() will notice next time */
+	if (gone)
+	{
+		if (netif->rx_bytes_fd != -1)
+			close(netif->rx_bytes_fd);
+		if (netif->tx_bytes_fd != -1)
+			close(netif->tx_bytes_fd);
+		netif->rx_bytes_fd = netif->tx_bytes_fd = -1;
+		return OK;
 	}
 
+	stats->up = TRUE;
+	stats->rx_packets = netif->rx_cur;
+	stats->tx_packets = netif->tx_cur;
+
+	return OK;
+}
+
+/* Offload description function */
+RC netifh_generic_offload(NETIF *netif, OFFLOAD *offload)
+{
+	assert(netif && offload);
+
+	if (!netif->if_name)
+		return ERR;
+
+	/* On while the interface has carrier, toggling on packets in either direction.
+	   Unlike when sampled, the LED goes dark on a down or unplugged interface. */
+	offload->if_name = netif->if_name;
+	offload->link = offload->rx = offload->tx = TRUE;
+
+	return OK;
+}
+
+/* Brightness function */
+RC netifh_generic_brightness(NETIF *netif, uint *brightness)
+{
+	assert(netif && brightness);
+
+	*brightness = netif->up ? activity_brightness(netif->activity) : 0;
+
 	return OK;
 }
 
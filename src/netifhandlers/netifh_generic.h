@@ -33,23 +33,45 @@
 /* sysfs prefix to interface data (with trailing slash) */
 #define SYSFS_PREFIX "/sys/class/net/"
 
+/* Environment variable that, if set, replaces SYSFS_PREFIX, e.g. to point us to a fake
+   tree built by rleds-netgen */
+#define SYSFS_PREFIX_ENV "RLEDS_SYSFS_NET"
+
 /* sysfx suffixes to get number of received and number of transmitted packets (with heading slashes) */
 #define SYSFS_RX_SUFFIX "/statistics/rx_packets"
 #define SYSFS_TX_SUFFIX "/statistics/tx_packets"
 
-/* Length of buffer for reads from sysfs files */
-#define SYSFS_BUFLEN 20
+/* The same for the number of bytes (only read for stats()) */
+#define SYSFS_RX_BYTES_SUFFIX "/statistics/rx_bytes"
+#define SYSFS_TX_BYTES_SUFFIX "/statistics/tx_bytes"
+
+/* Length of buffer for reads from sysfs files (enough for a 64-bit counter plus
+   newline) */
+#define SYSFS_BUFLEN 24
 
 /* Our private NETIF structure */
 struct _netif
 {
-	char		*if_path;			/* Sysfs path for interface */
 	BOOL		up;				/* Remember whether interface is/was up */
 
+	char		*if_name;			/* Interface name (NULL if the interface
+							   lives in an alternative sysfs tree) */
 	char		*rx_path,			/* Sysfs path for rx_packets value */
-			*tx_path;			/* Sysfs path for tx_packets value */
-	long int 	rx_packets,			/* Last remembered rx_packets value */
-			tx_packets;			/* Last remembered tx_packets value */
+			*tx_path,			/* Sysfs path for tx_packets value */
+			*rx_bytes_path,			/* Sysfs path for rx_bytes value */
+			*tx_bytes_path;			/* Sysfs path for tx_bytes value */
+	int		rx_fd,				/* Open descriptors for the paths above */
+			tx_fd,				/* (-1 if closed; the bytes files are only */
+			rx_bytes_fd,			/* opened once stats() gets called) */
+			tx_bytes_fd;
+	unsigned long long
+			rx_cur,				/* rx_packets value from the last read */
+			tx_cur,				/* tx_packets value from the last read */
+			rx_packets,			/* Last remembered rx_packets value */
+			tx_packets,			/* Last remembered tx_packets value */
+			activity;			/* Packets seen by the last sample */
+	uint64_t	sampled;			/* CLOCK_MONOTONIC time of the last read in
+							   nanoseconds */
 
 	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
 };
@@ -59,5 +81,8 @@ NETIF *netifh_generic_init(char *if_name);
 RC netifh_generic_shutdown(NETIF *netif);
 RC netifh_generic_col(NETIF *netif, LEDSTATE *ledstate);
 char *netifh_generic_errmsg(NETIF *netif);
+RC netifh_generic_stats(NETIF *netif, NETIFSTATS *stats);
+RC netifh_generic_offload(NETIF *netif, OFFLOAD *offload);
+RC netifh_generic_brightness(NETIF *netif, uint *brightness);
 
 #endif
@@ -0,0 +1,656 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** rtnetlink interface handler
+**
+** Instead of polling sysfs for every interface on every call, this handler keeps a
+** single rtnetlink socket per process. Link state changes are pushed to us by the
+** kernel through the RTNLGRP_LINK multicast group and the packet counters of all
+** watched interfaces are fetched with one RTM_GETSTATS dump per sampling round.
+** Like the generic and procnetdev handlers, we consider an interface up as long as
+** it exists, regardless of its administrative (IFF_UP) and carrier state, so that
+** switching handlers does not change what the LEDs show.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+#include "netifh_netlink.h"
+
+/* Buffer for global error messages */
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/* The rtnetlink socket shared by all watched interfaces */
+static int _sock = -1;
+
+/* Sequence number of the last request sent */
+static unsigned int _seq;
+
+/* Set when our view of the interfaces' link states must be refreshed by a full
+   RTM_GETLINK dump (initially and after we lost multicast events) */
+static BOOL _resync;
+
+/* All watched interfaces and a hash over them by interface index */
+static NETIF *_netifs;
+static NETIF *_hash[NETLINK_HASH_SIZE];
+
+/* Receive buffer */
+static char _buf[NETLINK_BUFLEN];
+
+/* CLOCK_MONOTONIC time of the last counter dump in nanoseconds */
+static uint64_t _sampled;
+
+/* Description of this handler and its tri-color LED support */
+#define DESCRIPTION "rtnetlink event-driven interface handler"
+#define TRICOL_DESCRIPTION "unsupported"
+
+/* NETIFHANDLER structure required by the main program */
+NETIFHANDLER netifh_netlink =
+{
+	NETIFHANDLER_API_VER,				/* API version implemented by this interface handler */
+
+	DESCRIPTION,					/* Description of the interface handler */
+	NETIFH_NETLINK_VERSION,				/* Version of the interface handler */
+
+	TRICOL_DESCRIPTION,				/* Description text for this handler's tri-color LED support */
+
+	netifh_netlink_init,				/* Initialization function */
+	netifh_netlink_shutdown,			/* Shutdown function */
+	netifh_netlink_col,				/* LED color function */
+	netifh_netlink_errmsg,				/* Returns interface handler-internal error messages */
+	netifh_netlink_col_batch,			/* Batch LED color function */
+	netifh_netlink_stats,				/* Statistics function */
+	netifh_netlink_offload,				/* Offload description function */
+	netifh_netlink_brightness			/* Brightness function */
+};
+
+/* Description for listing this handler without loading it */
+NETIFHANDLER_NOTE(DESCRIPTION, NETIFH_NETLINK_VERSION, TRICOL_DESCRIPTION);
+
+/*
+** Removes "netif" from the interface index hash.
+*/
+static void unhash_netif(NETIF *netif)
+{
+	NETIF **pp;
+
+	for (pp = &_hash[netif->if_index % NETLINK_HASH_SIZE]; *pp; pp = &(*pp)->hnext)
+	{
+		if (*pp == netif)
+		{
+			*pp = netif->hnext;
+			break;
+		}
+	}
+	netif->hnext = NULL;
+}
+
+/*
+** Assigns "if_index" to "netif", keeping the interface index hash up to date.
+*/
+static void set_if_index(NETIF *netif, int if_index)
+{
+	if (netif->if_index == if_index)
+		return;
+
+	if (netif->if_index)
+		unhash_netif(netif);
+
+	netif->if_index = if_index;
+	if (if_index)
+	{
+		netif->hnext = _hash[if_index % NETLINK_HASH_SIZE];
+		_hash[if_index % NETLINK_HASH_SIZE] = netif;
+	}
+}
+
+/*
+** Opens the rtnetlink socket and subscribes to link events.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC open_socket(void)
+{
+	struct sockaddr_nl addr;
+	int group = RTNLGRP_LINK;
+
+	_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+	if (_sock == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not open rtnetlink socket:\n%s\n",
+		         strerror(errno));
+		return ERR;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	if (bind(_sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    setsockopt(_sock, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not subscribe to link events:\n%s\n",
+		         strerror(errno));
+		close(_sock);
+		_sock = -1;
+		return ERR;
+	}
+
+	_resync = TRUE;
+
+	return OK;
+}
+
+/*
+** Sends a dump request of type "type" with "payload" of "len" bytes as the family
+** header.
+**
+** Returns the sequence number used or 0 on failure.
+*/
+static unsigned int send_dump(int type, void *payload, size_t len)
+{
+	struct
+	{
+		struct nlmsghdr		nh;
+		char			payload[sizeof(struct if_stats_msg) > sizeof(struct ifinfomsg) ?
+					        sizeof(struct if_stats_msg) : sizeof(struct ifinfomsg)];
+	} req;
+	struct sockaddr_nl addr;
+
+	assert(len <= sizeof(req.payload));
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(len);
+	req.nh.nlmsg_type = type;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq = ++_seq ? _seq : ++_seq;
+	memcpy(req.payload, payload, len);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if (sendto(_sock, &req, req.nh.nlmsg_len, 0, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not send rtnetlink request:\n%s\n",
+		         strerror(errno));
+		return 0;
+	}
+
+	return req.nh.nlmsg_seq;
+}
+
+/*
+** Processes a RTM_NEWLINK or RTM_DELLINK message, whether part of a dump or a
+** multicast event.
+*/
+static void process_link(struct nlmsghdr *nh)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *rta;
+	int len = IFLA_PAYLOAD(nh);
+	char *name = NULL;
+	NETIF *netif;
+
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+	{
+		if (rta->rta_type == IFLA_IFNAME)
+		{
+			name = RTA_DATA(rta);
+			break;
+		}
+	}
+
+	for (netif = _netifs; netif; netif = netif->next)
+	{
+		/* An interface we watch was renamed away */
+		if (netif->if_index == ifi->ifi_index &&
+		    (!name || strcmp(netif->if_name, name) != 0))
+		{
+			set_if_index(netif, 0);
+			netif->present = FALSE;
+		}
+
+		if (name && strcmp(netif->if_name, name) == 0)
+		{
+			if (nh->nlmsg_type == RTM_DELLINK)
+			{
+				set_if_index(netif, 0);
+				netif->present = FALSE;
+			}
+			else
+			{
+				set_if_index(netif, ifi->ifi_index);
+				netif->present = TRUE;
+			}
+		}
+	}
+}
+
+/*
+** Processes a RTM_NEWSTATS message.
+*/
+static void process_stats(struct nlmsghdr *nh)
+{
+	struct if_stats_msg *ifsm = NLMSG_DATA(nh);
+	struct rtattr *rta;
+	int len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+	NETIF *netif;
+
+	for (netif = _hash[ifsm->ifindex % NETLINK_HASH_SIZE]; netif; netif = netif->hnext)
+	{
+		if (netif->if_index == ifsm->ifindex)
+			break;
+	}
+	if (!netif)
+		return;
+
+	rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+	{
+		if (rta->rta_type == IFLA_STATS_LINK_64)
+		{
+			struct rtnl_link_stats64 stats;
+
+			memset(&stats, 0, sizeof(stats));
+			memcpy(&stats, RTA_DATA(rta),
+			       RTA_PAYLOAD(rta) < sizeof(stats) ? RTA_PAYLOAD(rta) : sizeof(stats));
+
+			/* Interfaces we watch may share the same index while one of them has
+			   not been told about a rename yet; update all of them */
+			for (; netif; netif = netif->hnext)
+			{
+				if (netif->if_index == ifsm->ifindex)
+				{
+					netif->rx_cur = stats.rx_packets;
+					netif->tx_cur = stats.tx_packets;
+					netif->rx_bytes_cur = stats.rx_bytes;
+					netif->tx_bytes_cur = stats.tx_bytes;
+				}
+			}
+			break;
+		}
+	}
+}
+
+/*
+** Receives and processes everything waiting on the socket. If "seq" is non-zero,
+** blocks until the dump with that sequence number has completed.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC receive(unsigned int seq)
+{
+	BOOL done = seq ? FALSE : TRUE;
+
+	while (1)
+	{
+		struct nlmsghdr *nh;
+		ssize_t len;
+
+		len = recv(_sock, _buf, sizeof(_buf), 0);
+		if (len == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				struct pollfd pfd = { _sock, POLLIN, 0 };
+
+				if (done)
+					return OK;
+
+				/* Wait for the remainder of the dump */
+				if (poll(&pfd, 1, NETLINK_TIMEOUT) > 0)
+					continue;
+
+				snprintf(_errmsg, sizeof(_errmsg),
+				         "Timeout waiting for rtnetlink reply\n");
+				return ERR;
+			}
+
+			/* We lost multicast events because we didn't read fast enough. Our view
+			   of the link states must be refreshed. */
+			if (errno == ENOBUFS)
+			{
+				_resync = TRUE;
+				continue;
+			}
+
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not receive from rtnetlink socket:\n%s\n",
+			         strerror(errno));
+			return ERR;
+		}
+
+		for (nh = (struct nlmsghdr *)_buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len))
+		{
+			switch (nh->nlmsg_type)
+			{
+				case RTM_NEWLINK:
+				case RTM_DELLINK:
+					process_link(nh);
+					break;
+
+				case RTM_NEWSTATS:
+					process_stats(nh);
+					break;
+
+				case NLMSG_DONE:
+					if (seq && nh->nlmsg_seq == seq)
+						done = TRUE;
+					break;
+
+				case NLMSG_ERROR:
+				{
+					struct nlmsgerr *err = NLMSG_DATA(nh);
+
+					if (seq && nh->nlmsg_seq == seq && err->error)
+					{
+						snprintf(_errmsg, sizeof(_errmsg),
+						         "rtnetlink request failed:\n%s\n",
+						         strerror(-err->error));
+						return ERR;
+					}
+					break;
+				}
+			}
+		}
+
+		/* Don't block on a socket that has nothing more to tell us */
+		if (done)
+			seq = 0;
+	}
+}
+
+/*
+** Performs a sampling round: processes pending link events, refreshes link states if
+** necessary and fetches the counters of all interfaces with a single dump.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC sample(void)
+{
+	struct if_stats_msg ifsm;
+	struct timespec ts;
+	unsigned int seq;
+	NETIF *netif;
+
+	/* Process pending link events */
+	if (receive(0) != OK)
+		return ERR;
+
+	/* Refresh link states if necessary */
+	if (_resync)
+	{
+		struct ifinfomsg ifi;
+
+		_resync = FALSE;
+
+		/* Interfaces not mentioned in the dump don't exist */
+		for (netif = _netifs; netif; netif = netif->next)
+		{
+			set_if_index(netif, 0);
+			netif->present = FALSE;
+		}
+
+		memset(&ifi, 0, sizeof(ifi));
+		ifi.ifi_family = AF_UNSPEC;
+		seq = send_dump(RTM_GETLINK, &ifi, sizeof(ifi));
+		if (!seq || receive(seq) != OK)
+		{
+			_resync = TRUE;
+			return ERR;
+		}
+	}
+
+	/* Fetch the counters of all interfaces */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	_sampled = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	memset(&ifsm, 0, sizeof(ifsm));
+	ifsm.family = AF_UNSPEC;
+	ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+	seq = send_dump(RTM_GETSTATS, &ifsm, sizeof(ifsm));
+	if (!seq || receive(seq) != OK)
+		return ERR;
+
+	for (netif = _netifs; netif; netif = netif->next)
+		netif->fresh = TRUE;
+
+	return OK;
+}
+
+/* Initialization function */
+NETIF *netifh_netlink_init(char *if_name)
+{
+	NETIF *netif;
+
+	assert(if_name);
+
+	/* Initialize error message buffer */
+	*_errmsg = '\0';
+
+	if (strlen(if_name) >= IF_NAMESIZE)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Interface name \"%s\" too long!\n",
+		         if_name);
+		return NULL;
+	}
+
+	/* Open the socket shared by all interfaces, if necessary */
+	if (_sock == -1 && open_socket() != OK)
+		return NULL;
+
+	/* Allocate NETIF structure for this interface */
+	netif = calloc(1, sizeof(NETIF));
+	if (!netif)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for NETIF structure!\n");
+		return NULL;
+	}
+	strcpy(netif->if_name, if_name);
+
+	/* Watch it. Its index and link state will be learned by the next sampling round. */
+	netif->next = _netifs;
+	_netifs = netif;
+	_resync = TRUE;
+
+	return netif;
+}
+
+/* Shutdown function */
+RC netifh_netlink_shutdown(NETIF *netif)
+{
+	NETIF **pp;
+
+	assert(netif);
+
+	set_if_index(netif, 0);
+	for (pp = &_netifs; *pp; pp = &(*pp)->next)
+	{
+		if (*pp == netif)
+		{
+			*pp = netif->next;
+			break;
+		}
+	}
+	free(netif);
+
+	/* Close the socket with the last interface */
+	if (!_netifs && _sock != -1)
+	{
+		close(_sock);
+		_sock = -1;
+	}
+
+	return OK;
+}
+
+/*
+** Determines the LED state for "netif" from the link state and counters fetched by
+** the last sampling round.
+*/
+static void update_ledstate(NETIF *netif, LEDSTATE *ledstate)
+{
+	netif->fresh = FALSE;
+
+	if (netif->present)
+	{
+		/* If the interface just went up (and during startup), turn on the LED */
+		if (!netif->up)
+		{
+			netif->up = 1;
+			*ledstate = LEDSTATE_PRIM;
+
+			/* Store initial values */
+			netif->rx_packets = netif->rx_cur;
+			netif->tx_packets = netif->tx_cur;
+			netif->activity = 0;
+		}
+		/* Otherwise compare rx_packets and tx_packets values */
+		else
+		{
+			unsigned long long rx = counter_delta(netif->rx_cur, netif->rx_packets),
+			                   tx = counter_delta(netif->tx_cur, netif->tx_packets);
+
+			/* Did any of the values grow? */
+			if (rx || tx)
+			{
+				/* If yes, toggle the LED */
+				if (*ledstate == LEDSTATE_PRIM)
+					*ledstate = LEDSTATE_OFF;
+				else
+					*ledstate = LEDSTATE_PRIM;
+				netif->activity = rx + tx;
+			}
+			/* Otherwise turn the LED back on */
+			else
+			{
+				*ledstate = LEDSTATE_PRIM;
+				netif->activity = 0;
+			}
+
+			/* Remember the new values, which also starts over from counters
+			   that went backwards */
+			netif->rx_packets = netif->rx_cur;
+			netif->tx_packets = netif->tx_cur;
+		}
+	}
+	else
+	{
+		netif->up = 0;
+		*ledstate = LEDSTATE_OFF;
+	}
+}
+
+/* LED color function */
+RC netifh_netlink_col(NETIF *netif, LEDSTATE *ledstate)
+{
+	assert(netif && ledstate);
+
+	/* If we've already looked at this interface's counters since the last sampling
+	   round, it's time for a new one */
+	if (!netif->fresh && sample() != OK)
+	{
+		snprintf(netif->errmsg, sizeof(netif->errmsg), "%s", _errmsg);
+		return ERR;
+	}
+
+	update_ledstate(netif, ledstate);
+
+	return OK;
+}
+
+/* Batch LED color function */
+RC netifh_netlink_col_batch(NETIF **netifs, LEDSTATE **ledstates, int count)
+{
+	int i;
+
+	assert(netifs && ledstates);
+
+	/* One sampling round covers all interfaces */
+	if (sample() != OK)
+		return ERR;
+
+	for (i = 0; i < count; i++)
+		update_ledstate(netifs[i], ledstates[i]);
+
+	return OK;
+}
+
+/* Statistics function */
+RC netifh_netlink_stats(NETIF *netif, NETIFSTATS *stats)
+{
+	assert(netif && stats);
+
+	stats->up = netif->present;
+	stats->rx_packets = netif->rx_cur;
+	stats->tx_packets = netif->tx_cur;
+	stats->rx_bytes = netif->rx_bytes_cur;
+	stats->tx_bytes = netif->tx_bytes_cur;
+	stats->timestamp = _sampled;
+
+	return OK;
+}
+
+/* Offload description function */
+RC netifh_netlink_offload(NETIF *netif, OFFLOAD *offload)
+{
+	assert(netif && offload);
+
+	/* On while the interface has carrier, toggling on packets in either direction.
+	   Unlike when sampled, the LED goes dark on a down or unplugged interface. */
+	offload->if_name = netif->if_name;
+	offload->link = offload->rx = offload->tx = TRUE;
+
+	return OK;
+}
+
+/* Brightness function */
+RC netifh_netlink_brightness(NETIF *netif, uint *brightness)
+{
+	assert(netif && brightness);
+
+	*brightness = netif->up ? activity_brightness(netif->activity) : 0;
+
+	return OK;
+}
+
+/* Returns interface handler-internal error messages */
+char *netifh_netlink_errmsg(NETIF *netif)
+{
+	if (netif)
+		return netif->errmsg;
+
+	return _errmsg;
+}
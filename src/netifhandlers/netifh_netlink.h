@@ -0,0 +1,82 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for rtnetlink network interface handler
+*/
+
+#ifndef NETIFH_NETLINK_H
+#define NETIFH_NETLINK_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <net/if.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+/* Since netifh_netlink is part of the main rleds package, we use the same version
+   number */
+#define NETIFH_NETLINK_VERSION PACKAGE_VERSION
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN 100
+
+/* Size of the buffer netlink messages are received into. Dump replies are split by the
+   kernel into chunks that fit into the buffer offered, so this merely limits the number
+   of recv() calls per dump. */
+#define NETLINK_BUFLEN 32768
+
+/* Number of milliseconds to wait for the kernel to answer a dump request */
+#define NETLINK_TIMEOUT 1000
+
+/* Number of buckets in the interface index hash */
+#define NETLINK_HASH_SIZE 64
+
+/* Our private NETIF structure */
+struct _netif
+{
+	char		if_name[IF_NAMESIZE];		/* Interface name */
+	int		if_index;			/* Kernel interface index (0 if unknown) */
+	BOOL		present;			/* Interface exists, as last reported by
+							   the kernel */
+	BOOL		fresh;				/* Counters below were updated by a dump but
+							   not yet looked at by col() */
+
+	BOOL		up;				/* Remember whether interface is/was up */
+	unsigned long long
+			rx_cur,				/* rx_packets value from the last dump */
+			tx_cur,				/* tx_packets value from the last dump */
+			rx_bytes_cur,			/* rx_bytes value from the last dump */
+			tx_bytes_cur,			/* tx_bytes value from the last dump */
+			rx_packets,			/* Last remembered rx_packets value */
+			tx_packets,			/* Last remembered tx_packets value */
+			activity;			/* Packets seen by the last sample */
+
+	struct _netif	*next,				/* Next watched interface */
+			*hnext;				/* Next interface in the same hash bucket */
+
+	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
+};
+
+/* Prototypes for the functions implemented in this interface handler */
+NETIF *netifh_netlink_init(char *if_name);
+RC netifh_netlink_shutdown(NETIF *netif);
+RC netifh_netlink_col(NETIF *netif, LEDSTATE *ledstate);
+char *netifh_netlink_errmsg(NETIF *netif);
+RC netifh_netlink_col_batch(NETIF **netifs, LEDSTATE **ledstates, int count);
+RC netifh_netlink_stats(NETIF *netif, NETIFSTATS *stats);
+RC netifh_netlink_offload(NETIF *netif, OFFLOAD *offload);
+RC netifh_netlink_brightness(NETIF *netif, uint *brightness);
+
+#endif
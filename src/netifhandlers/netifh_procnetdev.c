@@ -0,0 +1,544 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** /proc/net/dev interface handler
+**
+** Fills the state of all watched interfaces from one pass over /proc/net/dev per
+** sampling round, read page by page into a single buffer. The file is tokenized
+** by first classifying all of its bytes into bitmasks (digits, newlines, colons),
+** 16 bytes at a time with SSE2 where available, and then walking the set bits of
+** these masks to locate the lines and the counter fields we're interested in.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+#include "netifh_procnetdev.h"
+
+/* Buffer for global error messages */
+static char _errmsg[MAX_ERRMSG_LEN];
+
+/* Descriptor for /proc/net/dev, kept open while interfaces are watched */
+static int _fd = -1;
+
+/* Number of watched interfaces */
+static int _num_netifs;
+
+/* Hash over the watched interfaces by name */
+static NETIF *_hash[PROCNETDEV_HASH_SIZE];
+
+/* Number of the last read of /proc/net/dev */
+static unsigned int _generation;
+
+/* CLOCK_MONOTONIC time of the last read in nanoseconds */
+static uint64_t _sampled;
+
+/* Buffer /proc/net/dev is read into and the classification masks for it, one bit per
+   byte. "_starts" marks the first digit of each number. */
+static char *_buf;
+static size_t _bufsize;
+static uint64_t *_starts, *_newlines, *_colons;
+
+/* Description of this handler and its tri-color LED support */
+#define DESCRIPTION "reads all interfaces from /proc/net/dev at once"
+#define TRICOL_DESCRIPTION "unsupported"
+
+/* NETIFHANDLER structure required by the main program */
+NETIFHANDLER netifh_procnetdev =
+{
+	NETIFHANDLER_API_VER,				/* API version implemented by this interface handler */
+
+	DESCRIPTION,					/* Description of the interface handler */
+	NETIFH_PROCNETDEV_VERSION,			/* Version of the interface handler */
+
+	TRICOL_DESCRIPTION,				/* Description text for this handler's tri-color LED support */
+
+	netifh_procnetdev_init,				/* Initialization function */
+	netifh_procnetdev_shutdown,			/* Shutdown function */
+	netifh_procnetdev_col,				/* LED color function */
+	netifh_procnetdev_errmsg,			/* Returns interface handler-internal error messages */
+	netifh_procnetdev_col_batch,			/* Batch LED color function */
+	netifh_procnetdev_stats,			/* Statistics function */
+	netifh_procnetdev_offload,			/* Offload description function */
+	netifh_procnetdev_brightness			/* Brightness function */
+};
+
+/* Description for listing this handler without loading it */
+NETIFHANDLER_NOTE(DESCRIPTION, NETIFH_PROCNETDEV_VERSION, TRICOL_DESCRIPTION);
+
+/*
+** Returns the hash bucket for the interface name "name" of length "len".
+*/
+static NETIF **hash_bucket(const char *name, size_t len)
+{
+	uint32_t h = 2166136261u;
+
+	while (len--)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+
+	return &_hash[h % PROCNETDEV_HASH_SIZE];
+}
+
+/*
+** (Re)allocates the read buffer and the classification masks for "size" bytes.
+** The buffer gets 64 bytes of slack so that the classification can always work on
+** whole 64 byte blocks.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC alloc_buffers(size_t size)
+{
+	size_t words = size / 64 + 1;
+	char *buf;
+	uint64_t *starts, *newlines, *colons;
+
+	buf = realloc(_buf, size + 64);
+	if (buf)
+		_buf = buf;
+	starts = realloc(_starts, words * sizeof(uint64_t));
+	if (starts)
+		_starts = starts;
+	newlines = realloc(_newlines, words * sizeof(uint64_t));
+	if (newlines)
+		_newlines = newlines;
+	colons = realloc(_colons, words * sizeof(uint64_t));
+	if (colons)
+		_colons = colons;
+	if (!buf || !starts || !newlines || !colons)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for reading \"%s\"!\n",
+		         PROCNETDEV_PATH);
+		return ERR;
+	}
+
+	_bufsize = size;
+	return OK;
+}
+
+/*
+** Classifies the first "len" bytes of the read buffer into the bitmasks. The buffer
+** must be zero-padded up to the next multiple of 64 bytes.
+*/
+static void classify(size_t len)
+{
+	size_t words = (len + 63) / 64, w;
+	uint64_t carry = 0;
+
+	for (w = 0; w < words; w++)
+	{
+		const char *p = _buf + w * 64;
+		uint64_t digits = 0, newlines = 0, colons = 0;
+#ifdef __SSE2__
+		const __m128i lo = _mm_set1_epi8('0' - 1),
+		              hi = _mm_set1_epi8('9' + 1),
+		              nl = _mm_set1_epi8('\n'),
+		              co = _mm_set1_epi8(':');
+		int i;
+
+		for (i = 0; i < 4; i++)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+			__m128i d = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+
+			digits   |= (uint64_t)(uint16_t)_mm_movemask_epi8(d) << (i * 16);
+			newlines |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (i * 16);
+			colons   |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, co)) << (i * 16);
+		}
+#else
+		int i;
+
+		for (i = 0; i < 64; i++)
+		{
+			if (p[i] >= '0' && p[i] <= '9')
+				digits |= (uint64_t)1 << i;
+			else if (p[i] == '\n')
+				newlines |= (uint64_t)1 << i;
+			else if (p[i] == ':')
+				colons |= (uint64_t)1 << i;
+		}
+#endif
+
+		/* A number starts at every digit not preceded by another one */
+		_starts[w] = digits & ~((digits << 1) | carry);
+		carry = digits >> 63;
+
+		_newlines[w] = newlines;
+		_colons[w] = colons;
+	}
+}
+
+/*
+** Returns the position of the first bit set in "mask" at or after "pos" and before
+** "end", or -1 if there is none.
+*/
+static long next_bit(const uint64_t *mask, long pos, long end)
+{
+	long w = pos / 64;
+	uint64_t bits;
+
+	if (pos >= end)
+		return -1;
+
+	bits = mask[w] & (~(uint64_t)0 << (pos % 64));
+	while (!bits)
+	{
+		if (++w * 64 >= end)
+			return -1;
+		bits = mask[w];
+	}
+
+	pos = w * 64 + __builtin_ctzll(bits);
+	return pos < end ? pos : -1;
+}
+
+/*
+** Parses the decimal number at position "pos" of the read buffer.
+*/
+static unsigned long long parse_number(long pos)
+{
+	unsigned long long v = 0;
+	const char *p = _buf + pos;
+
+	while (*p >= '0' && *p <= '9')
+		v = v * 10 + (*p++ - '0');
+
+	return v;
+}
+
+/*
+** Reads /proc/net/dev and updates the counters of all watched interfaces listed in
+** it.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC sample(void)
+{
+	struct timespec ts;
+	ssize_t len;
+	long pos, end;
+	int line;
+
+	/* Read the file up to its end. seq_file based proc files return at most about a
+	   page per read, however large the buffer offered, so keep reading at increasing
+	   offsets and grow the buffer only when it is full. */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	_sampled = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	len = 0;
+	while (1)
+	{
+		ssize_t n;
+
+		if ((size_t)len == _bufsize && alloc_buffers(_bufsize * 2) != OK)
+			return ERR;
+
+		n = pread(_fd, _buf + len, _bufsize - len, len);
+		if (n == -1)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not read \"%s\":\n%s\n",
+			         PROCNETDEV_PATH, strerror(errno));
+			return ERR;
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+	memset(_buf + len, 0, 64);
+
+	classify(len);
+	_generation++;
+
+	/* Walk the lines */
+	for (pos = 0, line = 0; pos < len; pos = end + 1, line++)
+	{
+		long colon, field;
+		const char *name;
+		NETIF *netif;
+		int i;
+
+		end = next_bit(_newlines, pos, len);
+		if (end == -1)
+			end = len;
+
+		if (line < PROCNETDEV_HEADER_LINES)
+			continue;
+
+		/* The interface name is everything up to the colon, minus leading blanks */
+		colon = next_bit(_colons, pos, end);
+		if (colon == -1)
+			continue;
+		for (name = _buf + pos; *name == ' '; name++)
+			;
+
+		for (netif = *hash_bucket(name, _buf + colon - name); netif; netif = netif->hnext)
+		{
+			if (strlen(netif->if_name) == _buf + colon - name &&
+			    memcmp(netif->if_name, name, _buf + colon - name) == 0)
+				break;
+		}
+		if (!netif)
+			continue;
+
+		/* Locate the counters among the numbers following the colon */
+		for (i = 0, field = next_bit(_starts, colon + 1, end);
+		     field != -1 && i <= PROCNETDEV_TX_PACKETS;
+		     i++, field = next_bit(_starts, field + 1, end))
+		{
+			if (i == PROCNETDEV_RX_BYTES)
+				netif->rx_bytes_cur = parse_number(field);
+			else if (i == PROCNETDEV_RX_PACKETS)
+				netif->rx_cur = parse_number(field);
+			else if (i == PROCNETDEV_TX_BYTES)
+				netif->tx_bytes_cur = parse_number(field);
+			else if (i == PROCNETDEV_TX_PACKETS)
+			{
+				netif->tx_cur = parse_number(field);
+				netif->seen = _generation;
+			}
+		}
+	}
+
+	return OK;
+}
+
+/*
+** Determines the LED state for "netif" from the counters fetched by the last read.
+*/
+static void update_ledstate(NETIF *netif, LEDSTATE *ledstate)
+{
+	/* Check whether interface is up (= listed in /proc/net/dev) */
+	if (netif->seen == _generation)
+	{
+		/* If the interface just went up (and during startup), turn on the LED */
+		if (!netif->up)
+		{
+			netif->up = 1;
+			*ledstate = LEDSTATE_PRIM;
+
+			/* Store initial values */
+			netif->rx_packets = netif->rx_cur;
+			netif->tx_packets = netif->tx_cur;
+			netif->activity = 0;
+		}
+		/* Otherwise compare rx_packets and tx_packets values */
+		else
+		{
+			unsigned long long rx = counter_delta(netif->rx_cur, netif->rx_packets),
+			                   tx = counter_delta(netif->tx_cur, netif->tx_packets);
+
+			/* Did any of the values grow? */
+			if (rx || tx)
+			{
+				/* If yes, toggle the LED */
+				if (*ledstate == LEDSTATE_PRIM)
+					*ledstate = LEDSTATE_OFF;
+				else
+					*ledstate = LEDSTATE_PRIM;
+				netif->activity = rx + tx;
+			}
+			/* Otherwise turn the LED back on */
+			else
+			{
+				*ledstate = LEDSTATE_PRIM;
+				netif->activity = 0;
+			}
+
+			/* Remember the new values, which also starts over from counters
+			   that went backwards */
+			netif->rx_packets = netif->rx_cur;
+			netif->tx_packets = netif->tx_cur;
+		}
+	}
+	else
+	{
+		netif->up = 0;
+		*ledstate = LEDSTATE_OFF;
+	}
+}
+
+/* Initialization function */
+NETIF *netifh_procnetdev_init(char *if_name)
+{
+	NETIF *netif, **bucket;
+
+	assert(if_name);
+
+	/* Initialize error message buffer */
+	*_errmsg = '\0';
+
+	if (strlen(if_name) >= IF_NAMESIZE)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Interface name \"%s\" too long!\n",
+		         if_name);
+		return NULL;
+	}
+
+	/* Open /proc/net/dev with the first interface */
+	if (_fd == -1)
+	{
+		if (!_buf && alloc_buffers(PROCNETDEV_BUFLEN) != OK)
+			return NULL;
+
+		_fd = open(PROCNETDEV_PATH, O_RDONLY | O_CLOEXEC);
+		if (_fd == -1)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not open \"%s\":\n%s\n",
+			         PROCNETDEV_PATH, strerror(errno));
+			return NULL;
+		}
+	}
+
+	/* Allocate NETIF structure for this interface */
+	netif = calloc(1, sizeof(NETIF));
+	if (!netif)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Not enough memory for NETIF structure!\n");
+		return NULL;
+	}
+	strcpy(netif->if_name, if_name);
+
+	bucket = hash_bucket(if_name, strlen(if_name));
+	netif->hnext = *bucket;
+	*bucket = netif;
+	_num_netifs++;
+
+	return netif;
+}
+
+/* Shutdown function */
+RC netifh_procnetdev_shutdown(NETIF *netif)
+{
+	NETIF **pp;
+
+	assert(netif);
+
+	for (pp = hash_bucket(netif->if_name, strlen(netif->if_name)); *pp; pp = &(*pp)->hnext)
+	{
+		if (*pp == netif)
+		{
+			*pp = netif->hnext;
+			break;
+		}
+	}
+	free(netif);
+
+	/* Close /proc/net/dev with the last interface */
+	if (--_num_netifs == 0 && _fd != -1)
+	{
+		close(_fd);
+		_fd = -1;
+	}
+
+	return OK;
+}
+
+/* LED color function */
+RC netifh_procnetdev_col(NETIF *netif, LEDSTATE *ledstate)
+{
+	assert(netif && ledstate);
+
+	if (sample() != OK)
+	{
+		strncpy(netif->errmsg, _errmsg, sizeof(netif->errmsg));
+		return ERR;
+	}
+
+	update_ledstate(netif, ledstate);
+
+	return OK;
+}
+
+/* Batch LED color function */
+RC netifh_procnetdev_col_batch(NETIF **netifs, LEDSTATE **ledstates, int count)
+{
+	int i;
+
+	assert(netifs && ledstates);
+
+	/* One read covers all interfaces */
+	if (sample() != OK)
+		return ERR;
+
+	for (i = 0; i < count; i++)
+		update_ledstate(netifs[i], ledstates[i]);
+
+	return OK;
+}
+
+/* Statistics function */
+RC netifh_procnetdev_stats(NETIF *netif, NETIFSTATS *stats)
+{
+	assert(netif && stats);
+
+	stats->up = netif->seen == _generation;
+	stats->rx_packets = netif->rx_cur;
+	stats->tx_packets = netif->tx_cur;
+	stats->rx_bytes = netif->rx_bytes_cur;
+	stats->tx_bytes = netif->tx_bytes_cur;
+	stats->timestamp = _sampled;
+
+	return OK;
+}
+
+/* Offload description function */
+RC netifh_procnetdev_offload(NETIF *netif, OFFLOAD *offload)
+{
+	assert(netif && offload);
+
+	/* On while the interface has carrier, toggling on packets in either direction.
+	   Unlike when sampled, the LED goes dark on a down or unplugged interface. */
+	offload->if_name = netif->if_name;
+	offload->link = offload->rx = offload->tx = TRUE;
+
+	return OK;
+}
+
+/* Brightness function */
+RC netifh_procnetdev_brightness(NETIF *netif, uint *brightness)
+{
+	assert(netif && brightness);
+
+	*brightness = netif->up ? activity_brightness(netif->activity) : 0;
+
+	return OK;
+}
+
+/* Returns interface handler-internal error messages */
+char *netifh_procnetdev_errmsg(NETIF *netif)
+{
+	if (netif)
+		return netif->errmsg;
+
+	return _errmsg;
+}
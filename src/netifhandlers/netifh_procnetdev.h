@@ -0,0 +1,86 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for /proc/net/dev network interface handler
+*/
+
+#ifndef NETIFH_PROCNETDEV_H
+#define NETIFH_PROCNETDEV_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <net/if.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+/* Since netifh_procnetdev is part of the main rleds package, we use the same version
+   number */
+#define NETIFH_PROCNETDEV_VERSION PACKAGE_VERSION
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN 100
+
+/* The file we read */
+#define PROCNETDEV_PATH "/proc/net/dev"
+
+/* Initial size of the buffer /proc/net/dev is read into (grows as necessary) */
+#define PROCNETDEV_BUFLEN 16384
+
+/* Number of header lines in /proc/net/dev */
+#define PROCNETDEV_HEADER_LINES 2
+
+/* Positions of the counters we're interested in among the numeric fields following
+   the interface name */
+#define PROCNETDEV_RX_BYTES 0
+#define PROCNETDEV_RX_PACKETS 1
+#define PROCNETDEV_TX_BYTES 8
+#define PROCNETDEV_TX_PACKETS 9
+
+/* Number of buckets in the interface name hash */
+#define PROCNETDEV_HASH_SIZE 256
+
+/* Our private NETIF structure */
+struct _netif
+{
+	char		if_name[IF_NAMESIZE];		/* Interface name */
+	unsigned int	seen;				/* Number of the last read the interface
+							   was listed in */
+
+	BOOL		up;				/* Remember whether interface is/was up */
+	unsigned long long
+			rx_cur,				/* rx_packets value from the last read */
+			tx_cur,				/* tx_packets value from the last read */
+			rx_bytes_cur,			/* rx_bytes value from the last read */
+			tx_bytes_cur,			/* tx_bytes value from the last read */
+			rx_packets,			/* Last remembered rx_packets value */
+			tx_packets,			/* Last remembered tx_packets value */
+			activity;			/* Packets seen by the last sample */
+
+	struct _netif	*hnext;				/* Next interface in the same hash bucket */
+
+	char		errmsg[MAX_ERRMSG_LEN];		/* Error message */
+};
+
+/* Prototypes for the functions implemented in this interface handler */
+NETIF *netifh_procnetdev_init(char *if_name);
+RC netifh_procnetdev_shutdown(NETIF *netif);
+RC netifh_procnetdev_col(NETIF *netif, LEDSTATE *ledstate);
+char *netifh_procnetdev_errmsg(NETIF *netif);
+RC netifh_procnetdev_col_batch(NETIF **netifs, LEDSTATE **ledstates, int count);
+RC netifh_procnetdev_stats(NETIF *netif, NETIFSTATS *stats);
+RC netifh_procnetdev_offload(NETIF *netif, OFFLOAD *offload);
+RC netifh_procnetdev_brightness(NETIF *netif, uint *brightness);
+
+#endif
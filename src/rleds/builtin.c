@@ -0,0 +1,59 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Plugins compiled into the program
+**
+** With --enable-builtin-plugins, the bundled LED drivers and network interface
+** handlers are linked into rleds (see Makefile.in) and listed here, so that they
+** are found without dlopen()ing anything and their callbacks can be optimized
+** together with ours. Otherwise the tables are empty.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+#include "../common/netifhandlers.h"
+
+#include "plugins.h"
+
+#ifdef BUILTIN_PLUGINS
+extern LEDDRIVER leddrvr_parallel, leddrvr_capture, leddrvr_gpiochip, leddrvr_ledclass;
+extern NETIFHANDLER netifh_generic, netifh_netlink, netifh_procnetdev;
+#endif
+
+/* LED drivers compiled in */
+const BUILTIN_PLUGIN _builtin_leddrivers[] =
+{
+#ifdef BUILTIN_PLUGINS
+	{ "leddrvr_parallel",		&leddrvr_parallel },
+	{ "leddrvr_capture",		&leddrvr_capture },
+	{ "leddrvr_gpiochip",		&leddrvr_gpiochip },
+	{ "leddrvr_ledclass",		&leddrvr_ledclass },
+#endif
+	{ NULL,				NULL }
+};
+
+/* Network interface handlers compiled in */
+const BUILTIN_PLUGIN _builtin_netifhandlers[] =
+{
+#ifdef BUILTIN_PLUGINS
+	{ "netifh_generic",		&netifh_generic },
+	{ "netifh_netlink",		&netifh_netlink },
+	{ "netifh_procnetdev",		&netifh_procnetdev },
+#endif
+	{ NULL,				NULL }
+};
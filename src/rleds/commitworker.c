@@ -0,0 +1,205 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Commit worker
+**
+** Provides the submit()/complete() interface of asynchronous LED drivers for
+** drivers that only implement the synchronous set_frame() and commit(): a thread
+** per port calls these and signals completion through an eventfd. Like with
+** asynchronous drivers, the caller must not submit again before completion.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/eventfd.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+
+#include "plugins.h"
+#include "commitworker.h"
+
+/*
+** Worker thread: commits frames as they are submitted.
+*/
+static void *commitworker_thread(void *arg)
+{
+	COMMITWORKER *worker = arg;
+	uint64_t val = 1;
+	RC rc;
+
+	pthread_mutex_lock(&worker->lock);
+	while (1)
+	{
+		while (!worker->pending && !worker->stop)
+			pthread_cond_wait(&worker->cond, &worker->lock);
+		if (!worker->pending)
+			break;
+		pthread_mutex_unlock(&worker->lock);
+
+		/* The frame is ours until we signal completion */
+		rc = worker->leddrvr->set_frame(worker->port, worker->frame, worker->valid);
+		if (rc == OK)
+			rc = worker->leddrvr->commit(worker->port);
+
+		pthread_mutex_lock(&worker->lock);
+		worker->pending = FALSE;
+		worker->rc = rc;
+		if (rc != OK)
+			snprintf(worker->errmsg, sizeof(worker->errmsg), "%s",
+			         worker->leddrvr->errmsg(worker->port));
+		(void)write(worker->efd, &val, sizeof(val));
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	return NULL;
+}
+
+/*
+** worker = commitworker_start(leddrvr, port, frame_words)
+**
+** Starts a worker thread committing to "port" of the LED driver "leddrvr", with
+** frames of "frame_words" 64-bit words.
+**
+** Returns the worker on success and NULL on failure, in which case an error message
+** can be found in _errmsg.
+*/
+COMMITWORKER *commitworker_start(LEDDRIVER *leddrvr, PORT *port, uint frame_words)
+{
+	COMMITWORKER *worker;
+	int rc;
+
+	assert(leddrvr && port);
+
+	worker = calloc(1, sizeof(COMMITWORKER));
+	if (!worker ||
+	    !(worker->frame = calloc(frame_words, sizeof(uint64_t))) ||
+	    !(worker->valid = calloc(frame_words, sizeof(uint64_t))))
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for commit worker!\n");
+		goto failed;
+	}
+	worker->leddrvr = leddrvr;
+	worker->port = port;
+	worker->frame_words = frame_words;
+
+	worker->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (worker->efd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set up commit worker:\n%s!\n",
+		         strerror(errno));
+		goto failed;
+	}
+
+	pthread_mutex_init(&worker->lock, NULL);
+	pthread_cond_init(&worker->cond, NULL);
+	rc = pthread_create(&worker->thread, NULL, commitworker_thread, worker);
+	if (rc != 0)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not start commit worker thread:\n%s!\n",
+		         strerror(rc));
+		close(worker->efd);
+		goto failed;
+	}
+
+	return worker;
+
+failed:
+	if (worker)
+	{
+		free(worker->frame);
+		free(worker->valid);
+		free(worker);
+	}
+	return NULL;
+}
+
+/*
+** fd = commitworker_submit(worker, frame, valid)
+**
+** Hands the frame "frame", controlling the pins in "valid", to "worker" for
+** committing.
+**
+** Returns the file descriptor that becomes readable on completion.
+*/
+int commitworker_submit(COMMITWORKER *worker, const uint64_t *frame, const uint64_t *valid)
+{
+	assert(worker && frame && valid);
+
+	pthread_mutex_lock(&worker->lock);
+	memcpy(worker->frame, frame, worker->frame_words * sizeof(uint64_t));
+	memcpy(worker->valid, valid, worker->frame_words * sizeof(uint64_t));
+	worker->pending = TRUE;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+
+	return worker->efd;
+}
+
+/*
+** rc = commitworker_complete(worker)
+**
+** Finishes the commit submitted last to "worker" after its file descriptor became
+** readable.
+**
+** Returns OK if the frame was committed and ERR on failure, in which case an error
+** message can be found in "worker->errmsg".
+*/
+RC commitworker_complete(COMMITWORKER *worker)
+{
+	uint64_t val;
+	RC rc;
+
+	assert(worker);
+
+	pthread_mutex_lock(&worker->lock);
+	(void)read(worker->efd, &val, sizeof(val));
+	rc = worker->rc;
+	pthread_mutex_unlock(&worker->lock);
+
+	return rc;
+}
+
+/*
+** commitworker_stop(worker)
+**
+** Waits for a commit in progress, then stops and frees "worker".
+*/
+void commitworker_stop(COMMITWORKER *worker)
+{
+	assert(worker);
+
+	pthread_mutex_lock(&worker->lock);
+	worker->stop = TRUE;
+	pthread_cond_signal(&worker->cond);
+	pthread_mutex_unlock(&worker->lock);
+	pthread_join(worker->thread, NULL);
+
+	pthread_mutex_destroy(&worker->lock);
+	pthread_cond_destroy(&worker->cond);
+	close(worker->efd);
+	free(worker->frame);
+	free(worker->valid);
+	free(worker);
+}
@@ -0,0 +1,61 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the commit worker
+*/
+
+#ifndef _RLEDS_COMMITWORKER_H
+#define _RLEDS_COMMITWORKER_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+
+#include "plugins.h"
+
+/*
+** A thread committing frames to a port whose LED driver has no submit() function,
+** so that the caller never waits for the device.
+*/
+typedef struct _commitworker
+{
+	LEDDRIVER	*leddrvr;			/* LED driver... */
+	PORT		*port;				/* ...and port committed to */
+
+	pthread_t	thread;				/* Worker thread */
+	pthread_mutex_t	lock;				/* Guards the fields below */
+	pthread_cond_t	cond;				/* Signals "pending" and "stop" */
+	BOOL		pending,			/* A frame is waiting to be committed */
+			stop;				/* The thread should terminate */
+
+	uint64_t	*frame,				/* Frame to be committed */
+			*valid;				/* Pins controlled */
+	uint		frame_words;			/* Number of words in the masks above */
+
+	RC		rc;				/* Result of the last commit... */
+	char		errmsg[MAX_ERRMSG_LEN];		/* ...and error message if it failed */
+	int		efd;				/* eventfd signalling completion */
+} COMMITWORKER;
+
+/* Function prototypes */
+COMMITWORKER *commitworker_start(LEDDRIVER *leddrvr, PORT *port, uint frame_words);
+int commitworker_submit(COMMITWORKER *worker, const uint64_t *frame, const uint64_t *valid);
+RC commitworker_complete(COMMITWORKER *worker);
+void commitworker_stop(COMMITWORKER *worker);
+
+#endif /* _RLEDS_COMMITWORKER_H */
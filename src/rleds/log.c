@@ -0,0 +1,615 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Logging
+**
+** LOG() statements append records to a ring without taking locks or making system
+** calls: a record holds its call site and its arguments in binary form. A thread
+** of its own formats them and writes them to stderr every LOG_FLUSH_INTERVAL
+** milliseconds, at normal priority even if we run with a real-time one. If the
+** ring is full, records are dropped and counted.
+**
+** The ring is a bounded multi-producer queue: each slot carries the position it
+** is next valid for. A writer claims a position by advancing _log_head if the
+** slot's sequence number equals it, fills in the slot and publishes it by setting
+** the sequence number to the position plus one. The flushing thread reads slots
+** in order, and hands each back by setting its sequence number to the position
+** one lap later.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../common/base.h"
+
+#include "log.h"
+#include "plugins.h"
+#include "profile.h"
+
+/* Argument types, determined from the conversion specifications in the format */
+enum
+{
+	LOGARG_INT,					/* int (and what's promoted to it) */
+	LOGARG_LONG,					/* long */
+	LOGARG_LLONG,					/* long long */
+	LOGARG_SIZE,					/* size_t */
+	LOGARG_INTMAX,					/* intmax_t */
+	LOGARG_PTRDIFF,					/* ptrdiff_t */
+	LOGARG_DOUBLE,					/* double */
+	LOGARG_PTR,					/* void * */
+	LOGARG_STR					/* char *, copied into the record */
+};
+
+/* Sizes of the integer types above */
+static const uint8_t _int_sizes[] =
+{
+	sizeof(int), sizeof(long), sizeof(long long),
+	sizeof(size_t), sizeof(intmax_t), sizeof(ptrdiff_t)
+};
+
+/* A record in the ring */
+typedef struct _logentry
+{
+	uint		seq;				/* Position the slot is valid for */
+	uint		suppressed;			/* Records of the call site suppressed
+							   before this one */
+	LOGSITE		*site;				/* Call site that wrote it */
+	uint64_t	timestamp;			/* When */
+	uint64_t	args[LOG_MAX_ARGS];		/* Arguments (strings: offsets into
+							   "strs") */
+	char		strs[LOG_STR_SIZE];		/* String arguments, or the formatted
+							   message if the site's num_args is -2 */
+} LOGENTRY;
+
+/* Names of the log levels, by LOGLEVEL_* */
+static const char *_level_names[] = { "error", "warn", "info", "debug" };
+
+int _log_level = LOG_DEFAULT_LEVEL;
+
+/* The ring, the next position to write resp. to flush, and the number of records
+   dropped because the ring was full */
+static LOGENTRY _log_ring[LOG_RING_SIZE];
+static uint _log_head, _log_tail;
+static uint _log_dropped;
+
+/* Time log_init() was called, record timestamps are relative to it */
+static uint64_t _log_started;
+
+/* The flushing thread, the condition it waits on and the flag telling it to
+   stop */
+static pthread_t _log_thread;
+static pthread_mutex_t _log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _log_cond;
+static BOOL _log_running = FALSE, _log_stop = FALSE;
+
+/*
+** log_init()
+**
+** Sets up the ring. Must be called before the first LOG() statement.
+*/
+void log_init(void)
+{
+	uint i;
+
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		_log_ring[i].seq = i;
+	_log_head = _log_tail = 0;
+	_log_started = profile_now();
+}
+
+/*
+** rc = log_parse_level(name, &level)
+**
+** Converts the log level "name" ("error", "warn", "info" or "debug") into one of
+** the LOGLEVEL_* values.
+**
+** Returns OK on success and ERR if "name" is unknown or its level is not compiled
+** in, in which case an error message can be found in _errmsg.
+*/
+RC log_parse_level(char *name, int *level)
+{
+	int i;
+
+	assert(name && level);
+
+	for (i = 0; i < sizeof(_level_names) / sizeof(char *); i++)
+	{
+		if (strcasecmp(name, _level_names[i]) == 0)
+			break;
+	}
+	if (i == sizeof(_level_names) / sizeof(char *))
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Unknown log level \"%s\"!\n",
+		         name);
+		return ERR;
+	}
+	if (i > LOG_MAX_LEVEL)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Log level \"%s\" is not compiled in (see configure's --with-log-level)!\n",
+		         name);
+		return ERR;
+	}
+
+	*level = i;
+	return OK;
+}
+
+/*
+** len = conv_spec(p)
+**
+** Returns the length of the conversion specification at "p" (starting with the
+** '%'), without looking at the conversion character itself.
+*/
+static size_t conv_spec(const char *p)
+{
+	return 1 + strspn(p + 1, "#0- +'123456789.hljztL");
+}
+
+/*
+** parse_format(site)
+**
+** Determines the types of the arguments "site"'s format describes. If they cannot
+** be stored in binary form, records of the site will be formatted when written.
+*/
+static void parse_format(LOGSITE *site)
+{
+	const char *p = site->fmt;
+	int num_args = 0;
+
+	while ((p = strchr(p, '%')))
+	{
+		size_t len = conv_spec(p);
+		const char *mod = p + 1 + strcspn(p + 1, "hljztL");
+		char conv = p[len];
+		int type;
+
+		if (conv == '%')
+		{
+			p += len + 1;
+			continue;
+		}
+
+		if (num_args == LOG_MAX_ARGS || memchr(p, '*', len + 1))
+			break;
+
+		switch (conv)
+		{
+			case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+				if (mod >= p + len)
+					type = LOGARG_INT;
+				else if (mod[0] == 'h')
+					type = LOGARG_INT;
+				else if (mod[0] == 'l')
+					type = mod[1] == 'l' ? LOGARG_LLONG : LOGARG_LONG;
+				else if (mod[0] == 'z')
+					type = LOGARG_SIZE;
+				else if (mod[0] == 'j')
+					type = LOGARG_INTMAX;
+				else if (mod[0] == 't')
+					type = LOGARG_PTRDIFF;
+				else
+					type = -1;
+				if (conv == 'c' && type != LOGARG_INT)
+					type = -1;
+				break;
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+				type = mod < p + len ? -1 : LOGARG_DOUBLE;
+				break;
+			case 'p':
+				type = mod < p + len ? -1 : LOGARG_PTR;
+				break;
+			case 's':
+				type = mod < p + len ? -1 : LOGARG_STR;
+				break;
+			default:
+				type = -1;
+		}
+		if (type < 0)
+			break;
+
+		site->arg_types[num_args++] = type;
+		p += len + 1;
+	}
+
+	/* Other threads may parse the same format at the same time, with the same
+	   result */
+	__atomic_store_n(&site->num_args, p ? -2 : num_args, __ATOMIC_RELEASE);
+}
+
+/*
+** allowed = rate_limit(site, now)
+**
+** Accounts for a record "site" wants to write at "now".
+**
+** Returns TRUE if it may, FALSE if it exceeded LOG_RATE_BURST.
+*/
+static BOOL rate_limit(LOGSITE *site, uint64_t now)
+{
+	uint64_t window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+	/* Whoever starts a new window resets the count */
+	if (now - window >= LOG_RATE_INTERVAL &&
+	    __atomic_compare_exchange_n(&site->window, &window, now, FALSE,
+	                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		__atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+
+	if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) <= LOG_RATE_BURST)
+		return TRUE;
+
+	__atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+	return FALSE;
+}
+
+/*
+** log_write(site, fmt, ...)
+**
+** Writes a record for the LOG() statement "site" into the ring. Use LOG() instead
+** of calling this directly.
+*/
+void log_write(LOGSITE *site, const char *fmt, ...)
+{
+	uint64_t now = profile_now();
+	LOGENTRY *entry;
+	uint pos, seq;
+	int num_args, i;
+	size_t used = 0;
+	va_list ap;
+
+	if (!rate_limit(site, now))
+		return;
+
+	num_args = __atomic_load_n(&site->num_args, __ATOMIC_ACQUIRE);
+	if (num_args == -1)
+	{
+		parse_format(site);
+		num_args = site->num_args;
+	}
+
+	/* Claim a slot */
+	pos = __atomic_load_n(&_log_head, __ATOMIC_RELAXED);
+	while (1)
+	{
+		entry = &_log_ring[pos & (LOG_RING_SIZE - 1)];
+		seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos)
+		{
+			if (__atomic_compare_exchange_n(&_log_head, &pos, pos + 1, TRUE,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if ((int)(seq - pos) < 0)
+		{
+			/* Full, the flushing thread has not handed the slot back yet */
+			__atomic_add_fetch(&_log_dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+			pos = __atomic_load_n(&_log_head, __ATOMIC_RELAXED);
+	}
+
+	entry->site = site;
+	entry->timestamp = now;
+	entry->suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+
+	va_start(ap, fmt);
+	if (num_args < 0)
+		vsnprintf(entry->strs, sizeof(entry->strs), fmt, ap);
+	for (i = 0; i < num_args; i++)
+	{
+		switch (site->arg_types[i])
+		{
+			case LOGARG_INT:
+				entry->args[i] = (int64_t)va_arg(ap, int);
+				break;
+			case LOGARG_LONG:
+				entry->args[i] = (int64_t)va_arg(ap, long);
+				break;
+			case LOGARG_LLONG:
+				entry->args[i] = (int64_t)va_arg(ap, long long);
+				break;
+			case LOGARG_SIZE:
+				entry->args[i] = va_arg(ap, size_t);
+				break;
+			case LOGARG_INTMAX:
+				entry->args[i] = (int64_t)va_arg(ap, intmax_t);
+				break;
+			case LOGARG_PTRDIFF:
+				entry->args[i] = (int64_t)va_arg(ap, ptrdiff_t);
+				break;
+			case LOGARG_DOUBLE:
+			{
+				double d = va_arg(ap, double);
+
+				memcpy(&entry->args[i], &d, sizeof(d));
+				break;
+			}
+			case LOGARG_PTR:
+				entry->args[i] = (uintptr_t)va_arg(ap, void *);
+				break;
+			case LOGARG_STR:
+			{
+				/* The last byte stays '\0' for strings that don't fit */
+				const char *s = va_arg(ap, const char *);
+				size_t len;
+
+				if (!s)
+					s = "(null)";
+				len = strnlen(s, sizeof(entry->strs) - 1 - used);
+				memcpy(entry->strs + used, s, len);
+				entry->strs[used + len] = '\0';
+				entry->args[i] = used;
+				used += len < sizeof(entry->strs) - 1 - used ? len + 1 : len;
+				break;
+			}
+		}
+	}
+	va_end(ap);
+
+	/* Publish it */
+	__atomic_store_n(&entry->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/*
+** print_entry(f, entry)
+**
+** Formats the record "entry" and prints it to "f".
+*/
+static void print_entry(FILE *f, const LOGENTRY *entry)
+{
+	const LOGSITE *site = entry->site;
+	const char *p;
+	char spec[32];
+	int i = 0;
+
+	fprintf(f, "[%10.6f] %s: ",
+	        (entry->timestamp - _log_started) / 1e9, _level_names[site->level]);
+
+	if (site->num_args < 0)
+	{
+		fputs(entry->strs, f);
+		p = NULL;
+	}
+	else
+		p = site->fmt;
+
+	/* Print each conversion with an argument of the type it expects */
+	while (p && *p)
+	{
+		size_t len = strcspn(p, "%");
+
+		fwrite(p, 1, len, f);
+		p += len;
+		if (!*p)
+			break;
+
+		len = conv_spec(p);
+		if (p[len] == '%')
+		{
+			fputc('%', f);
+			p += len + 1;
+			continue;
+		}
+
+		/* Copy flags, width and precision, but not the length modifier */
+		len = strcspn(p, "hljztL");
+		if (len > conv_spec(p))
+			len = conv_spec(p);
+		if (len > sizeof(spec) - 4)
+			len = sizeof(spec) - 4;
+		memcpy(spec, p, len);
+		p += conv_spec(p);
+
+		switch (site->arg_types[i])
+		{
+			case LOGARG_DOUBLE:
+			{
+				double d;
+
+				memcpy(&d, &entry->args[i], sizeof(d));
+				snprintf(spec + len, 2, "%c", *p);
+				fprintf(f, spec, d);
+				break;
+			}
+			case LOGARG_PTR:
+				snprintf(spec + len, 2, "%c", *p);
+				fprintf(f, spec, (void *)(uintptr_t)entry->args[i]);
+				break;
+			case LOGARG_STR:
+				snprintf(spec + len, 2, "%c", *p);
+				fprintf(f, spec, entry->strs + entry->args[i]);
+				break;
+			default:
+			{
+				/* Integers are printed as long long, sign-extended or cut to their
+				   size */
+				uint bits = _int_sizes[site->arg_types[i]] * 8;
+				uint64_t v = entry->args[i];
+
+				if (*p == 'c')
+				{
+					snprintf(spec + len, 2, "%c", *p);
+					fprintf(f, spec, (int)v);
+					break;
+				}
+
+				snprintf(spec + len, 4, "ll%c", *p);
+				if (*p == 'd' || *p == 'i')
+				{
+					if (bits < 64)
+						v = (uint64_t)((int64_t)(v << (64 - bits)) >> (64 - bits));
+					fprintf(f, spec, (long long)v);
+				}
+				else
+				{
+					if (bits < 64)
+						v &= (1ULL << bits) - 1;
+					fprintf(f, spec, (unsigned long long)v);
+				}
+			}
+		}
+		i++;
+		p++;
+	}
+
+	if (entry->suppressed)
+		fprintf(f, " (%u more suppressed)", entry->suppressed);
+	fputc('\n', f);
+}
+
+/*
+** log_flush(f)
+**
+** Prints all records in the ring to "f". Only the flushing thread may call this
+** while it runs.
+*/
+void log_flush(FILE *f)
+{
+	uint dropped;
+	BOOL printed = FALSE;
+
+	assert(f);
+
+	while (1)
+	{
+		LOGENTRY *entry = &_log_ring[_log_tail & (LOG_RING_SIZE - 1)];
+
+		if (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != _log_tail + 1)
+			break;
+
+		print_entry(f, entry);
+		printed = TRUE;
+
+		/* Hand the slot back to the writers */
+		__atomic_store_n(&entry->seq, _log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+		_log_tail++;
+	}
+
+	dropped = __atomic_exchange_n(&_log_dropped, 0, __ATOMIC_RELAXED);
+	if (dropped)
+	{
+		fprintf(f, "%u log records dropped, the log ring was full\n", dropped);
+		printed = TRUE;
+	}
+
+	if (printed)
+		fflush(f);
+}
+
+/*
+** Flushing thread.
+*/
+static void *log_thread(void *arg)
+{
+	struct timespec deadline;
+
+	pthread_mutex_lock(&_log_mutex);
+	while (!_log_stop)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += LOG_FLUSH_INTERVAL * 1000000;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000;
+		deadline.tv_nsec %= 1000000000;
+		pthread_cond_timedwait(&_log_cond, &_log_mutex, &deadline);
+
+		pthread_mutex_unlock(&_log_mutex);
+		log_flush(stderr);
+		pthread_mutex_lock(&_log_mutex);
+	}
+	pthread_mutex_unlock(&_log_mutex);
+
+	return NULL;
+}
+
+/*
+** rc = log_start()
+**
+** Starts the thread flushing the ring. It runs with the normal scheduling policy,
+** whatever ours is.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC log_start(void)
+{
+	struct sched_param param;
+	pthread_condattr_t cattr;
+	pthread_attr_t attr;
+	int rc;
+
+	if (_log_running)
+		return OK;
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&_log_cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	memset(&param, 0, sizeof(param));
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	pthread_attr_setschedparam(&attr, &param);
+
+	_log_stop = FALSE;
+	rc = pthread_create(&_log_thread, &attr, log_thread, NULL);
+	pthread_attr_destroy(&attr);
+	if (rc)
+	{
+		pthread_cond_destroy(&_log_cond);
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not start logging thread:\n%s!\n",
+		         strerror(rc));
+		return ERR;
+	}
+	_log_running = TRUE;
+
+	return OK;
+}
+
+/*
+** log_shutdown()
+**
+** Stops the flushing thread, if running, and prints the records left in the ring.
+*/
+void log_shutdown(void)
+{
+	if (_log_running)
+	{
+		pthread_mutex_lock(&_log_mutex);
+		_log_stop = TRUE;
+		pthread_cond_signal(&_log_cond);
+		pthread_mutex_unlock(&_log_mutex);
+
+		pthread_join(_log_thread, NULL);
+		pthread_cond_destroy(&_log_cond);
+		_log_running = FALSE;
+	}
+
+	log_flush(stderr);
+}
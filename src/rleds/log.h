@@ -0,0 +1,108 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for logging
+*/
+
+#ifndef _RLEDS_LOG_H
+#define _RLEDS_LOG_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../common/base.h"
+
+/* Log levels, from the most to the least important */
+#define LOGLEVEL_ERROR	0
+#define LOGLEVEL_WARN	1
+#define LOGLEVEL_INFO	2
+#define LOGLEVEL_DEBUG	3
+
+/* Most verbose level compiled in (see configure's --with-log-level). LOG()
+   statements above it generate no code at all. */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOGLEVEL_DEBUG
+#endif
+
+/* Level used unless changed with --log-level */
+#define LOG_DEFAULT_LEVEL LOGLEVEL_INFO
+
+/* Maximum number of arguments of a record kept in binary form, and room for the
+   strings among them (records with more are formatted when written) */
+#define LOG_MAX_ARGS 6
+#define LOG_STR_SIZE 176
+
+/* Number of records the ring holds, must be a power of two */
+#define LOG_RING_SIZE 512
+
+/* How often the ring is flushed, in milliseconds */
+#define LOG_FLUSH_INTERVAL 100
+
+/* Each call site writes at most LOG_RATE_BURST records per LOG_RATE_INTERVAL
+   nanoseconds, the ones above are counted only */
+#define LOG_RATE_BURST 10
+#define LOG_RATE_INTERVAL 1000000000ULL
+
+/*
+** A LOG() statement. Created by the macro, filled in by the first record it
+** writes.
+*/
+typedef struct _logsite
+{
+	int		level;				/* LOGLEVEL_* */
+	const char	*fmt;				/* printf() format */
+	int		num_args;			/* Number of arguments, -1 until "fmt"
+							   was parsed, -2 if records must be
+							   formatted when written */
+	uint8_t		arg_types[LOG_MAX_ARGS];	/* Their types (see log.c) */
+	uint64_t	window;				/* Start of the rate limit window... */
+	uint32_t	count,				/* ...and records written in it */
+			suppressed;			/* Records suppressed since the last one
+							   written */
+} LOGSITE;
+
+/* Least important level logged, LOGLEVEL_* */
+extern int _log_level;
+
+/*
+** LOG(level, fmt, ...)
+**
+** Logs the printf()-style message "fmt" (without a trailing newline) if "level"
+** is compiled in and enabled. Arguments are copied into the ring in binary form and
+** formatted later by the flushing thread, strings are copied as well. Each call
+** site is rate limited on its own.
+*/
+#define LOG(level, fmt, ...) \
+	do \
+	{ \
+		if ((level) <= LOG_MAX_LEVEL && \
+		    __builtin_expect((level) <= _log_level, 0)) \
+		{ \
+			static LOGSITE _log_site = { (level), (fmt), -1 }; \
+			log_write(&_log_site, fmt, ##__VA_ARGS__); \
+		} \
+	} \
+	while (0)
+
+/* Function prototypes */
+void log_init(void);
+RC log_parse_level(char *name, int *level);
+void log_write(LOGSITE *site, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+RC log_start(void);
+void log_flush(FILE *f);
+void log_shutdown(void);
+
+#endif /* _RLEDS_LOG_H */
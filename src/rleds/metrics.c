@@ -0,0 +1,785 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Rate estimator and metrics endpoint
+**
+** After every tick, the counters the network interface handlers sampled are turned
+** into packet and byte rates per interface, both between the last two samples and
+** as exponentially weighted moving averages. These and our own tick statistics are
+** served in the Prometheus text format over HTTP on a Unix or localhost TCP socket.
+** Clients are handled by the main loop: the listening and client sockets are
+** non-blocking and registered with its epoll instance.
+*/
+
+/* For accept4() */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+#include "plugins.h"
+#include "profile.h"
+#include "metrics.h"
+#include "realtime.h"
+
+/* Growing buffer responses are built in */
+typedef struct _strbuf
+{
+	char		*buf;
+	size_t		len,
+			size;
+} STRBUF;
+
+/* Listening socket, the epoll instance it is registered with and, for Unix sockets,
+   the path to remove on shutdown */
+static int _listen_fd = -1, _epollfd = -1;
+static char *_unix_path;
+
+/* Connected clients */
+static METRICSCLIENT _clients[METRICS_MAX_CLIENTS];
+
+/* Interfaces we estimate rates for */
+static METRICSNETIF *_netifs;
+static int _num_netifs;
+
+/* Time constants of the moving averages and their labels */
+static const int _windows[METRICS_NUM_WINDOWS] = METRICS_WINDOWS;
+
+/* Tick statistics */
+static uint64_t _start, _ticks, _tick_ns, _changes, _overruns;
+static uint _interval;
+
+/*
+** Appends the printf()-style "fmt" and arguments to "sb". Running out of memory
+** leaves "sb->buf" NULL.
+*/
+static void sb_printf(STRBUF *sb, const char *fmt, ...)
+{
+	va_list ap;
+	char *buf;
+	int len;
+
+	if (!sb->buf)
+		return;
+
+	while (1)
+	{
+		va_start(ap, fmt);
+		len = vsnprintf(sb->buf + sb->len, sb->size - sb->len, fmt, ap);
+		va_end(ap);
+		if (len < sb->size - sb->len)
+			break;
+
+		sb->size = (sb->size + len) * 2;
+		buf = realloc(sb->buf, sb->size);
+		if (!buf)
+		{
+			free(sb->buf);
+			sb->buf = NULL;
+			return;
+		}
+		sb->buf = buf;
+	}
+	sb->len += len;
+}
+
+/*
+** Appends the label set for "mn", plus "extra" (may be empty), to "sb".
+*/
+static void sb_labels(STRBUF *sb, METRICSNETIF *mn, const char *extra)
+{
+	const char *p;
+
+	sb_printf(sb, "{interface=\"");
+	for (p = mn->netif_name; *p; p++)
+	{
+		if (*p == '\\' || *p == '"')
+			sb_printf(sb, "\\%c", *p);
+		else if (*p == '\n')
+			sb_printf(sb, "\\n");
+		else
+			sb_printf(sb, "%c", *p);
+	}
+	sb_printf(sb, "\",handler=\"%s\"%s}", mn->netifh_name, extra);
+}
+
+/*
+** Builds the response to a metrics request.
+**
+** Returns the response (to be free()d by the caller) or NULL if out of memory.
+*/
+static char *build_response(size_t *len)
+{
+	static const char *dirs[2] = { "rx", "tx" };
+	STRBUF body, resp;
+	int i, j, w;
+
+	body.size = 4096;
+	body.len = 0;
+	body.buf = malloc(body.size);
+
+	/* Our own statistics */
+	sb_printf(&body,
+	          "# HELP rleds_uptime_seconds Time since rleds started.\n"
+	          "# TYPE rleds_uptime_seconds gauge\n"
+	          "rleds_uptime_seconds %.3f\n"
+	          "# HELP rleds_ticks_total Ticks processed.\n"
+	          "# TYPE rleds_ticks_total counter\n"
+	          "rleds_ticks_total %llu\n"
+	          "# HELP rleds_tick_seconds_total Time spent processing ticks.\n"
+	          "# TYPE rleds_tick_seconds_total counter\n"
+	          "rleds_tick_seconds_total %.9f\n"
+	          "# HELP rleds_tick_changes_total Ticks that changed the state of any LED.\n"
+	          "# TYPE rleds_tick_changes_total counter\n"
+	          "rleds_tick_changes_total %llu\n"
+	          "# HELP rleds_tick_overruns_total Ticks skipped because we were late.\n"
+	          "# TYPE rleds_tick_overruns_total counter\n"
+	          "rleds_tick_overruns_total %llu\n"
+	          "# HELP rleds_tick_interval_seconds Current time between ticks.\n"
+	          "# TYPE rleds_tick_interval_seconds gauge\n"
+	          "rleds_tick_interval_seconds %.6f\n",
+	          (profile_now() - _start) / 1e9,
+	          (unsigned long long)_ticks, _tick_ns / 1e9,
+	          (unsigned long long)_changes, (unsigned long long)_overruns,
+	          _interval / 1e6);
+
+	/* How late the threads woke up for their deadlines */
+	sb_printf(&body,
+	          "# HELP rleds_wakeup_latency_seconds Time between deadlines and wakeups.\n"
+	          "# TYPE rleds_wakeup_latency_seconds summary\n");
+	for (i = 0; i < NUM_JITTERS; i++)
+	{
+		JITTER *jitter = _jitters[i];
+
+		sb_printf(&body,
+		          "rleds_wakeup_latency_seconds_sum{thread=\"%s\"} %.9f\n"
+		          "rleds_wakeup_latency_seconds_count{thread=\"%s\"} %llu\n",
+		          jitter->name,
+		          __atomic_load_n(&jitter->latency_sum, __ATOMIC_RELAXED) / 1e9,
+		          jitter->name,
+		          (unsigned long long)__atomic_load_n(&jitter->wakeups, __ATOMIC_RELAXED));
+	}
+	sb_printf(&body,
+	          "# HELP rleds_wakeup_latency_max_seconds Largest wakeup latency so far.\n"
+	          "# TYPE rleds_wakeup_latency_max_seconds gauge\n");
+	for (i = 0; i < NUM_JITTERS; i++)
+	{
+		JITTER *jitter = _jitters[i];
+
+		sb_printf(&body,
+		          "rleds_wakeup_latency_max_seconds{thread=\"%s\"} %.9f\n",
+		          jitter->name,
+		          __atomic_load_n(&jitter->latency_max, __ATOMIC_RELAXED) / 1e9);
+	}
+	sb_printf(&body,
+	          "# HELP rleds_render_overruns_total Renderer deadlines skipped because it was late.\n"
+	          "# TYPE rleds_render_overruns_total counter\n"
+	          "rleds_render_overruns_total %llu\n"
+	          "# HELP rleds_pwm_overruns_total PWM refreshes skipped because we were late.\n"
+	          "# TYPE rleds_pwm_overruns_total counter\n"
+	          "rleds_pwm_overruns_total %llu\n",
+	          (unsigned long long)__atomic_load_n(&_render_jitter.overruns, __ATOMIC_RELAXED),
+	          (unsigned long long)__atomic_load_n(&_pwm_jitter.overruns, __ATOMIC_RELAXED));
+
+	/* Per-interface statistics */
+	sb_printf(&body,
+	          "# HELP rleds_netif_up Whether the interface is up.\n"
+	          "# TYPE rleds_netif_up gauge\n");
+	for (i = 0; i < _num_netifs; i++)
+	{
+		sb_printf(&body, "rleds_netif_up");
+		sb_labels(&body, &_netifs[i], "");
+		sb_printf(&body, " %d\n", _netifs[i].last.up ? 1 : 0);
+	}
+
+	sb_printf(&body,
+	          "# HELP rleds_netif_sample_seconds CLOCK_MONOTONIC time of the last sample.\n"
+	          "# TYPE rleds_netif_sample_seconds gauge\n");
+	for (i = 0; i < _num_netifs; i++)
+	{
+		sb_printf(&body, "rleds_netif_sample_seconds");
+		sb_labels(&body, &_netifs[i], "");
+		sb_printf(&body, " %.6f\n", _netifs[i].last.timestamp / 1e9);
+	}
+
+	for (j = 0; j < 2; j++)
+	{
+		const char *unit = j ? "bytes" : "packets";
+		int k;
+
+		sb_printf(&body,
+		          "# HELP rleds_netif_%s_total %s transferred by the interface.\n"
+		          "# TYPE rleds_netif_%s_total counter\n",
+		          unit, j ? "Bytes" : "Packets", unit);
+		for (i = 0; i < _num_netifs; i++)
+		{
+			METRICSNETIF *mn = &_netifs[i];
+
+			if (!mn->last.up)
+				continue;
+
+			for (k = 0; k < 2; k++)
+			{
+				char extra[32];
+
+				snprintf(extra, sizeof(extra), ",direction=\"%s\"", dirs[k]);
+				sb_printf(&body, "rleds_netif_%s_total", unit);
+				sb_labels(&body, mn, extra);
+				sb_printf(&body, " %llu\n",
+				          j ? (k ? mn->last.tx_bytes : mn->last.rx_bytes)
+				            : (k ? mn->last.tx_packets : mn->last.rx_packets));
+			}
+		}
+
+		sb_printf(&body,
+		          "# HELP rleds_netif_%s_per_second %s rate between the last two samples "
+		          "(window=\"0\") and averaged over the last seconds.\n"
+		          "# TYPE rleds_netif_%s_per_second gauge\n",
+		          unit, j ? "Byte" : "Packet", unit);
+		for (i = 0; i < _num_netifs; i++)
+		{
+			METRICSNETIF *mn = &_netifs[i];
+
+			if (!mn->last.up)
+				continue;
+
+			for (k = 0; k < 2; k++)
+			{
+				RATE rate = j * 2 + k;
+				char extra[48];
+
+				snprintf(extra, sizeof(extra), ",direction=\"%s\",window=\"0\"", dirs[k]);
+				sb_printf(&body, "rleds_netif_%s_per_second", unit);
+				sb_labels(&body, mn, extra);
+				sb_printf(&body, " %.3f\n", mn->inst[rate]);
+
+				for (w = 0; w < METRICS_NUM_WINDOWS; w++)
+				{
+					snprintf(extra, sizeof(extra), ",direction=\"%s\",window=\"%ds\"",
+					         dirs[k], _windows[w]);
+					sb_printf(&body, "rleds_netif_%s_per_second", unit);
+					sb_labels(&body, mn, extra);
+					sb_printf(&body, " %.3f\n", mn->ewma[w][rate]);
+				}
+			}
+		}
+	}
+
+	if (!body.buf)
+		return NULL;
+
+	/* Wrap it into an HTTP response */
+	resp.size = body.len + 256;
+	resp.len = 0;
+	resp.buf = malloc(resp.size);
+	sb_printf(&resp,
+	          "HTTP/1.0 200 OK\r\n"
+	          "Content-Type: text/plain; version=0.0.4\r\n"
+	          "Content-Length: %lu\r\n"
+	          "Connection: close\r\n"
+	          "\r\n",
+	          (unsigned long)body.len);
+	if (resp.buf && resp.size - resp.len >= body.len)
+	{
+		memcpy(resp.buf + resp.len, body.buf, body.len);
+		resp.len += body.len;
+	}
+	free(body.buf);
+
+	*len = resp.len;
+	return resp.buf;
+}
+
+/*
+** Disconnects "client".
+*/
+static void close_client(METRICSCLIENT *client)
+{
+	epoll_ctl(_epollfd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	free(client->resp);
+	memset(client, 0, sizeof(*client));
+	client->fd = -1;
+}
+
+/*
+** Accepts pending connections.
+*/
+static void accept_clients(void)
+{
+	while (1)
+	{
+		struct epoll_event ev;
+		int fd, i;
+
+		fd = accept4(_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1)
+			return;
+
+		for (i = 0; i < METRICS_MAX_CLIENTS; i++)
+		{
+			if (_clients[i].fd == -1)
+				break;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (i == METRICS_MAX_CLIENTS || epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		{
+			close(fd);
+			continue;
+		}
+		_clients[i].fd = fd;
+	}
+}
+
+/*
+** Sends as much of the response to "client" as the socket takes, then disconnects it
+** if everything has been sent.
+*/
+static void send_response(METRICSCLIENT *client)
+{
+	while (client->resp_off < client->resp_len)
+	{
+		ssize_t n;
+
+		n = send(client->fd, client->resp + client->resp_off,
+		         client->resp_len - client->resp_off, MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			break;
+		}
+		client->resp_off += n;
+	}
+
+	close_client(client);
+}
+
+/*
+** Reads the request from "client" and, once it is complete, starts responding.
+*/
+static void receive_request(METRICSCLIENT *client)
+{
+	struct epoll_event ev;
+	ssize_t n;
+
+	n = recv(client->fd, client->req + client->req_len,
+	         sizeof(client->req) - 1 - client->req_len, 0);
+	if (n == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			close_client(client);
+		return;
+	}
+	client->req_len += n;
+	client->req[client->req_len] = '\0';
+
+	/* We don't care what's being asked for. Answer at the end of the request
+	   header, when the client stops sending or when the buffer is full. */
+	if (n > 0 && client->req_len < sizeof(client->req) - 1 &&
+	    !strstr(client->req, "\r\n\r\n") && !strstr(client->req, "\n\n"))
+		return;
+
+	client->resp = build_response(&client->resp_len);
+	if (!client->resp)
+	{
+		close_client(client);
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLOUT;
+	ev.data.fd = client->fd;
+	epoll_ctl(_epollfd, EPOLL_CTL_MOD, client->fd, &ev);
+
+	send_response(client);
+}
+
+/*
+** rc = metrics_init(addr, epollfd)
+**
+** Starts listening for metrics requests on "addr", which is either a Unix socket path
+** (optionally prefixed by "unix:") or a TCP port, optionally preceded by an address
+** and a colon (default: 127.0.0.1). The listening socket is registered with the epoll
+** instance "epollfd"; events for it must be passed to metrics_handle().
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC metrics_init(char *addr, int epollfd)
+{
+	struct epoll_event ev;
+	int i;
+
+	assert(addr);
+
+	_epollfd = epollfd;
+	_start = profile_now();
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++)
+		_clients[i].fd = -1;
+
+	if (strncmp(addr, "unix:", 5) == 0 || *addr == '/')
+	{
+		struct sockaddr_un sun;
+		struct stat st;
+		char *path = *addr == '/' ? addr : addr + 5;
+
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		if (strlen(path) >= sizeof(sun.sun_path))
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Metrics socket path \"%s\" too long!\n", path);
+			return ERR;
+		}
+		strcpy(sun.sun_path, path);
+
+		/* Remove a stale socket left behind by a previous instance, but leave
+		   anything else there alone */
+		if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(path);
+
+		_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (_listen_fd == -1 ||
+		    bind(_listen_fd, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not create metrics socket \"%s\":\n%s!\n",
+			         path, strerror(errno));
+			return ERR;
+		}
+		_unix_path = strdup(path);
+	}
+	else
+	{
+		struct sockaddr_storage ss;
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+		char buf[METRICS_ADDR_LEN], *host, *port, *p;
+		unsigned long num;
+		socklen_t len;
+		int one = 1;
+
+		/* Split "[<ip>:]<port>", where <ip> may be a bracketed IPv6 address */
+		if (strlen(addr) >= sizeof(buf))
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Invalid metrics address \"%s\"!\n", addr);
+			return ERR;
+		}
+		strcpy(buf, addr);
+		host = buf;
+		p = strrchr(host, ':');
+		if (p)
+		{
+			*p = '\0';
+			port = p + 1;
+			if (*host == '[' && host[strlen(host) - 1] == ']')
+			{
+				host[strlen(host) - 1] = '\0';
+				host++;
+			}
+		}
+		else
+		{
+			port = host;
+			host = "127.0.0.1";
+		}
+
+		/* Only numeric addresses are accepted, so that we need neither name
+		   resolution nor the NSS modules it would load in a static rleds */
+		memset(&ss, 0, sizeof(ss));
+		num = strtoul(port, &p, 10);
+		if (!*port || *p || num == 0 || num > 65535)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Invalid port in metrics address \"%s\"!\n", addr);
+			return ERR;
+		}
+		if (inet_pton(AF_INET, host, &sin->sin_addr) == 1)
+		{
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons(num);
+			len = sizeof(*sin);
+		}
+		else if (inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1)
+		{
+			sin6->sin6_family = AF_INET6;
+			sin6->sin6_port = htons(num);
+			len = sizeof(*sin6);
+		}
+		else
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Invalid IP address in metrics address \"%s\"!\n", addr);
+			return ERR;
+		}
+
+		_listen_fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (_listen_fd == -1 ||
+		    setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+		    bind(_listen_fd, (struct sockaddr *)&ss, len) == -1)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not listen for metrics requests on \"%s\":\n%s!\n",
+			         addr, strerror(errno));
+			return ERR;
+		}
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = _listen_fd;
+	if (listen(_listen_fd, METRICS_MAX_CLIENTS) == -1 ||
+	    epoll_ctl(_epollfd, EPOLL_CTL_ADD, _listen_fd, &ev) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not listen for metrics requests on \"%s\":\n%s!\n",
+		         addr, strerror(errno));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** rc = metrics_add_netif(netif_name, netifh_name, netifh, netif)
+**
+** Adds the interface "netif_name", watched by the network interface handler "netifh"
+** (named "netifh_name") as "netif", to the interfaces we estimate rates for. Adding
+** the same interface and handler twice has no effect.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC metrics_add_netif(char *netif_name, char *netifh_name, NETIFHANDLER *netifh, NETIF *netif)
+{
+	METRICSNETIF *mn;
+	int i;
+
+	assert(netif_name && netifh_name && netifh && netif);
+
+	for (i = 0; i < _num_netifs; i++)
+	{
+		if (_netifs[i].netifh == netifh && strcmp(_netifs[i].netif_name, netif_name) == 0)
+			return OK;
+	}
+
+	mn = realloc(_netifs, (_num_netifs + 1) * sizeof(METRICSNETIF));
+	if (!mn)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for metrics!\n");
+		return ERR;
+	}
+	_netifs = mn;
+
+	mn = &_netifs[_num_netifs++];
+	memset(mn, 0, sizeof(*mn));
+	mn->netif_name = netif_name;
+	mn->netifh_name = netifh_name;
+	mn->netifh = netifh;
+	mn->netif = netif;
+
+	return OK;
+}
+
+/*
+** metrics_del_netif(netif)
+**
+** Stops estimating rates for the interface watched as "netif", which is about to
+** be shut down.
+*/
+void metrics_del_netif(NETIF *netif)
+{
+	int i;
+
+	assert(netif);
+
+	for (i = 0; i < _num_netifs; i++)
+	{
+		if (_netifs[i].netif == netif)
+		{
+			memmove(&_netifs[i], &_netifs[i + 1],
+			        (_num_netifs - i - 1) * sizeof(METRICSNETIF));
+			_num_netifs--;
+			return;
+		}
+	}
+}
+
+/*
+** metrics_tick(duration, interval, changed, overruns)
+**
+** Accounts for a tick that took "duration" nanoseconds, at a tick interval of
+** "interval" microseconds, changed the LEDs if "changed" is set and followed
+** "overruns" skipped ticks. Then updates the rates from the counters the network
+** interface handlers sampled during the tick.
+*/
+void metrics_tick(uint64_t duration, uint interval, BOOL changed, uint64_t overruns)
+{
+	int i, j, w;
+
+	_ticks++;
+	_tick_ns += duration;
+	if (changed)
+		_changes++;
+	_overruns += overruns;
+	_interval = interval;
+
+	for (i = 0; i < _num_netifs; i++)
+	{
+		METRICSNETIF *mn = &_netifs[i];
+		NETIFSTATS stats;
+		unsigned long long cur[NUM_RATES], last[NUM_RATES];
+		double dt;
+
+		if (!mn->netifh->stats || mn->netifh->stats(mn->netif, &stats) != OK)
+			continue;
+
+		/* Nothing new sampled? */
+		if (mn->valid && stats.timestamp <= mn->last.timestamp)
+			continue;
+
+		cur[RATE_RX_PACKETS] = stats.rx_packets;
+		cur[RATE_TX_PACKETS] = stats.tx_packets;
+		cur[RATE_RX_BYTES] = stats.rx_bytes;
+		cur[RATE_TX_BYTES] = stats.tx_bytes;
+		last[RATE_RX_PACKETS] = mn->last.rx_packets;
+		last[RATE_TX_PACKETS] = mn->last.tx_packets;
+		last[RATE_RX_BYTES] = mn->last.rx_bytes;
+		last[RATE_TX_BYTES] = mn->last.tx_bytes;
+		dt = (stats.timestamp - mn->last.timestamp) / 1e9;
+
+		/* Rates need two consecutive samples of an interface that was up. Counters
+		   going backwards mean the interface was recreated. */
+		if (!stats.up || !mn->valid)
+			memset(mn->inst, 0, sizeof(mn->inst));
+		for (j = 0; j < NUM_RATES && stats.up && mn->valid; j++)
+		{
+			if (cur[j] < last[j])
+			{
+				memset(mn->inst, 0, sizeof(mn->inst));
+				mn->valid = FALSE;
+			}
+		}
+
+		if (stats.up && mn->valid)
+		{
+			for (j = 0; j < NUM_RATES; j++)
+				mn->inst[j] = (cur[j] - last[j]) / dt;
+		}
+
+		/* Samples come at irregular intervals, so the weight of each one depends on
+		   the time it covers. Down interfaces have zero rates. */
+		for (w = 0; w < METRICS_NUM_WINDOWS && (mn->valid || !stats.up); w++)
+		{
+			double alpha = 1 - exp(-dt / _windows[w]);
+
+			for (j = 0; j < NUM_RATES; j++)
+				mn->ewma[w][j] += alpha * (mn->inst[j] - mn->ewma[w][j]);
+		}
+
+		mn->last = stats;
+		mn->valid = stats.up;
+	}
+}
+
+/*
+** handled = metrics_handle(fd, events)
+**
+** Handles the epoll events "events" for "fd".
+**
+** Returns TRUE if "fd" belongs to us and FALSE otherwise.
+*/
+BOOL metrics_handle(int fd, uint32_t events)
+{
+	int i;
+
+	if (fd == -1)
+		return FALSE;
+
+	if (fd == _listen_fd)
+	{
+		accept_clients();
+		return TRUE;
+	}
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++)
+	{
+		METRICSCLIENT *client = &_clients[i];
+
+		if (client->fd != fd)
+			continue;
+
+		if (client->resp)
+			send_response(client);
+		else if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			receive_request(client);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+** metrics_shutdown()
+**
+** Disconnects all clients and stops listening.
+*/
+void metrics_shutdown(void)
+{
+	int i;
+
+	for (i = 0; i < METRICS_MAX_CLIENTS; i++)
+	{
+		if (_clients[i].fd != -1)
+			close_client(&_clients[i]);
+	}
+
+	if (_listen_fd != -1)
+	{
+		close(_listen_fd);
+		_listen_fd = -1;
+	}
+
+	if (_unix_path)
+	{
+		unlink(_unix_path);
+		free(_unix_path);
+		_unix_path = NULL;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the rate estimator and metrics endpoint
+*/
+
+#ifndef _RLEDS_METRICS_H
+#define _RLEDS_METRICS_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+/* Time constants of the exponentially weighted moving averages, in seconds */
+#define METRICS_WINDOWS { 1, 10, 60 }
+#define METRICS_NUM_WINDOWS 3
+
+/* Maximum number of clients served at the same time */
+#define METRICS_MAX_CLIENTS 8
+
+/* Maximum size of a request we read before answering */
+#define METRICS_REQ_LEN 2048
+
+/* Maximum length of a "[<host>:]<port>" address to listen on */
+#define METRICS_ADDR_LEN 64
+
+/* Rates tracked per interface */
+typedef enum _rate
+{
+	RATE_RX_PACKETS,
+	RATE_TX_PACKETS,
+	RATE_RX_BYTES,
+	RATE_TX_BYTES,
+	NUM_RATES
+} RATE;
+
+/*
+** An interface whose rates we estimate.
+*/
+typedef struct _metricsnetif
+{
+	char		*netif_name;			/* Network interface name */
+	char		*netifh_name;			/* Handler name */
+	NETIFHANDLER	*netifh;			/* Associated handler */
+	NETIF		*netif;				/* Associated NETIF handle */
+
+	NETIFSTATS	last;				/* Statistics at the last sample */
+	BOOL		valid;				/* Whether "last" can be used for rates */
+	double		inst[NUM_RATES],		/* Rates between the last two samples */
+			ewma[METRICS_NUM_WINDOWS][NUM_RATES];	/* Moving averages */
+} METRICSNETIF;
+
+/*
+** A connected client.
+*/
+typedef struct _metricsclient
+{
+	int		fd;				/* Socket (-1 if slot unused) */
+	char		req[METRICS_REQ_LEN];		/* Request received so far */
+	size_t		req_len;
+	char		*resp;				/* Response to be sent... */
+	size_t		resp_len,
+			resp_off;			/* ...and how much of it has been sent */
+} METRICSCLIENT;
+
+/* Function prototypes */
+RC metrics_init(char *addr, int epollfd);
+RC metrics_add_netif(char *netif_name, char *netifh_name, NETIFHANDLER *netifh, NETIF *netif);
+void metrics_del_netif(NETIF *netif);
+void metrics_tick(uint64_t duration, uint interval, BOOL changed, uint64_t overruns);
+BOOL metrics_handle(int fd, uint32_t events);
+void metrics_shutdown(void);
+
+#endif /* _RLEDS_METRICS_H */
@@ -0,0 +1,626 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Loading of LED drivers and network interface handlers
+**
+** Plugins compiled into the program (see builtin.c) are found first. Others are
+** dlopen()ed once and registered, all LEDs using them share their interface
+** structure. Plugins can also be described without loading them, from the ELF note
+** they carry (see ../common/pluginnote.h).
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <elf.h>
+#ifdef DYNAMIC_PLUGINS
+#include <dlfcn.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+#include "../common/netifhandlers.h"
+
+#include "plugins.h"
+
+#ifdef DYNAMIC_PLUGINS
+/* A plugin loaded. There are only a few of them, so a list will do. */
+typedef struct _plugin
+{
+	char		*path;				/* Complete path to the shared object */
+	void		*dlobj;				/* Handle returned by dlopen() */
+	void		*ifstruct;			/* Its interface structure */
+	struct _plugin	*next;
+} PLUGIN;
+
+static PLUGIN *_plugins;
+#endif
+
+/* ELF structures of the kind we were built as, since that's what we can dlopen() */
+#if __SIZEOF_POINTER__ == 8
+#define ELF_CLASS ELFCLASS64
+typedef Elf64_Ehdr ELF_EHDR;
+typedef Elf64_Shdr ELF_SHDR;
+typedef Elf64_Nhdr ELF_NHDR;
+#else
+#define ELF_CLASS ELFCLASS32
+typedef Elf32_Ehdr ELF_EHDR;
+typedef Elf32_Shdr ELF_SHDR;
+typedef Elf32_Nhdr ELF_NHDR;
+#endif
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ELF_DATA ELFDATA2LSB
+#else
+#define ELF_DATA ELFDATA2MSB
+#endif
+
+/* Rounds up to the 4-byte alignment of note fields */
+#define NOTE_ALIGN(n) (((n) + 3) & ~(size_t)3)
+
+/*
+** ifstruct = find_builtin(table, prefix, name)
+**
+** Returns the interface structure of the plugin "name" with "prefix" in "table"
+** (see builtin.c), NULL if it is not compiled in.
+*/
+static void *find_builtin(const BUILTIN_PLUGIN *table, char *prefix, char *name)
+{
+	size_t len = strlen(prefix);
+
+	for (; table->name; table++)
+	{
+		if (strncmp(table->name, prefix, len) == 0 &&
+		    strcmp(table->name + len, name) == 0)
+			return table->ifstruct;
+	}
+
+	return NULL;
+}
+
+#ifdef DYNAMIC_PLUGINS
+/*
+** ifstruct = open_shobj(path, &dlobj)
+**
+** Opens the shared object "path" and looks up its interface structure, whose name is
+** the "canonical name" of "path": the directory part and the suffix removed. For
+** example, "/usr/lib/rleds/ifh_generic.so" becomes "ifh_generic". "dlobj" receives
+** the handle to pass to dlclose().
+**
+** Returns a pointer to the object's interface structure, NULL if the required
+** structure could not be found (the object stays open) and -1 on error, in which
+** case an error message can be found in _errmsg.
+*/
+static void *open_shobj(char *path, void **dlobj)
+{
+	char ifstruct_name[PATH_MAX], *p;
+	void *ifstruct;
+	char *errmsg;
+
+	assert(path && dlobj);
+
+	/* Attempt to open the specified file as a dynamic library */
+	*dlobj = dlopen(path, RTLD_LAZY);
+	if (!*dlobj)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not dlopen() \"%s\":\n%s!\n",
+		         path, dlerror());
+		return (void *)-1;
+	}
+
+	/* Create the structure name based on the shared object name */
+	p = strrchr(path, '/');
+	snprintf(ifstruct_name, sizeof(ifstruct_name), "%s", p ? p + 1 : path);
+	p = strstr(ifstruct_name, ".so");
+	if (p)
+		*p = '\0';
+
+	/* Attempt to locate defining structure */
+	dlerror();
+	ifstruct = dlsym(*dlobj, ifstruct_name);
+	errmsg = dlerror();
+	if (errmsg)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "dlsym() error in %s\n",
+		         errmsg);
+		return (void *)-1;
+	}
+
+	return ifstruct;
+}
+
+/*
+** obj = load_shobj(path)
+**
+** Loads a shared object implementing some functionality and returns a pointer to its
+** interface structure (see open_shobj()). The object is not registered, so that
+** loading it again opens it again.
+**
+** Returns a pointer to the object's interface structure, NULL if the required structure could
+** not be found and -1 on error, in which case an error message can be found in _errmsg.
+*/
+void *load_shobj(char *path)
+{
+	void *dlobj;
+
+	return open_shobj(path, &dlobj);
+}
+
+/*
+** ifstruct = find_plugin(path)
+**
+** Returns the interface structure of the plugin "path" if it is registered already,
+** NULL otherwise.
+*/
+static void *find_plugin(char *path)
+{
+	PLUGIN *plugin;
+
+	for (plugin = _plugins; plugin; plugin = plugin->next)
+	{
+		if (strcmp(plugin->path, path) == 0)
+			return plugin->ifstruct;
+	}
+
+	return NULL;
+}
+
+/*
+** ifstruct = open_plugin(dir, prefix, name, struct_type, &dlobj, path, path_len)
+**
+** Composes the path to the plugin "name" in "dir" into "path" and opens it unless
+** it is registered already, in which case "dlobj" is set to NULL.
+**
+** Returns a pointer to the plugin's interface structure or NULL on error, in which
+** case an error message can be found in _errmsg.
+*/
+static void *open_plugin(char *dir, char *prefix, char *name, char *struct_type,
+                         void **dlobj, char *path, size_t path_len)
+{
+	void *ifstruct;
+
+	if (snprintf(path, path_len, "%s/%s%s.so", dir, prefix, name) >= path_len)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Path to \"%s\" is too long!\n",
+		         name);
+		return NULL;
+	}
+
+	*dlobj = NULL;
+	ifstruct = find_plugin(path);
+	if (ifstruct)
+		return ifstruct;
+
+	/* Attemt to load as shared object */
+	ifstruct = open_shobj(path, dlobj);
+	if (ifstruct == (void *)-1)
+	{
+		if (*dlobj)
+			dlclose(*dlobj);
+		return NULL;
+	}
+	if (!ifstruct)
+	{
+		dlclose(*dlobj);
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "\"%s\" misses the defining %s structure!\n",
+		         name, struct_type);
+		return NULL;
+	}
+
+	return ifstruct;
+}
+
+/*
+** rc = register_plugin(path, dlobj, ifstruct)
+**
+** Registers the plugin "path" opened as "dlobj" with the interface structure
+** "ifstruct", so that it is loaded only once. On failure, it is closed.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+static RC register_plugin(char *path, void *dlobj, void *ifstruct)
+{
+	PLUGIN *plugin;
+
+	plugin = calloc(1, sizeof(PLUGIN));
+	if (!plugin || !(plugin->path = strdup(path)))
+	{
+		free(plugin);
+		dlclose(dlobj);
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for plugin \"%s\"!\n",
+		         path);
+		return ERR;
+	}
+	plugin->dlobj = dlobj;
+	plugin->ifstruct = ifstruct;
+	plugin->next = _plugins;
+	_plugins = plugin;
+
+	return OK;
+}
+#endif
+
+/*
+** leddrvr = load_leddriver(dir, leddriver_name)
+**
+** Attempts to load a LED driver in "dir" by its canonical name, e.g. "parallel"
+** instead of "/foo/bar/drvr_parallel.so". A LED driver compiled in is used
+** instead of one in "dir". Each LED driver is loaded only once, loading it again
+** returns the same LEDDRIVER structure.
+**
+** Returns a pointer to the led driver's LEDDRIVER structure or NULL on error, in
+** which case an error message can be found in _errmsg.
+*/
+LEDDRIVER *load_leddriver(char *dir, char *leddriver_name)
+{
+	LEDDRIVER *leddrvr;
+#ifdef DYNAMIC_PLUGINS
+	char path[PATH_MAX];
+	void *dlobj;
+#endif
+
+	assert(dir && leddriver_name);
+
+	leddrvr = find_builtin(_builtin_leddrivers, LEDDRIVER_PREFIX, leddriver_name);
+	if (leddrvr)
+		return leddrvr;
+
+#ifdef DYNAMIC_PLUGINS
+	leddrvr = open_plugin(dir, LEDDRIVER_PREFIX, leddriver_name, "LEDDRIVER",
+	                      &dlobj, path, sizeof(path));
+	if (!leddrvr || !dlobj)
+		return leddrvr;
+
+	/* Compare API versions */
+	if (leddrvr->api_ver != LEDDRIVER_API_VER)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "LED driver \"%s\" has the wrong API version (%d != ours: %d)!\n",
+		         leddriver_name, leddrvr->api_ver, LEDDRIVER_API_VER);
+		dlclose(dlobj);
+		return NULL;
+	}
+
+	if (register_plugin(path, dlobj, leddrvr) != OK)
+		return NULL;
+
+	return leddrvr;
+#else
+	snprintf(_errmsg, sizeof(_errmsg),
+	         "LED driver \"%s\" is not built in!\n",
+	         leddriver_name);
+	return NULL;
+#endif
+}
+
+/*
+** netifh = load_netifhandler(dir, ifhandler_name)
+**
+** Attempts to load an network interface handler in "dir" by its canonical name, e.g.
+** "generic" instead of "/foo/bar/netifh_generic.so". A handler compiled in is used
+** instead of one in "dir". Each handler is loaded only once, loading it again
+** returns the same NETIFHANDLER structure.
+**
+** Returns a pointer to the network interface handler's NETIFHANDLER structure or NULL
+** on error, in which case an error message can be found in _errmsg.
+*/
+NETIFHANDLER *load_netifhandler(char *dir, char *netifhandler_name)
+{
+	NETIFHANDLER *netifh;
+#ifdef DYNAMIC_PLUGINS
+	char path[PATH_MAX];
+	void *dlobj;
+#endif
+
+	assert(dir && netifhandler_name);
+
+	netifh = find_builtin(_builtin_netifhandlers, NETIFHANDLER_PREFIX, netifhandler_name);
+	if (netifh)
+		return netifh;
+
+#ifdef DYNAMIC_PLUGINS
+	netifh = open_plugin(dir, NETIFHANDLER_PREFIX, netifhandler_name, "NETIFHANDLER",
+	                     &dlobj, path, sizeof(path));
+	if (!netifh || !dlobj)
+		return netifh;
+
+	/* Compare API versions */
+	if (netifh->api_ver != NETIFHANDLER_API_VER)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Network interface handler \"%s\" has the wrong API version (%d != ours: %d)!\n",
+		         netifhandler_name, netifh->api_ver, NETIFHANDLER_API_VER);
+		dlclose(dlobj);
+		return NULL;
+	}
+
+	if (register_plugin(path, dlobj, netifh) != OK)
+		return NULL;
+
+	return netifh;
+#else
+	snprintf(_errmsg, sizeof(_errmsg),
+	         "Network interface handler \"%s\" is not built in!\n",
+	         netifhandler_name);
+	return NULL;
+#endif
+}
+
+/*
+** desc = find_note(map, size, &desc_size)
+**
+** Looks up the plugin note (see ../common/pluginnote.h) in the ELF file mapped at
+** "map" with "size" bytes.
+**
+** Returns a pointer to the note's descriptor, its size in "desc_size", or NULL if
+** the file is no ELF file of our kind or carries no plugin note.
+*/
+static const char *find_note(const char *map, size_t size, size_t *desc_size)
+{
+	const ELF_EHDR *ehdr = (const ELF_EHDR *)map;
+	const ELF_SHDR *shdrs, *strtab;
+	int i;
+
+	if (size < sizeof(ELF_EHDR) ||
+	    memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr->e_ident[EI_CLASS] != ELF_CLASS ||
+	    ehdr->e_ident[EI_DATA] != ELF_DATA ||
+	    ehdr->e_shentsize != sizeof(ELF_SHDR) ||
+	    ehdr->e_shoff > size ||
+	    ehdr->e_shnum > (size - ehdr->e_shoff) / sizeof(ELF_SHDR) ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum)
+		return NULL;
+
+	shdrs = (const ELF_SHDR *)(map + ehdr->e_shoff);
+	strtab = &shdrs[ehdr->e_shstrndx];
+	if (strtab->sh_offset > size || strtab->sh_size > size - strtab->sh_offset)
+		return NULL;
+
+	for (i = 0; i < ehdr->e_shnum; i++)
+	{
+		const ELF_SHDR *shdr = &shdrs[i];
+		size_t pos;
+
+		if (shdr->sh_type != SHT_NOTE ||
+		    shdr->sh_name >= strtab->sh_size ||
+		    strncmp(map + strtab->sh_offset + shdr->sh_name, PLUGIN_NOTE_SECTION,
+		            strtab->sh_size - shdr->sh_name) != 0 ||
+		    shdr->sh_offset > size || shdr->sh_size > size - shdr->sh_offset)
+			continue;
+
+		/* The section may hold several notes */
+		for (pos = 0; pos + sizeof(ELF_NHDR) <= shdr->sh_size; )
+		{
+			const ELF_NHDR *nhdr = (const ELF_NHDR *)(map + shdr->sh_offset + pos);
+			const char *name = (const char *)(nhdr + 1);
+			size_t name_size = NOTE_ALIGN(nhdr->n_namesz);
+
+			if (name_size + NOTE_ALIGN(nhdr->n_descsz) >
+			    shdr->sh_size - pos - sizeof(ELF_NHDR))
+				break;
+
+			if (nhdr->n_type == PLUGIN_NOTE_TYPE &&
+			    nhdr->n_namesz == sizeof(PLUGIN_NOTE_OWNER) &&
+			    memcmp(name, PLUGIN_NOTE_OWNER, sizeof(PLUGIN_NOTE_OWNER)) == 0)
+			{
+				*desc_size = nhdr->n_descsz;
+				return name + name_size;
+			}
+
+			pos += sizeof(ELF_NHDR) + name_size + NOTE_ALIGN(nhdr->n_descsz);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+** rc = read_plugin_info(path, info)
+**
+** Fills in "info" from the note the plugin "path" carries, without loading it.
+** Fields not described stay NULL resp. -1. The strings point into memory to be freed
+** with free_plugin_info().
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC read_plugin_info(char *path, PLUGININFO *info)
+{
+	const char *desc;
+	size_t size, desc_size;
+	struct stat st;
+	uint num_pins = 0;
+	void *map;
+	char *p;
+	int fd;
+
+	assert(path && info);
+
+	memset(info, 0, sizeof(PLUGININFO));
+	info->api_ver = -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not open \"%s\":\n%s!\n",
+		         path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return ERR;
+	}
+	size = st.st_size;
+	map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not map \"%s\":\n%s!\n",
+		         path, size ? strerror(errno) : "Empty file");
+		return ERR;
+	}
+
+	/* Copy the descriptor, making sure that its last field is terminated */
+	desc = find_note(map, size, &desc_size);
+	if (desc)
+	{
+		info->buf = malloc(desc_size + 2);
+		if (info->buf)
+		{
+			memcpy(info->buf, desc, desc_size);
+			info->buf[desc_size] = info->buf[desc_size + 1] = '\0';
+		}
+	}
+	munmap(map, size);
+	if (!desc)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "\"%s\" carries no plugin description!\n",
+		         path);
+		return ERR;
+	}
+	if (!info->buf)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for the description of \"%s\"!\n",
+		         path);
+		return ERR;
+	}
+
+	for (p = info->buf; *p; p += strlen(p) + 1)
+	{
+		if (strncmp(p, "pin=", 4) == 0)
+			num_pins++;
+	}
+	info->pins = calloc(num_pins + 1, sizeof(char *));
+	if (!info->pins)
+	{
+		free_plugin_info(info);
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for the description of \"%s\"!\n",
+		         path);
+		return ERR;
+	}
+	num_pins = 0;
+
+	/* Fields are "<key>=<value>", keys we don't know are ignored */
+	for (p = info->buf; *p; p += strlen(p) + 1)
+	{
+		char *value = strchr(p, '=');
+
+		if (!value)
+			continue;
+		value++;
+
+		if (strncmp(p, "kind=", 5) == 0)
+			info->kind = value;
+		else if (strncmp(p, "api=", 4) == 0)
+			info->api_ver = atoi(value);
+		else if (strncmp(p, "desc=", 5) == 0)
+			info->desc = value;
+		else if (strncmp(p, "ver=", 4) == 0)
+			info->ver = value;
+		else if (strncmp(p, "dev=", 4) == 0)
+			info->def_dev = value;
+		else if (strncmp(p, "tricol=", 7) == 0)
+			info->tricol_desc = value;
+		else if (strncmp(p, "pin=", 4) == 0)
+			info->pins[num_pins++] = value;
+	}
+
+	return OK;
+}
+
+/*
+** rc = read_builtin_info(kind, plugin, info)
+**
+** Fills in "info" for the plugin "plugin" compiled in, which is of the "kind"
+** "leddriver" or "netifhandler". The strings point into its interface structure,
+** "info" must be freed with free_plugin_info() nevertheless.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC read_builtin_info(char *kind, const BUILTIN_PLUGIN *plugin, PLUGININFO *info)
+{
+	assert(kind && plugin && info);
+
+	memset(info, 0, sizeof(PLUGININFO));
+	info->kind = kind;
+	info->builtin = TRUE;
+
+	if (strcmp(kind, "leddriver") == 0)
+	{
+		LEDDRIVER *leddrvr = plugin->ifstruct;
+		uint num_pins = 0;
+
+		while (leddrvr->pins[num_pins])
+			num_pins++;
+		info->pins = calloc(num_pins + 1, sizeof(char *));
+		if (!info->pins)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for the description of \"%s\"!\n",
+			         plugin->name);
+			return ERR;
+		}
+		memcpy(info->pins, leddrvr->pins, num_pins * sizeof(char *));
+
+		info->api_ver = leddrvr->api_ver;
+		info->desc = leddrvr->desc;
+		info->ver = leddrvr->ver;
+		info->def_dev = leddrvr->def_dev;
+	}
+	else
+	{
+		NETIFHANDLER *netifh = plugin->ifstruct;
+
+		info->api_ver = netifh->api_ver;
+		info->desc = netifh->desc;
+		info->ver = netifh->ver;
+		info->tricol_desc = netifh->tricol_desc;
+	}
+
+	return OK;
+}
+
+/*
+** free_plugin_info(info)
+**
+** Frees the memory allocated by read_plugin_info() resp. read_builtin_info() for
+** "info".
+*/
+void free_plugin_info(PLUGININFO *info)
+{
+	assert(info);
+
+	free(info->pins);
+	free(info->buf);
+	info->pins = NULL;
+	info->buf = NULL;
+}
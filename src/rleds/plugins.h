@@ -0,0 +1,77 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for loading of LED drivers and network interface handlers
+*/
+
+#ifndef _RLEDS_PLUGINS_H
+#define _RLEDS_PLUGINS_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <limits.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+#include "../common/netifhandlers.h"
+
+/* Maximum length of buffer for error messages */
+#define MAX_ERRMSG_LEN (PATH_MAX + 100)
+
+/* Error messages of the loader functions below end up here. Defined by the program
+   using them. */
+extern char _errmsg[MAX_ERRMSG_LEN];
+
+/*
+** Description of a plugin as read from its ELF note (see ../common/pluginnote.h).
+** Fields the note does not contain are NULL resp. -1.
+*/
+typedef struct _plugininfo
+{
+	char		*kind;				/* "leddriver" or "netifhandler" */
+	int		api_ver;			/* API version implemented */
+	char		*desc,				/* Description... */
+			*ver;				/* ...and version of the plugin */
+	char		*def_dev;			/* Default device (LED drivers) */
+	char		**pins;				/* NULL-terminated list of pin names
+							   (LED drivers) */
+	char		*tricol_desc;			/* Tri-color LED support (network
+							   interface handlers) */
+	char		*buf;				/* Copy of the note's fields */
+	BOOL		builtin;			/* Compiled into the program? */
+} PLUGININFO;
+
+/*
+** A plugin compiled into the program (see builtin.c). Its tables end with an
+** entry whose "name" is NULL.
+*/
+typedef struct _builtin_plugin
+{
+	char		*name;				/* Canonical name, eg. "leddrvr_parallel" */
+	void		*ifstruct;			/* Its interface structure */
+} BUILTIN_PLUGIN;
+
+extern const BUILTIN_PLUGIN _builtin_leddrivers[], _builtin_netifhandlers[];
+
+/* Function prototypes */
+#ifdef DYNAMIC_PLUGINS
+void *load_shobj(char *path);
+#endif
+LEDDRIVER *load_leddriver(char *dir, char *leddriver_name);
+NETIFHANDLER *load_netifhandler(char *dir, char *netifhandler_name);
+RC read_plugin_info(char *path, PLUGININFO *info);
+RC read_builtin_info(char *kind, const BUILTIN_PLUGIN *plugin, PLUGININFO *info);
+void free_plugin_info(PLUGININFO *info);
+
+#endif /* _RLEDS_PLUGINS_H */
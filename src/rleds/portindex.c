@@ -0,0 +1,181 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Port index
+**
+** Maps a LED driver and a device name to the port set up for them, so that
+** setting up a LED finds the port it shares with others in constant time instead
+** of comparing its device name with those of all ports set up before.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "../common/base.h"
+
+#include "portindex.h"
+
+/*
+** Returns the hash of "leddrvr" and "device_name", the latter ignoring case
+** (FNV-1a).
+*/
+static uint32_t hash(const void *leddrvr, const char *device_name)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)((uintptr_t)leddrvr >> 4);
+
+	for (; *device_name; device_name++)
+	{
+		h ^= (unsigned char)tolower((unsigned char)*device_name);
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+** Stores an entry in the first free slot of its probe sequence. There must be one.
+*/
+static void place(PORTINDEX *idx, const PORTINDEX_ENTRY *entry)
+{
+	uint i = entry->hash & (idx->num_slots - 1);
+
+	while (idx->slots[i].leddrvr)
+		i = (i + 1) & (idx->num_slots - 1);
+
+	idx->slots[i] = *entry;
+	idx->count++;
+}
+
+/*
+** rc = portindex_init(idx, capacity)
+**
+** Initializes "idx" for at least "capacity" entries, discarding any entries it
+** held before.
+**
+** Returns OK on success and ERR if memory could not be allocated.
+*/
+RC portindex_init(PORTINDEX *idx, uint capacity)
+{
+	uint num_slots = PORTINDEX_MIN_SLOTS;
+
+	assert(idx);
+
+	while (num_slots < 2 * capacity)
+		num_slots *= 2;
+
+	free(idx->slots);
+	idx->count = 0;
+	idx->num_slots = num_slots;
+	idx->slots = calloc(num_slots, sizeof(PORTINDEX_ENTRY));
+	if (!idx->slots)
+	{
+		idx->num_slots = 0;
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** port = portindex_find(idx, leddrvr, device_name)
+**
+** Returns the port added for "leddrvr" and "device_name" (ignoring case), NULL if
+** there is none.
+*/
+void *portindex_find(PORTINDEX *idx, const void *leddrvr, const char *device_name)
+{
+	uint32_t h;
+	uint i;
+
+	assert(idx && leddrvr && device_name);
+
+	if (!idx->num_slots)
+		return NULL;
+
+	h = hash(leddrvr, device_name);
+	for (i = h & (idx->num_slots - 1); idx->slots[i].leddrvr;
+	     i = (i + 1) & (idx->num_slots - 1))
+	{
+		PORTINDEX_ENTRY *entry = &idx->slots[i];
+
+		if (entry->hash == h && entry->leddrvr == leddrvr &&
+		    strcasecmp(entry->device_name, device_name) == 0)
+			return entry->port;
+	}
+
+	return NULL;
+}
+
+/*
+** rc = portindex_add(idx, leddrvr, device_name, port)
+**
+** Adds "port" for "leddrvr" and "device_name", which must stay valid as long as
+** the entry. Grows "idx" if it becomes more than half full.
+**
+** Returns OK on success and ERR if memory could not be allocated.
+*/
+RC portindex_add(PORTINDEX *idx, const void *leddrvr, const char *device_name, void *port)
+{
+	PORTINDEX_ENTRY entry;
+
+	assert(idx && leddrvr && device_name);
+
+	if (2 * (idx->count + 1) > idx->num_slots)
+	{
+		PORTINDEX_ENTRY *old = idx->slots;
+		uint num_old = idx->num_slots, i;
+
+		idx->slots = NULL;
+		if (portindex_init(idx, idx->count + 1) != OK)
+		{
+			idx->slots = old;
+			idx->num_slots = num_old;
+			for (i = 0; i < num_old; i++)
+				if (old[i].leddrvr)
+					idx->count++;
+			return ERR;
+		}
+		for (i = 0; i < num_old; i++)
+			if (old[i].leddrvr)
+				place(idx, &old[i]);
+		free(old);
+	}
+
+	entry.leddrvr = leddrvr;
+	entry.device_name = device_name;
+	entry.hash = hash(leddrvr, device_name);
+	entry.port = port;
+	place(idx, &entry);
+
+	return OK;
+}
+
+/*
+** portindex_free(idx)
+**
+** Frees the memory held by "idx".
+*/
+void portindex_free(PORTINDEX *idx)
+{
+	assert(idx);
+
+	free(idx->slots);
+	idx->slots = NULL;
+	idx->num_slots = idx->count = 0;
+}
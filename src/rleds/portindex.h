@@ -0,0 +1,60 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the port index
+*/
+
+#ifndef _RLEDS_PORTINDEX_H
+#define _RLEDS_PORTINDEX_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../common/base.h"
+
+/* Smallest number of slots of an index */
+#define PORTINDEX_MIN_SLOTS 16
+
+/*
+** An entry of the index: a LED driver, a device name (compared case-insensitively)
+** and the port it maps to.
+*/
+typedef struct _portindex_entry
+{
+	const void	*leddrvr;			/* LED driver (NULL if the slot is free) */
+	const char	*device_name;			/* Device name (not copied) */
+	uint32_t	hash;				/* Hash of the two */
+	void		*port;				/* Port management structure */
+} PORTINDEX_ENTRY;
+
+/*
+** A hash table with open addressing, kept at most half full so that lookups take
+** constant time on average. Entries cannot be removed, the index is rebuilt instead.
+*/
+typedef struct _portindex
+{
+	PORTINDEX_ENTRY	*slots;				/* The slots */
+	uint		num_slots,			/* Number of slots (a power of two)... */
+			count;				/* ...and of those in use */
+} PORTINDEX;
+
+/* Function prototypes */
+RC portindex_init(PORTINDEX *idx, uint capacity);
+void *portindex_find(PORTINDEX *idx, const void *leddrvr, const char *device_name);
+RC portindex_add(PORTINDEX *idx, const void *leddrvr, const char *device_name, void *port);
+void portindex_free(PORTINDEX *idx);
+
+#endif /* _RLEDS_PORTINDEX_H */
@@ -0,0 +1,474 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Tick profiler
+**
+** Records the wall time of each tick and of the handler and driver calls made
+** during it in log2-scaled histograms. Where the kernel lets us, a perf_event
+** counter group on our own thread additionally yields the cycles, instructions and
+** system calls spent per tick.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../common/base.h"
+
+#include "profile.h"
+
+/* Where to find the id of the raw_syscalls:sys_enter tracepoint */
+static const char *_tracepoint_paths[] =
+{
+	"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+	"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+	NULL
+};
+
+/* Set when profiling is enabled */
+BOOL _profiling = FALSE;
+
+/* All registered histograms, in order of registration */
+static HISTOGRAM *_hists, **_hists_tail = &_hists;
+
+/* Histograms for whole ticks */
+static HISTOGRAM *_tick_hist, *_ctr_hists[PERFCTR_NUM];
+
+/* perf_event counter group: file descriptor of the group leader, position of each
+   counter in the group (-1 if not available) and number of counters in the group */
+static int _perf_fd = -1;
+static int _perf_idx[PERFCTR_NUM];
+static int _perf_nr;
+
+/* Tick statistics */
+static uint64_t _start_time, _ticks, _overruns, _misses;
+
+/* Values at the start of the current tick */
+static uint64_t _tick_start, _ctr_start[PERFCTR_NUM];
+
+/*
+** now = profile_now()
+**
+** Returns the current CLOCK_MONOTONIC time in nanoseconds.
+*/
+uint64_t profile_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+** hist_add(hist, val)
+**
+** Adds the value "val" to the histogram "hist".
+*/
+void hist_add(HISTOGRAM *hist, uint64_t val)
+{
+	int bucket;
+
+	assert(hist);
+
+	bucket = val ? 64 - __builtin_clzll(val) : 0;
+	if (bucket >= HIST_BUCKETS)
+		bucket = HIST_BUCKETS - 1;
+
+	hist->buckets[bucket]++;
+	if (!hist->count || val < hist->min)
+		hist->min = val;
+	if (val > hist->max)
+		hist->max = val;
+	hist->count++;
+	hist->sum += val;
+}
+
+/*
+** Returns an upper bound for the "permille"th permille of the values in "hist".
+*/
+static uint64_t hist_quantile(HISTOGRAM *hist, uint permille)
+{
+	uint64_t rank = (hist->count * permille + 999) / 1000, seen = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	/* The last bucket is open-ended, and no bound needs to exceed the maximum */
+	if (i >= HIST_BUCKETS - 1 || ((uint64_t)1 << i) - 1 > hist->max)
+		return hist->max;
+
+	return i ? ((uint64_t)1 << i) - 1 : 0;
+}
+
+/*
+** hist_print(f, hist)
+**
+** Prints the histogram "hist" to "f".
+*/
+void hist_print(FILE *f, HISTOGRAM *hist)
+{
+	int i;
+
+	assert(f && hist);
+
+	fprintf(f, "%s [%s]: count %llu", hist->label, hist->unit,
+	        (unsigned long long)hist->count);
+	if (!hist->count)
+	{
+		fprintf(f, "\n");
+		return;
+	}
+
+	fprintf(f, ", min %llu, avg %llu, p50 <= %llu, p99 <= %llu, max %llu\n",
+	        (unsigned long long)hist->min,
+	        (unsigned long long)(hist->sum / hist->count),
+	        (unsigned long long)hist_quantile(hist, 500),
+	        (unsigned long long)hist_quantile(hist, 990),
+	        (unsigned long long)hist->max);
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		if (!hist->buckets[i])
+			continue;
+
+		if (i == 0)
+			fprintf(f, "  %20s", "0");
+		else if (i == HIST_BUCKETS - 1)
+			fprintf(f, "  %20llu+", (unsigned long long)1 << (i - 1));
+		else
+			fprintf(f, "  %9llu..%9llu",
+			        (unsigned long long)1 << (i - 1), ((unsigned long long)1 << i) - 1);
+		fprintf(f, " %12llu\n", (unsigned long long)hist->buckets[i]);
+	}
+}
+
+/*
+** hist = profile_register(unit, fmt, ...)
+**
+** Allocates a histogram for values in "unit", labeled with the printf()-style "fmt"
+** and arguments, which will be included in profile_dump()'s output.
+**
+** Returns the new histogram or NULL if out of memory.
+*/
+HISTOGRAM *profile_register(char *unit, const char *fmt, ...)
+{
+	HISTOGRAM *hist;
+	va_list ap;
+
+	assert(unit && fmt);
+
+	hist = calloc(1, sizeof(HISTOGRAM));
+	if (!hist)
+		return NULL;
+
+	va_start(ap, fmt);
+	vsnprintf(hist->label, sizeof(hist->label), fmt, ap);
+	va_end(ap);
+	hist->unit = unit;
+
+	*_hists_tail = hist;
+	_hists_tail = &hist->next;
+
+	return hist;
+}
+
+/*
+** Returns the id of the raw_syscalls:sys_enter tracepoint or -1 if unknown.
+*/
+static long syscall_tracepoint(void)
+{
+	const char **path;
+
+	for (path = _tracepoint_paths; *path; path++)
+	{
+		char buf[32];
+		int fd;
+		ssize_t len;
+
+		fd = open(*path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+
+		len = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (len > 0)
+		{
+			buf[len] = '\0';
+			return atol(buf);
+		}
+	}
+
+	return -1;
+}
+
+/*
+** Opens perf_event counter "ctr" on our own thread, as part of the group led by
+** "group_fd" (-1 to start a new group).
+**
+** Returns the file descriptor or -1 on failure.
+*/
+static int perf_open(PERFCTR ctr, int group_fd)
+{
+	struct perf_event_attr attr;
+	long tracepoint;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.read_format = PERF_FORMAT_GROUP;
+
+	switch (ctr)
+	{
+		case PERFCTR_CYCLES:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+		case PERFCTR_INSTRUCTIONS:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+		case PERFCTR_SYSCALLS:
+			tracepoint = syscall_tracepoint();
+			if (tracepoint == -1)
+				return -1;
+			attr.type = PERF_TYPE_TRACEPOINT;
+			attr.config = tracepoint;
+			break;
+		default:
+			return -1;
+	}
+
+	/* Count kernel work done on our behalf, unless we're not allowed to */
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1 && attr.type == PERF_TYPE_HARDWARE)
+	{
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+	}
+
+	return fd;
+}
+
+/*
+** Adds counter "ctr" to our perf_event counter group.
+*/
+static void perf_add(PERFCTR ctr)
+{
+	int fd;
+
+	fd = perf_open(ctr, _perf_fd);
+	if (fd == -1)
+		return;
+
+	if (_perf_fd == -1)
+		_perf_fd = fd;
+	_perf_idx[ctr] = _perf_nr++;
+}
+
+/*
+** Reads the current values of our perf_event counters into "vals".
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC perf_read(uint64_t *vals)
+{
+	uint64_t buf[1 + PERFCTR_NUM];
+	int i;
+
+	if (read(_perf_fd, buf, sizeof(buf)) < (ssize_t)((1 + _perf_nr) * sizeof(uint64_t)))
+		return ERR;
+
+	for (i = 0; i < PERFCTR_NUM; i++)
+	{
+		if (_perf_idx[i] != -1)
+			vals[i] = buf[1 + _perf_idx[i]];
+	}
+
+	return OK;
+}
+
+/*
+** rc = profile_init()
+**
+** Sets up profiling: registers the tick histograms and opens whatever perf_event
+** counters the kernel lets us have. Missing counters are not an error.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC profile_init(void)
+{
+	int i;
+
+	_tick_hist = profile_register("ns", "tick");
+	_ctr_hists[PERFCTR_CYCLES] = profile_register("cycles", "tick");
+	_ctr_hists[PERFCTR_INSTRUCTIONS] = profile_register("instructions", "tick");
+	_ctr_hists[PERFCTR_SYSCALLS] = profile_register("syscalls", "tick");
+	if (!_tick_hist || !_ctr_hists[PERFCTR_CYCLES] ||
+	    !_ctr_hists[PERFCTR_INSTRUCTIONS] || !_ctr_hists[PERFCTR_SYSCALLS])
+		return ERR;
+
+	for (i = 0; i < PERFCTR_NUM; i++)
+		_perf_idx[i] = -1;
+
+	for (i = 0; i < PERFCTR_NUM; i++)
+		perf_add(i);
+
+	_start_time = profile_now();
+
+	return OK;
+}
+
+/*
+** fd = profile_counter_open(ctr)
+**
+** Opens perf_event counter "ctr" on our own thread on its own, for programs that want
+** to measure something other than ticks.
+**
+** Returns a file descriptor to pass to profile_counter_read() or -1 if the counter is
+** not available.
+*/
+int profile_counter_open(PERFCTR ctr)
+{
+	return perf_open(ctr, -1);
+}
+
+/*
+** rc = profile_counter_read(fd, &val)
+**
+** Reads the current value of the counter opened as "fd" by profile_counter_open()
+** into "val". When counting system calls, note that this call counts itself.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC profile_counter_read(int fd, uint64_t *val)
+{
+	uint64_t buf[2];
+
+	if (read(fd, buf, sizeof(buf)) != sizeof(buf))
+		return ERR;
+
+	*val = buf[1];
+	return OK;
+}
+
+/*
+** profile_tick_start()
+**
+** Marks the start of a tick.
+*/
+void profile_tick_start(void)
+{
+	if (_perf_fd != -1)
+		(void)perf_read(_ctr_start);
+
+	_tick_start = profile_now();
+}
+
+/*
+** profile_tick_end(deadline, overruns)
+**
+** Marks the end of a tick. A tick that took longer than "deadline" microseconds is
+** counted as a missed deadline. "overruns" is the number of ticks that were skipped
+** entirely since the last one.
+*/
+void profile_tick_end(uint deadline, uint64_t overruns)
+{
+	uint64_t dt = profile_now() - _tick_start;
+
+	hist_add(_tick_hist, dt);
+	_ticks++;
+	_overruns += overruns;
+	if (dt > (uint64_t)deadline * 1000)
+		_misses++;
+
+	if (_perf_fd != -1)
+	{
+		uint64_t vals[PERFCTR_NUM];
+		int i;
+
+		if (perf_read(vals) != OK)
+			return;
+
+		for (i = 0; i < PERFCTR_NUM; i++)
+		{
+			uint64_t delta;
+
+			if (_perf_idx[i] == -1)
+				continue;
+
+			delta = vals[i] - _ctr_start[i];
+
+			/* Don't count the read() that fetched these values */
+			if (i == PERFCTR_SYSCALLS && delta)
+				delta--;
+
+			hist_add(_ctr_hists[i], delta);
+		}
+	}
+}
+
+/*
+** profile_dump(f)
+**
+** Prints all profiling data gathered so far to "f".
+*/
+void profile_dump(FILE *f)
+{
+	HISTOGRAM *hist;
+	int i;
+
+	assert(f);
+
+	fprintf(f, "=== rleds profile after %.3f s ===\n",
+	        (profile_now() - _start_time) / 1e9);
+	fprintf(f, "ticks %llu, missed deadlines %llu, skipped ticks %llu\n",
+	        (unsigned long long)_ticks, (unsigned long long)_misses,
+	        (unsigned long long)_overruns);
+
+	for (hist = _hists; hist; hist = hist->next)
+	{
+		/* Counters we couldn't open have nothing to say */
+		for (i = 0; i < PERFCTR_NUM; i++)
+		{
+			if (hist == _ctr_hists[i] && _perf_idx[i] == -1)
+				break;
+		}
+		if (i < PERFCTR_NUM)
+		{
+			fprintf(f, "%s [%s]: not available\n", hist->label, hist->unit);
+			continue;
+		}
+
+		hist_print(f, hist);
+	}
+
+	fflush(f);
+}
@@ -0,0 +1,76 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the tick profiler
+*/
+
+#ifndef _RLEDS_PROFILE_H
+#define _RLEDS_PROFILE_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../common/base.h"
+
+/* Number of buckets in a histogram. Bucket n counts values in [2^(n-1), 2^n), bucket
+   0 counts zeroes and the last bucket everything beyond. */
+#define HIST_BUCKETS 40
+
+/* Maximum length of a histogram label */
+#define HIST_LABEL_LEN 64
+
+/* Hardware and software counters sampled per tick */
+typedef enum _perfctr
+{
+	PERFCTR_CYCLES,					/* CPU cycles */
+	PERFCTR_INSTRUCTIONS,				/* Instructions retired */
+	PERFCTR_SYSCALLS,				/* System calls entered */
+	PERFCTR_NUM
+} PERFCTR;
+
+/*
+** A histogram with fixed, log2-scaled buckets.
+*/
+typedef struct _histogram
+{
+	char		label[HIST_LABEL_LEN];		/* What is being measured */
+	char		*unit;				/* Unit of the values ("ns" for times) */
+
+	uint64_t	buckets[HIST_BUCKETS];		/* Bucket counts */
+	uint64_t	count,				/* Number of values added */
+			sum,				/* Sum of all values */
+			min,				/* Smallest value */
+			max;				/* Largest value */
+
+	struct _histogram *next;			/* Next registered histogram */
+} HISTOGRAM;
+
+/* Set when profiling is enabled */
+extern BOOL _profiling;
+
+/* Function prototypes */
+uint64_t profile_now(void);
+void hist_add(HISTOGRAM *hist, uint64_t val);
+void hist_print(FILE *f, HISTOGRAM *hist);
+HISTOGRAM *profile_register(char *unit, const char *fmt, ...);
+RC profile_init(void);
+int profile_counter_open(PERFCTR ctr);
+RC profile_counter_read(int fd, uint64_t *val);
+void profile_tick_start(void);
+void profile_tick_end(uint deadline, uint64_t overruns);
+void profile_dump(FILE *f);
+
+#endif /* _RLEDS_PROFILE_H */
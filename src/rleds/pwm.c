@@ -0,0 +1,349 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Software PWM engine
+**
+** Dims LEDs on drivers that can only switch pins on and off: a thread refreshes
+** all ports at a fixed rate, a PWM period spanning PWM_SLOTS refreshes. Whenever
+** the renderer changes a port's duty cycles, the frames of all slots of a period
+** are precomputed from a table of on/off patterns per duty cycle. A refresh then
+** only looks up its slot's frame and commits it if it differs from the last one.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/eventfd.h>
+
+#include "../common/base.h"
+#include "../common/leddrivers.h"
+
+#include "rleds.h"
+
+/* The slots each duty cycle is on for, as a bitmask */
+static uint16_t _patterns[PWM_SLOTS + 1];
+
+/* The ports refreshed, the time between two refreshes in nanoseconds, the PWM thread,
+   the eventfd it waits on while all ports are steady and the flag telling it to
+   stop (_pwm_efd is -1 if it is not running) */
+static LEDPORT *_pwm_ports;
+static uint _pwm_num_ports;
+static uint64_t _pwm_period;
+static pthread_t _pwm_thread;
+static int _pwm_efd = -1;
+static BOOL _pwm_stop = FALSE;
+
+/*
+** Fills in _patterns. A pin's on slots are spread over the period as evenly as
+** possible, so that low refresh rates flicker as little as they can.
+*/
+static void build_patterns(void)
+{
+	uint d, s;
+
+	for (d = 0; d <= PWM_SLOTS; d++)
+	{
+		_patterns[d] = 0;
+		for (s = 0; s < PWM_SLOTS; s++)
+			if ((s + 1) * d / PWM_SLOTS > s * d / PWM_SLOTS)
+				_patterns[d] |= 1 << s;
+	}
+}
+
+/*
+** rc = pwm_setup_port(ledport)
+**
+** Allocates the duty cycles and frame sequence of "ledport", replacing the ones
+** allocated before, if any. All pins start out off.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC pwm_setup_port(LEDPORT *ledport)
+{
+	uint bits;
+
+	assert(ledport);
+
+	if (!_patterns[PWM_SLOTS])
+		build_patterns();
+
+	free(ledport->duty);
+	free(ledport->built_duty);
+	free(ledport->seq);
+	free(ledport->pwm_frame);
+
+	bits = ledport->frame_words * 64;
+	ledport->duty = calloc(bits, sizeof(uint8_t));
+	ledport->built_duty = calloc(bits, sizeof(uint8_t));
+	ledport->seq = calloc(PWM_SLOTS * ledport->frame_words, sizeof(uint64_t));
+	ledport->pwm_frame = calloc(ledport->frame_words, sizeof(uint64_t));
+	if (!ledport->duty || !ledport->built_duty || !ledport->seq || !ledport->pwm_frame)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for PWM sequences!\n");
+		return ERR;
+	}
+	ledport->seq_gen = 0;
+	ledport->steady = TRUE;
+
+	return OK;
+}
+
+/*
+** changed = pwm_update(ledport)
+**
+** Rebuilds the frame sequence of "ledport" if the duty cycles of its pins changed
+** since it was built last, and wakes up the PWM thread if it is waiting.
+**
+** The sequence is guarded by a seqlock: the renderer is its only writer and never
+** waits for the PWM thread, which retries reading if it overlapped with an update.
+**
+** Returns TRUE if the duty cycles changed.
+*/
+BOOL pwm_update(LEDPORT *ledport)
+{
+	uint gen = ledport->seq_gen, w, b, s;
+	uint64_t val = 1;
+	BOOL steady = TRUE;
+
+	assert(ledport);
+
+	if (memcmp(ledport->duty, ledport->built_duty, ledport->frame_words * 64) == 0)
+		return FALSE;
+
+	__atomic_store_n(&ledport->seq_gen, gen + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (w = 0; w < ledport->frame_words; w++)
+	{
+		uint64_t words[PWM_SLOTS];
+
+		/* Distribute each pin's on slots over the slots' frames */
+		memset(words, 0, sizeof(words));
+		for (b = 0; b < 64; b++)
+		{
+			uint duty = ledport->duty[w * 64 + b];
+			uint pattern = _patterns[duty];
+
+			if (duty != 0 && duty != PWM_SLOTS)
+				steady = FALSE;
+
+			while (pattern)
+			{
+				s = __builtin_ctz(pattern);
+				pattern &= pattern - 1;
+				words[s] |= (uint64_t)1 << b;
+			}
+		}
+
+		for (s = 0; s < PWM_SLOTS; s++)
+			__atomic_store_n(&ledport->seq[s * ledport->frame_words + w], words[s],
+			                 __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&ledport->seq_gen, gen + 2, __ATOMIC_RELEASE);
+
+	memcpy(ledport->built_duty, ledport->duty, ledport->frame_words * 64);
+	__atomic_store_n(&ledport->steady, steady, __ATOMIC_RELEASE);
+
+	if (_pwm_efd != -1)
+		(void)write(_pwm_efd, &val, sizeof(val));
+
+	return TRUE;
+}
+
+/*
+** Commits the frame of slot "slot" to "ledport" unless it is enabled already.
+**
+** Returns OK on success and ERR on failure.
+*/
+static RC refresh_port(LEDPORT *ledport, uint slot)
+{
+	uint64_t *seq = &ledport->seq[slot * ledport->frame_words], t = 0;
+	uint gen, w;
+
+	do
+	{
+		gen = __atomic_load_n(&ledport->seq_gen, __ATOMIC_ACQUIRE);
+		for (w = 0; w < ledport->frame_words; w++)
+			ledport->pwm_frame[w] = __atomic_load_n(&seq[w], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((gen & 1) || gen != __atomic_load_n(&ledport->seq_gen, __ATOMIC_RELAXED));
+
+	if (memcmp(ledport->pwm_frame, ledport->shadow,
+	           ledport->frame_words * sizeof(uint64_t)) == 0)
+		return OK;
+
+	if (_profiling)
+		t = profile_now();
+
+	if (ledport->leddrvr->set_frame(ledport->port, ledport->pwm_frame, ledport->valid) != OK)
+	{
+		fprintf(stderr,
+		        "Error enabling pins on \"%s\": %s!\n",
+		        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+		return ERR;
+	}
+	if (ledport->leddrvr->commit(ledport->port) != OK)
+	{
+		fprintf(stderr,
+		        "Error committing pins on \"%s\": %s!\n",
+		        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+		return ERR;
+	}
+
+	if (_profiling)
+		hist_add(ledport->commit_hist, profile_now() - t);
+
+	memcpy(ledport->shadow, ledport->pwm_frame, ledport->frame_words * sizeof(uint64_t));
+
+	return OK;
+}
+
+/*
+** PWM thread: refreshes all ports once per _pwm_period nanoseconds, at absolute
+** deadlines. While all pins are either fully on or off, every slot has the same
+** frame, so we wait for the duty cycles to change instead.
+*/
+static void *pwm_thread(void *arg)
+{
+	struct timespec next, now;
+	uint64_t val, skipped;
+	uint slot = 0, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&_pwm_stop, __ATOMIC_ACQUIRE))
+	{
+		BOOL steady = TRUE;
+
+		for (i = 0; i < _pwm_num_ports; i++)
+		{
+			LEDPORT *ledport = &_pwm_ports[i];
+
+			/* Checked before reading the frame, so that an update we miss
+			   here still wakes us up below */
+			if (!__atomic_load_n(&ledport->steady, __ATOMIC_ACQUIRE))
+				steady = FALSE;
+
+			if (refresh_port(ledport, slot) != OK)
+			{
+				/* Have the main loop shut us down */
+				kill(getpid(), SIGTERM);
+				return NULL;
+			}
+		}
+		slot = (slot + 1) % PWM_SLOTS;
+
+		if (steady)
+		{
+			(void)read(_pwm_efd, &val, sizeof(val));
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			continue;
+		}
+
+		/* Sleep until the next deadline, skipping the ones missed */
+		next.tv_nsec += _pwm_period;
+		next.tv_sec += next.tv_nsec / 1000000000;
+		next.tv_nsec %= 1000000000;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		skipped = 0;
+		if (TS_NS(now) > TS_NS(next))
+		{
+			skipped = (TS_NS(now) - TS_NS(next)) / _pwm_period + 1;
+			next = now;
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		jitter_add(&_pwm_jitter, TS_NS(now) - TS_NS(next), skipped);
+	}
+
+	return NULL;
+}
+
+/*
+** rc = pwm_start(ports, num_ports, hz)
+**
+** Starts the PWM thread refreshing the "num_ports" ports in "ports" "hz" times per
+** second. The ports must have been set up with pwm_setup_port().
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC pwm_start(LEDPORT *ports, uint num_ports, uint hz)
+{
+	int rc;
+
+	assert(ports && hz);
+
+	_pwm_ports = ports;
+	_pwm_num_ports = num_ports;
+	_pwm_period = 1000000000 / hz;
+	_pwm_stop = FALSE;
+
+	_pwm_efd = eventfd(0, EFD_CLOEXEC);
+	if (_pwm_efd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set up PWM:\n%s!\n",
+		         strerror(errno));
+		return ERR;
+	}
+
+	rc = pthread_create(&_pwm_thread, NULL, pwm_thread, NULL);
+	if (rc != 0)
+	{
+		close(_pwm_efd);
+		_pwm_efd = -1;
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not start PWM thread:\n%s!\n",
+		         strerror(rc));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** pwm_stop()
+**
+** Stops the PWM thread, if running. The pins stay in the state of the slot
+** refreshed last.
+*/
+void pwm_stop(void)
+{
+	uint64_t val = 1;
+
+	if (_pwm_efd == -1)
+		return;
+
+	__atomic_store_n(&_pwm_stop, TRUE, __ATOMIC_RELEASE);
+	(void)write(_pwm_efd, &val, sizeof(val));
+	pthread_join(_pwm_thread, NULL);
+	close(_pwm_efd);
+	_pwm_efd = -1;
+}
@@ -0,0 +1,49 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the software PWM engine
+*/
+
+#ifndef _RLEDS_PWM_H
+#define _RLEDS_PWM_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+
+/* A PWM period consists of PWM_SLOTS refreshes, a pin's duty cycle being the number
+   of them it is on for (0 to PWM_SLOTS) */
+#define PWM_SLOTS 16
+
+/* Range of refresh rates accepted on the command line, in Hz */
+#define PWM_MIN_HZ 100
+#define PWM_MAX_HZ 100000
+
+/* Duty cycle for a brightness between 0 and BRIGHTNESS_MAX. Anything not off is
+   on for at least one slot. */
+#define PWM_DUTY(brightness) \
+	((brightness) ? ((brightness) * PWM_SLOTS + BRIGHTNESS_MAX - 1) / BRIGHTNESS_MAX : 0)
+
+struct _ledport;
+
+/* Function prototypes */
+RC pwm_setup_port(struct _ledport *ledport);
+BOOL pwm_update(struct _ledport *ledport);
+RC pwm_start(struct _ledport *ports, uint num_ports, uint hz);
+void pwm_stop(void);
+
+#endif /* _RLEDS_PWM_H */
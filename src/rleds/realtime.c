@@ -0,0 +1,234 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Real-time mode
+**
+** Keeps page faults, migrations and lower-priority work from delaying our ticks:
+** locks all memory, faults in the stack and a heap reserve up front, pins us to a
+** set of CPUs and optionally runs us with SCHED_FIFO priority. Threads started
+** afterwards inherit all of this. Also keeps track of how late threads wake up
+** for their deadlines.
+*/
+
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+
+#include <sys/mman.h>
+
+#include "../common/base.h"
+
+#include "plugins.h"
+#include "realtime.h"
+
+/* Wakeup statistics of the main loop, the renderer and the PWM thread */
+JITTER _tick_jitter = { "sampler", 0, 0, 0, 0 };
+JITTER _render_jitter = { "renderer", 0, 0, 0, 0 };
+JITTER _pwm_jitter = { "pwm", 0, 0, 0, 0 };
+JITTER *_jitters[NUM_JITTERS] = { &_tick_jitter, &_render_jitter, &_pwm_jitter };
+
+/*
+** rc = rt_parse_cpus(list, &cpus)
+**
+** Parses the comma-separated list of CPU numbers and ranges "list" (e.g. "0,2-3")
+** into "cpus".
+**
+** Returns OK on success and ERR if "list" is malformed.
+*/
+RC rt_parse_cpus(char *list, cpu_set_t *cpus)
+{
+	unsigned long first, last;
+	char *p = list, *end;
+
+	assert(list && cpus);
+
+	CPU_ZERO(cpus);
+	do
+	{
+		first = last = strtoul(p, &end, 10);
+		if (end == p)
+			return ERR;
+		if (*end == '-')
+		{
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p || last < first)
+				return ERR;
+		}
+		if (last >= CPU_SETSIZE)
+			return ERR;
+
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+
+		p = end + 1;
+	}
+	while (*end == ',');
+
+	return *end ? ERR : OK;
+}
+
+/*
+** rc = rt_set_affinity(cpus)
+**
+** Restricts us to the CPUs in "cpus".
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC rt_set_affinity(cpu_set_t *cpus)
+{
+	assert(cpus);
+
+	if (sched_setaffinity(0, sizeof(*cpus), cpus) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set CPU affinity:\n%s!\n",
+		         strerror(errno));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** Touches RT_STACK_PREFAULT bytes of stack below the caller's frame.
+*/
+static void __attribute__((noinline)) prefault_stack(void)
+{
+	volatile char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/*
+** rc = rt_lock_memory()
+**
+** Locks all our memory, present and future, and faults in the stack and a heap
+** reserve, so that running never waits for a page to be read or zeroed. Stacks of
+** threads started later get locked, and thus faulted in, when they are mapped.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC rt_lock_memory(void)
+{
+	char *reserve;
+	size_t i;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not lock memory:\n%s!\n",
+		         strerror(errno));
+		return ERR;
+	}
+
+	prefault_stack();
+
+	/* Have malloc() serve everything from the heap and never give memory back,
+	   then grow the heap by the reserve once */
+	(void)mallopt(M_TRIM_THRESHOLD, -1);
+	(void)mallopt(M_MMAP_MAX, 0);
+	reserve = malloc(RT_HEAP_PREFAULT);
+	if (reserve)
+	{
+		for (i = 0; i < RT_HEAP_PREFAULT; i += 4096)
+			reserve[i] = 0;
+		free(reserve);
+	}
+
+	return OK;
+}
+
+/*
+** rc = rt_set_priority(prio)
+**
+** Switches us to the SCHED_FIFO scheduling policy with priority "prio".
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC rt_set_priority(int prio)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set SCHED_FIFO priority %d:\n%s!\n",
+		         prio, strerror(errno));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** jitter_add(jitter, latency, overruns)
+**
+** Accounts for a wakeup "latency" nanoseconds after the deadline, which followed
+** "overruns" deadlines skipped.
+*/
+void jitter_add(JITTER *jitter, uint64_t latency, uint64_t overruns)
+{
+	assert(jitter);
+
+	/* We are the only writer, so plain reads suffice */
+	__atomic_store_n(&jitter->wakeups, jitter->wakeups + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&jitter->latency_sum, jitter->latency_sum + latency, __ATOMIC_RELAXED);
+	if (latency > jitter->latency_max)
+		__atomic_store_n(&jitter->latency_max, latency, __ATOMIC_RELAXED);
+	if (overruns)
+		__atomic_store_n(&jitter->overruns, jitter->overruns + overruns, __ATOMIC_RELAXED);
+}
+
+/*
+** rt_dump(f)
+**
+** Prints the wakeup statistics to "f".
+*/
+void rt_dump(FILE *f)
+{
+	int i;
+
+	assert(f);
+
+	for (i = 0; i < NUM_JITTERS; i++)
+	{
+		JITTER *jitter = _jitters[i];
+		uint64_t wakeups = __atomic_load_n(&jitter->wakeups, __ATOMIC_RELAXED);
+
+		if (!wakeups)
+			continue;
+
+		fprintf(f, "%s wakeups %llu, latency avg %llu ns, max %llu ns, skipped deadlines %llu\n",
+		        jitter->name, (unsigned long long)wakeups,
+		        (unsigned long long)(__atomic_load_n(&jitter->latency_sum, __ATOMIC_RELAXED) / wakeups),
+		        (unsigned long long)__atomic_load_n(&jitter->latency_max, __ATOMIC_RELAXED),
+		        (unsigned long long)__atomic_load_n(&jitter->overruns, __ATOMIC_RELAXED));
+	}
+}
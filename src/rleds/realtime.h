@@ -0,0 +1,61 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for real-time mode
+*/
+
+#ifndef _RLEDS_REALTIME_H
+#define _RLEDS_REALTIME_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+
+#include "../common/base.h"
+
+/* How much of the main thread's stack to fault in before locking it, and how much
+   heap to keep around for allocations made while running */
+#define RT_STACK_PREFAULT (256 * 1024)
+#define RT_HEAP_PREFAULT (1024 * 1024)
+
+/*
+** Wakeup statistics of a thread waiting for absolute deadlines. Updated by that
+** thread only; other threads read them with atomic loads.
+*/
+typedef struct _jitter
+{
+	char		*name;				/* Thread name */
+	uint64_t	wakeups,			/* Deadlines waited for */
+			latency_sum,			/* Sum and maximum of the times we woke */
+			latency_max,			/* up after the deadlines, in nanoseconds */
+			overruns;			/* Deadlines skipped because we were late */
+} JITTER;
+
+/* Wakeup statistics of the main loop, the renderer and the PWM thread, and all of
+   them in this order */
+#define NUM_JITTERS 3
+extern JITTER _tick_jitter, _render_jitter, _pwm_jitter;
+extern JITTER *_jitters[NUM_JITTERS];
+
+/* Function prototypes */
+RC rt_parse_cpus(char *list, cpu_set_t *cpus);
+RC rt_set_affinity(cpu_set_t *cpus);
+RC rt_lock_memory(void);
+RC rt_set_priority(int prio);
+void jitter_add(JITTER *jitter, uint64_t latency, uint64_t overruns);
+void rt_dump(FILE *f);
+
+#endif /* _RLEDS_REALTIME_H */
@@ -13,6 +13,8 @@
 ** Main program
 */
 
+#define _GNU_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #include "../../config.h"
 #endif
@@ -26,10 +28,17 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <dirent.h>
-#include <libgen.h>
 #include <errno.h>
 #include <getopt.h>
-#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
 
 #include "../common/base.h"
 #include "../common/leddrivers.h"
@@ -41,18 +50,91 @@ const char *_prgbanner =
         "%s - Router LED control program\n"
         "Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>\n\n";
 
-/* Set by our signal handler */
-char _shutdown = 0;
+/* Set when the main loop should terminate */
+BOOL _shutdown = FALSE;
+
+/* The main loop waits on _epollfd for ticks from _timerfd and signals from
+   _signalfd */
+int _epollfd, _timerfd, _signalfd;
+
+/* Time between two samples resp. two renders in microseconds. If they differ, a
+   separate thread renders, otherwise each tick does both. */
+uint _sample_interval = SLEEP_TIME, _render_interval = SLEEP_TIME;
+
+/* Schedules the LEDs' samples, in CLOCK_MONOTONIC milliseconds */
+TIMERWHEEL _wheel;
+
+/* Time until the next tick in microseconds, the epoll_wait() timeout waiting for it
+   (-1 if _timerfd is armed for it), the tick _timerfd is armed for (0 if disarmed)
+   and our default and current timer slack */
+uint _tick_interval;
+int _tick_timeout;
+uint64_t _armed_at;
+unsigned long _def_slack, _cur_slack;
+
+/* Signals we handle */
+const int _signals[] = { SIGHUP, SIGINT, SIGABRT, SIGTERM, SIGUSR1, SIGUSR2 };
 
 /* Global error message variables */
 char _errmsg[MAX_ERRMSG_LEN];
 
+/* Where to look for LED drivers and network interface handlers */
+char *_plugin_dir = PACKAGE_LIBDIR;
+
+/* Set when committing to the LED drivers asynchronously */
+BOOL _async = FALSE;
+
+/* Set when LEDs are to be left to the kernel where possible */
+BOOL _offload = FALSE;
+
+/* Set in real-time mode, along with the SCHED_FIFO priority to run with (0 to keep
+   our scheduling policy), and the CPUs to run on if restricted */
+BOOL _realtime = FALSE;
+int _rt_prio = 0;
+BOOL _pin_cpus = FALSE;
+cpu_set_t _cpus;
+
+/* Refresh rate of the software PWM engine in Hz (0 if disabled) */
+uint _pwm_hz = 0;
+
+/* Where to serve metrics (NULL if disabled) */
+char *_metrics_addr;
+
+/* Name of the shared memory status page (NULL if disabled) */
+char *_status_name;
+
+/* Configuration file the LED specifications come from (NULL if given on the
+   command line) */
+char *_config_file;
+
+/* The renderer thread, the eventfd the sampler wakes it up with, the timerfd it
+   waits for its deadlines with, the sequence counter of the seqlock guarding the
+   LEDs' published states and the flag telling the renderer to stop (_render_efd
+   is -1 if no renderer is running) */
+pthread_t _renderer;
+int _render_efd = -1, _render_tfd = -1;
+uint _publish_seq;
+BOOL _render_stop = FALSE;
+
 /* Command line arguments */
-const char *_short_opts = "liV";
+const char *_short_opts = "liP:s:r:aoR::A:w:pm:S::c:L:V";
 struct option _long_opts[] =
 {
 	{ "led-drivers",	no_argument,		NULL,	'l' },
 	{ "netif-handlers",	no_argument,		NULL,	'i' },
+	{ "plugin-dir",		required_argument,	NULL,	'P' },
+	{ "sample-interval",	required_argument,	NULL,	's' },
+	{ "render-interval",	required_argument,	NULL,	'r' },
+	{ "async",		no_argument,		NULL,	'a' },
+	{ "offload",		no_argument,		NULL,	'o' },
+	{ "realtime",		optional_argument,	NULL,	'R' },
+	{ "affinity",		required_argument,	NULL,	'A' },
+	{ "pwm",		required_argument,	NULL,	'w' },
+	{ "profile",		no_argument,		NULL,	'p' },
+	{ "metrics",		required_argument,	NULL,	'm' },
+	{ "status",		optional_argument,	NULL,	'S' },
+	{ "config",		required_argument,	NULL,	'c' },
+	{ "log-level",		required_argument,	NULL,	'L' },
 	{ "help",		no_argument,		NULL,	'h' },
 	{ "usage",		no_argument,		NULL,	'h' },
 	{ "version",		no_argument,		NULL,	'V' },
@@ -64,208 +146,130 @@ const char *_help =
         "See the file COPYING or visit http://www.gnu.org/licenses/gpl.html for details.\n\n"
 
         "Usage: %s <options>\n"
-	"       %s <LEDSPEC1> [<LEDSPEC2> ...]\n\n"
+	"       %s <LEDSPEC1> [<LEDSPEC2> ...]\n"
+	"       %s -c <file>\n\n"
 
         "Options:\n"
 	"  -l, --led-drivers         list available LED drivers and their pin names\n"
 	"  -i, --netif-handlers      list available network interface handlers\n"
+	"  -P, --plugin-dir <dir>    load LED drivers and network interface handlers\n"
+	"                            from <dir> (default: %s)\n"
+	"  -s, --sample-interval <ms>\n"
+	"                            examine the network interfaces every <ms>\n"
+	"                            milliseconds (default: %u)\n"
+	"  -r, --render-interval <ms>\n"
+	"                            update the LEDs every <ms> milliseconds, LEDs of\n"
+	"                            busy interfaces toggling each time (default: %u).\n"
+	"                            If this differs from the sample interval, a\n"
+	"                            separate thread updates the LEDs.\n"
+	"  -a, --async               never wait for LED devices: commit through the\n"
+	"                            LED drivers' asynchronous interface or from a\n"
+	"                            thread per port, skipping frames for busy ports\n"
+	"  -o, --offload             leave LEDs to the kernel's netdev LED trigger where\n"
+	"                            the LED driver and the interface handler allow\n"
+	"                            (single-color LEDs only); those need no sampling,\n"
+	"                            but unlike sampled ones they go dark while their\n"
+	"                            interface is down or has no carrier\n"
+	"  -R, --realtime[=<prio>]   lock all memory, keep ticks to exact deadlines and\n"
+	"                            track wakeup latencies; with <prio>, run with that\n"
+	"                            SCHED_FIFO priority (1-99)\n"
+	"  -A, --affinity <cpus>     run on the CPUs listed only (e.g. 1 or 0,2-3)\n"
+	"  -w, --pwm <hz>            dim LEDs according to their interfaces' activity,\n"
+	"                            refreshing the ports <hz> times per second\n"
+	"                            (%u-%u, %u refreshes per PWM period)\n"
+	"  -p, --profile             record tick timings, dumped to stderr on SIGUSR2\n"
+	"  -m, --metrics <addr>      serve interface rates and tick statistics in the\n"
+	"                            Prometheus text format on <addr>, a Unix socket\n"
+	"                            path or [<ip>:]<port> (default ip: 127.0.0.1)\n"
+	"  -S, --status[=<name>]     publish LED states and interface counters in the\n"
+	"                            shared memory object <name> (default: %s)\n"
+	"  -c, --config <file>       read the LED specifications from <file> instead\n"
+	"                            and re-read it on SIGHUP\n"
+	"  -L, --log-level <level>   log messages up to <level>: error, warn, info or\n"
+	"                            debug (default: info)\n"
         "  -V, --version             print version and exit\n\n"
 
 	"<LEDSPEC> is a string of the format\n"
-	" <netifname>['['<netifhandler>']']:<led driver>['['<device>']']:<prim>[,<sec>]\n"
+	" <netifname>['['<netifhandler>']']['@'<ms>]:<led driver>['['<device>']']:<prim>[,<sec>]\n"
 	"where <prim> and optionally <sec> define the pins of the LED driver at which the\n"
-	"(tri-color) LED for <netifname> is connected.\n\n"
+	"(tri-color) LED for <netifname> is connected; pin names may contain colons.\n"
+	"<ms> overrides the sample interval for <netifname>. Interfaces without activity\n"
+	"get examined less and less often, down to once a second, until their LED changes\n"
+	"again.\n\n"
 
 	"Examples:\n"
-	" eth0:parallel:2 ppp0[ppp]:parallel[/dev/parport1]:3,4 eth3:serial[/dev/tty5]:1\n";
+	" eth0@20:parallel:2 ppp0[ppp]:parallel[/dev/parport1]:3,4 eth3@500:serial[/dev/tty5]:1\n"
+	" wan:ledclass:green:wan,amber:wan\n\n"
+
+	"A configuration file lists <LEDSPEC>s separated by whitespace or newlines, '#'\n"
+	"starting a comment that extends to the end of the line. On SIGHUP, LEDs whose\n"
+	"<LEDSPEC> is no longer listed are turned off and released, new ones are set up\n"
+	"and all others keep running undisturbed. If the file cannot be read, the\n"
+	"configuration stays as it is.\n\n"
+
+	"Environment:\n"
+	"  RLEDS_SYSFS_NET           directory the \"generic\" network interface handler\n"
+	"                            looks up interfaces in (default: /sys/class/net)\n";
 
 /* Dynamically created LED management array */
 LED *_leds;
 uint _num_leds;
 
-/* Additionally created array of pointers to LED structures that contains only one LED
-   structure for each PORT handle that was obtained. This is used so we don't call a
-   LED driver's shutdown function for a PORT handle twice.
-
-   An alternative approach would be to keep all PORT handles in a linked list. */
-LED **_ports;
+/* Management structures for each PORT handle that was obtained. Besides holding
+   the frames, this is used so we don't call a LED driver's shutdown function for a
+   PORT handle twice. */
+LEDPORT *_ports;
 uint _num_ports;
 
-/*
-** obj = load_shobj(path, ifstruct_name)
-**
-** Loads a shared object implementing some functionality and returns a pointer to its
-** interface structure.
-**
-** "path" is the complete path to the shared object to be opened.
-**
-** "path" is also used to construct a "canonical name" for a structure which is supposed
-** to exist inside the shared object and which sort of defines the interface to this object
-** (ie. the interface structure). This canonical name is created by removing the directory part
-** and the suffix. For example, "/usr/lib/rleds/ifh_generic.so" becomes "ifh_generic".
-**
-** Returns a pointer to the object's interface structure, NULL if the required structure could
-** not be found and -1 on error, in which case an error message can be found in _errmsg.
-*/
-void *load_shobj(char *path)
-{
-	void *dlobj, *ifstruct;
-	char *ifstruct_name, *p;
-	char *errmsg;
-
-	assert(path);
-
-	/* Attempt to open the specified file as a dynamic library */
-	dlobj = dlopen(path, RTLD_LAZY);
-	if (!dlobj)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "Could not dlopen() \"%s\":\n%s!\n",
-		         path, dlerror());
-		return (void *)-1;
-	}
-
-	/* Create the structure name based on the shared object name */
-	ifstruct_name = basename(strdup(path));
-	p = strstr(ifstruct_name, ".so");
-	if (p)
-		*p = '\0';
-
-	/* Attempt to locate defining structure */
-	dlerror();
-	ifstruct = dlsym(dlobj, ifstruct_name);
-	errmsg = dlerror();
-	if (errmsg)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "dlsym() error in %s\n",
-		         errmsg);
-		return (void *)-1;
-	}
-
-	return ifstruct;
-}
-
-/*
-** leddrvr = load_leddriver(dir, leddriver_name)
-**
-** Attempts to load a LED driver in "dir" by its canonical name, e.g. "parallel"
-** instead of "/foo/bar/drvr_parallel.so".
-**
-** Returns a pointer to the led driver's LEDDRIVER structure or NULL on error, in
-** which case an error message can be found in _errmsg.
-*/
-LEDDRIVER *load_leddriver(char *dir, char *leddriver_name)
-{
-	char *path;
-	size_t len;
-	LEDDRIVER *leddrvr;
-
-	assert(dir && leddriver_name);
-
-	/* Compose full path */
-	len = strlen(dir) + 1 + strlen(LEDDRIVER_PREFIX) + strlen(leddriver_name) + 4;
-	path = malloc(len);
-	if (!path)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "Not enough memory for complete path to LED driver \"%s\"!\n",
-		         leddriver_name);
-		return NULL;
-	}
-	snprintf(path, len, "%s/%s%s.so", dir, LEDDRIVER_PREFIX, leddriver_name);
-
-	/* Attemt to load as shared object */
-	leddrvr = (LEDDRIVER *)load_shobj(path);
-	if (leddrvr == (void *)-1)
-		return NULL;
-	if (!leddrvr)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "\"%s\" misses the defining LEDDRIVER structure!\n",
-		         leddriver_name);
-		return NULL;
-	}
-
-	return leddrvr;
-}
-
-/*
-** netifh = load_netifhandler(dir, ifhandler_name)
-**
-** Attempts to load an network interface handler in "dir" by its canonical name, e.g.
-** "generic" instead of "/foo/bar/netifh_generic.so".
-**
-** Returns a pointer to the network interface handler's NETIFHANDLER structure or NULL
-** on error, in which case an error message can be found in _errmsg.
-*/
-NETIFHANDLER *load_netifhandler(char *dir, char *netifhandler_name)
-{
-	char *path;
-	size_t len;
-	NETIFHANDLER *netifh;
-
-	assert(dir && netifhandler_name);
+/* Finds the port in _ports set up for a LED driver and device */
+PORTINDEX _port_index;
 
-	/* Compose full path */
-	len = strlen(dir) + 1 + strlen(NETIFHANDLER_PREFIX) + strlen(netifhandler_name) + 4;
-	path = malloc(len);
-	if (!path)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "Not enough memory for complete path to network interface handler \"%s\"!\n",
-		         netifhandler_name);
-		return NULL;
-	}
-	snprintf(path, len, "%s/%s%s.so", dir, NETIFHANDLER_PREFIX, netifhandler_name);
-
-	/* Attemt to load as shared object */
-	netifh = (NETIFHANDLER *)load_shobj(path);
-	if (netifh == (void *)-1)
-		return NULL;
-	if (!netifh)
-	{
-		snprintf(_errmsg, sizeof(_errmsg),
-		         "\"%s\" misses the defining NETIFHANDLER structure!\n",
-		         netifhandler_name);
-		return NULL;
-	}
-
-	return netifh;
-}
+/* LEDs grouped by network interface handler */
+NETIFGROUP *_netifgroups;
+uint _num_netifgroups;
 
 /*
-** rc = list_shobjs(dir, name, struct_name, filter_func, print_func)
+** rc = list_shobjs(dir, name, kind, builtins, filter_func, print_func)
 **
 ** Lists all available shared objects in the specified directory of a specific type.
 ** "name" is a representative name for this type of objects in the plural form,
-** "struct_name" is the name of the interface structure type that the shared object
-** must export, "filter_func" is a callback function passed to scandir() and "print_func" is a
-** function that is called to print the details of the shared object.
+** "kind" is the kind of plugin their descriptions must name, "builtins" is the
+** table of those compiled in, which are listed first, "filter_func" is a callback
+** function passed to scandir() and "print_func" is a function that is called to
+** print the details of the shared object. The shared objects are not loaded, their
+** details come from the descriptions they carry.
 **
 ** Returns OK on success and ERR on failure.
 */
 RC list_shobjs(char *dir,
                char *name,
-               char *struct_name,
+               char *kind,
+               const BUILTIN_PLUGIN *builtins,
                int (*filter_func)(const struct dirent *),
-               void (*print_func)(char *, void *))
+               void (*print_func)(char *, PLUGININFO *))
 {
-	int i, count;
-	struct dirent **dirents;
+	const BUILTIN_PLUGIN *builtin;
+	struct dirent **dirents = NULL;
+	int i, count = 0;
 
-	assert(dir && name && struct_name && filter_func && print_func);
+	assert(dir && name && kind && builtins && filter_func && print_func);
 
-	/* Scan the directory */
+#ifdef DYNAMIC_PLUGINS
+	/* Scan the directory, which need not exist if plugins are compiled in */
 	count = scandir(dir, &dirents, filter_func, alphasort);
 	if (count < 0)
 	{
-		fprintf(stderr,
-		        "Could not scandir() \"%s\":\n%s!\n",
-		        dir, strerror(errno));
-		return ERR;
+		if (!builtins->name)
+		{
+			fprintf(stderr,
+			        "Could not scandir() \"%s\":\n%s!\n",
+			        dir, strerror(errno));
+			return ERR;
+		}
+		count = 0;
 	}
-	if (count == 0)
+#endif
+	if (count == 0 && !builtins->name)
 	{
 		fprintf(stdout,
 		        "No %s installed in \"%s\" -- incomplete installation?\n",
@@ -277,13 +281,39 @@ RC list_shobjs(char *dir,
 
 	fprintf(stdout, "Available %s:\n", name);
 
+	/* Process plugins compiled in */
+	for (builtin = builtins; builtin->name; builtin++)
+	{
+		PLUGININFO info;
+
+		if (read_builtin_info(kind, builtin, &info) != OK)
+		{
+			fputs(_errmsg, stderr);
+			continue;
+		}
+
+		print_func(builtin->name, &info);
+		free_plugin_info(&info);
+	}
+
 	/* Process files found */
 	for (i = 0; i < count; i++)
 	{
-		void *ifstruct;
+		PLUGININFO info;
 		char *path;
 		int len;
 
+		/* Plugins compiled in are used instead */
+		for (builtin = builtins; builtin->name; builtin++)
+		{
+			len = strlen(builtin->name);
+			if (strncmp(dirents[i]->d_name, builtin->name, len) == 0 &&
+			    strcmp(dirents[i]->d_name + len, ".so") == 0)
+				break;
+		}
+		if (builtin->name)
+			continue;
+
 		/* Compose full path */
 		len = strlen(dir) + strlen(dirents[i]->d_name) + 2;
 		path = malloc(len);
@@ -296,22 +326,25 @@ RC list_shobjs(char *dir,
 		}
 		snprintf(path, len, "%s/%s", dir, dirents[i]->d_name);
 
-		/* Attemt to load as shared object */
-		ifstruct = load_shobj(path);
-		if (ifstruct == (void *)-1)
+		/* Read its description */
+		if (read_plugin_info(path, &info) != OK)
 		{
 			fputs(_errmsg, stderr);
-			return ERR;
+			free(path);
+			continue;
 		}
-		if (!ifstruct)
+		free(path);
+		if (!info.kind || strcmp(info.kind, kind) != 0)
 		{
 			fprintf(stderr,
-			        "\"%s\": missing %s structure\n",
-			        dirents[i]->d_name, struct_name);
+			        "\"%s\": not a %s\n",
+			        dirents[i]->d_name, kind);
+			free_plugin_info(&info);
 			continue;
 		}
 
-		print_func(dirents[i]->d_name, ifstruct);
+		print_func(dirents[i]->d_name, &info);
+		free_plugin_info(&info);
 	}
 
 	return OK;
@@ -336,20 +369,19 @@ int filter_leddrivers(const struct dirent *dirent)
 ** Print function for list_shobjs() above. Referenced by the list_leddrivers()
 ** macro below.
 */
-void print_leddriver(char *name, void *ifstruct)
+void print_leddriver(char *name, PLUGININFO *info)
 {
-	LEDDRIVER *leddrvr = (LEDDRIVER *)ifstruct;
 	char *leddrvr_name, **pin, *p;
 	char buf[PRINT_INDENT];
 
-	assert(name && ifstruct);
+	assert(name && info);
 
 	/* Compare API versions */
-	if (leddrvr->api_ver != LEDDRIVER_API_VER)
+	if (info->api_ver != LEDDRIVER_API_VER)
 	{
 		fprintf(stderr,
 		        "\"%s\": wrong API version (%d != ours: %d)\n",
-		        name, leddrvr->api_ver, LEDDRIVER_API_VER);
+		        name, info->api_ver, LEDDRIVER_API_VER);
 		return;
 	}
 
@@ -362,20 +394,20 @@ void print_leddriver(char *name, void *ifstruct)
 	/* Print out information */
 	snprintf(buf, PRINT_INDENT,
 	         "- %s (v%s) ",
-	         leddrvr_name, leddrvr->ver);
+	         leddrvr_name, info->ver);
 
 	fprintf(stdout,
-	        "%-*s%s\n",
-	        PRINT_INDENT, buf, leddrvr->desc);
+	        "%-*s%s%s\n",
+	        PRINT_INDENT, buf, info->desc, info->builtin ? " (built in)" : "");
 
 	fprintf(stdout,
 	        "%*cDefault device: \"%s\"\n",
-	        PRINT_INDENT, ' ', leddrvr->def_dev);
+	        PRINT_INDENT, ' ', info->def_dev);
 
 	fprintf(stdout,
 	        "%*cPins:",
 	        PRINT_INDENT, ' ');
-	for (pin = leddrvr->pins; *pin; pin++)
+	for (pin = info->pins; *pin; pin++)
 	{
 		fprintf(stdout, " %s", *pin);
 	}
@@ -400,20 +432,19 @@ int filter_netifhandlers(const struct dirent *dirent)
 ** Print function for list_shobjs() above. Referenced by the list_netifhandlers()
 ** macro below.
 */
-void print_netifhandler(char *name, void *ifstruct)
+void print_netifhandler(char *name, PLUGININFO *info)
 {
-	NETIFHANDLER *netifh = (NETIFHANDLER *)ifstruct;
 	char *netifh_name, *p;
 	char buf[PRINT_INDENT];
 
-	assert(name && ifstruct);
+	assert(name && info);
 
 	/* Compare API versions */
-	if (netifh->api_ver != NETIFHANDLER_API_VER)
+	if (info->api_ver != NETIFHANDLER_API_VER)
 	{
 		fprintf(stderr,
 		        "\"%s\": wrong API version (%d != ours: %d)\n",
-		        name, netifh->api_ver, NETIFHANDLER_API_VER);
+		        name, info->api_ver, NETIFHANDLER_API_VER);
 		return;
 	}
 
@@ -426,23 +457,26 @@ void print_netifhandler(char *name, void *ifstruct)
 	/* Print out information */
 	snprintf(buf, PRINT_INDENT,
 	         "- %s (v%s) ",
-	         netifh_name, netifh->ver);
+	         netifh_name, info->ver);
 
 	fprintf(stdout,
-	        "%-*s%s\n",
-	        PRINT_INDENT, buf, netifh->desc);
+	        "%-*s%s%s\n",
+	        PRINT_INDENT, buf, info->desc, info->builtin ? " (built in)" : "");
 
 	fprintf(stdout,
 	        "%*cTri-color LEDs: %s\n",
-	        PRINT_INDENT, ' ', netifh->tricol_desc);
+	        PRINT_INDENT, ' ', info->tricol_desc);
 }
 
 /*
-** rc = split_ledspec(spec, &if_name, &ifh_name, &leddrvr_name, &device, &prim_pin, &sec_pin);
+** rc = split_ledspec(spec, &if_name, &ifh_name, &leddrvr_name, &device, &prim_pin, &sec_pin,
+**                    &period);
 **
 ** Splits up an LED specification in the format
-**  <interface name>['('<interface handler>')']:<led driver>['('<device>')']:<prim>[,<sec>]
-** returning the components in the supplied pointers.
+**  <netifname>['['<netifhandler>']']['@'<ms>]:<led driver>['['<device>']']:<prim>[,<sec>]
+** returning the components in the supplied pointers, "period" receiving <ms> (0 if
+** not given). Everything after the second colon is taken as the pins, so pin names
+** may contain colons themselves.
 **
 ** Returns OK on success and ERR on failure.
 */
@@ -452,23 +486,39 @@ RC split_ledspec(char *spec,
                  char **leddrvr_name,
                  char **device,
                  char **prim_pin,
-                 char **sec_pin)
+                 char **sec_pin,
+                 uint *period)
 {
-	char *p;
+	unsigned long ms;
+	char *p, *end;
 
-	assert(spec && if_name && ifh_name && leddrvr_name && device && prim_pin && sec_pin);
+	assert(spec && if_name && ifh_name && leddrvr_name && device && prim_pin && sec_pin &&
+	       period);
 
-	/* Chop spec using the double colon */
+	/* Chop spec using the double colon. Pins come last and may contain colons
+	   themselves, as do the names of many LED class devices. */
 	p = strdup(spec);
 	*if_name = strsep(&p, ":");
 	*leddrvr_name = strsep(&p, ":");
-	*prim_pin = strsep(&p, ":");
-	if (p || !*leddrvr_name || !*prim_pin)
+	*prim_pin = p;
+	if (!*leddrvr_name || !*prim_pin)
 	{
 		return ERR;
 	}
 
 	/* Then process the smaller pieces */
+	p = strrchr(*if_name, '@');
+	if (p)
+	{
+		*p++ = '\0';
+		ms = strtoul(p, &end, 10);
+		if (!*p || *end || ms == 0 || ms > MAX_INTERVAL)
+			return ERR;
+		*period = ms;
+	}
+	else
+		*period = 0;
+
 	p = *if_name;
 	*if_name = strsep(&p, "[");
 	if (p)
@@ -495,7 +545,7 @@ RC split_ledspec(char *spec,
 	*sec_pin = *prim_pin;
 	*prim_pin = strsep(sec_pin, ",");
 	if (*sec_pin){
-		if (strpbrk(*sec_pin, ":[],"))
+		if (strpbrk(*sec_pin, "[],"))
 			return ERR;
 	}
 	else
@@ -505,298 +555,2399 @@ RC split_ledspec(char *spec,
 }
 
 /*
-** init(argc, argv);
+** rc = check_ledspec(spec)
 **
-** Initialization routine.
+** Checks whether "spec" is a syntactically valid LED specification.
 **
-** exit() is used here instead of return codes since we not only decide on whether
-** to exit or not but also on the return code.
+** Returns OK if it is and ERR otherwise.
 */
-void init(int argc, char **argv)
+RC check_ledspec(char *spec)
 {
-	int c, opt_idx = 0, i;
-
-	/* Process command line options */
-	while (1)
-	{
-		c = getopt_long(argc, argv, _short_opts, _long_opts, &opt_idx);
-		if (c < 0)
-			break;
+	char *if_name, *ifh_name, *leddrvr_name, *device, *prim_pin, *sec_pin;
+	uint period;
+	RC rc;
 
-		switch (c)
-		{
-			/* -l, --led-drivers */
-			case 'l':
-			{
-				if (list_shobjs(PACKAGE_LIBDIR, "LED drivers", "LEDDRIVER",
-				                filter_leddrivers, print_leddriver) == OK)
-					exit(0);
-				else
-					exit(1);
-			}
-			/* -i, --interface-handlers */
-			case 'i':
-			{
-				if (list_shobjs(PACKAGE_LIBDIR, "network interface handlers", "NETIFHANDLER",
-				                filter_netifhandlers, print_netifhandler) == OK)
-					exit(1);
-				else
-					exit(0);
-			}
-			/* -V, --version */
-			case 'V':
-			{
-				printf(_prgbanner, PACKAGE_STRING);
-				printf("Compiled on %s %s\n", __DATE__, __TIME__);
-				exit(0);
-			}
-			/* --help, --usage */
-			case 'h':
-			{
-				printf(_prgbanner, PACKAGE_NAME, PACKAGE_VERSION);
-				printf(_help, argv[0], argv[0]);
-				exit(0);
-			}
-			/* Unknown option */
-			case '?':
-			{
-				/* getopt_long already printed an error message */
-				fprintf(stderr, "Try \"%s --help\" or \"%s --usage\" for more information.\n",
-				        argv[0], argv[0]);
-				exit(1);
-			}
-		}
-	}
+	assert(spec);
 
-	/* The remaining arguments are assumed to be LED specifications. Check that at least
-	   one such definition was given. */
-	_num_leds = argc-optind;
-	if (_num_leds == 0)
-	{
-		fprintf(stderr, "No LED specifications given on command line!\n");
-		fprintf(stderr, "Try \"%s --help\" or \"%s --usage\" for more information.\n",
-		        argv[0], argv[0]);
-		exit(1);
-	}
+	rc = split_ledspec(spec, &if_name, &ifh_name, &leddrvr_name, &device,
+	                   &prim_pin, &sec_pin, &period);
 
-	/* Allocate memory for LED structures and _ports array. _num_leds is used here
-	   as an initial upper bound for the size of the _ports array. We'll realloc() later. */
-	_leds = calloc(_num_leds, sizeof(LED));
-	_ports = calloc(_num_leds, sizeof(LED *));
-	if (!_leds || !_ports)
-	{
-		fprintf(stderr, "Could not allocate memory for LED structures!\n");
-		exit(1);
-	}
-	_num_ports = 0;
+	/* All components point into a copy of "spec" starting at "if_name" */
+	free(if_name);
 
-	/* Install shutdown routine */
-	atexit(shutdown);	
+	return rc;
+}
 
-	/* Process LED specifications */
-	for (i=0; optind<argc ; optind++, i++)
-	{
-		char *netifh_name, *leddrvr_name;
-		LED *led = &_leds[i];
-		int j;
-		BOOL pins_ok;
+/*
+** rc = read_config(path, &specs, &num_specs)
+**
+** Reads the LED specifications from the configuration file "path". They are
+** separated by whitespace or newlines, a '#' starts a comment extending to the end
+** of the line. The specifications are returned in a newly allocated array, to be
+** freed with free_config().
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC read_config(char *path, char ***specs, uint *num_specs)
+{
+	char line[MAX_CONFIG_LINE], *p, *spec, *saveptr, **list = NULL;
+	uint num = 0, line_no = 0;
+	FILE *f;
 
-		/* Split up LED specification */
-		if (split_ledspec(argv[optind],
-		                  &led->netif_name, &netifh_name,
-		                  &leddrvr_name, &led->device_name,
-		                  &led->prim_pin, &led->sec_pin) != OK)
-		{
-			fprintf(stderr,
-			        "Invalid LED specification \"%s\"!\n",
-			        argv[optind]);
-			fprintf(stderr,
-			        "Try \"%s --help\" or \"%s --usage\" for more information.\n",
-			        argv[0], argv[0]);
-			exit(1);
-		}
+	assert(path && specs && num_specs);
 
-		/* Use default name for network interface handler, if necessary */
-		if (!netifh_name)
-			netifh_name = DEFAULT_NETIFH;
+	f = fopen(path, "re");
+	if (!f)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not open configuration file \"%s\":\n%s!\n",
+		         path, strerror(errno));
+		return ERR;
+	}
 
-		/* Load specified network interface handler */
-		led->netifh = load_netifhandler(PACKAGE_LIBDIR, netifh_name);
-		if (!led->netifh)
-		{
-			fputs(_errmsg, stderr);
-			exit(1);
-		}
+	while (fgets(line, sizeof(line), f))
+	{
+		line_no++;
 
-		/* ...and initialize it */
-		led->netif = led->netifh->init(led->netif_name);
-		if (!led->netif)
+		if (!strchr(line, '\n') && !feof(f))
 		{
-			fputs(led->netifh->errmsg(NULL), stderr);
-			exit(1);
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "%s:%u: Line too long!\n",
+			         path, line_no);
+			goto fail;
 		}
 
-		/* Load specified LED driver */
-		led->leddrvr = load_leddriver(PACKAGE_LIBDIR, leddrvr_name);
-		if (!led->leddrvr)
-		{
-			fputs(_errmsg, stderr);
-			exit(1);
-		}
+		p = strchr(line, '#');
+		if (p)
+			*p = '\0';
 
-		/* Check whether a PORT structure has already been initialized for
-		   this device */
-		for (j = 0; j < i; j++)
+		for (spec = strtok_r(line, " \t\r\n", &saveptr); spec;
+		     spec = strtok_r(NULL, " \t\r\n", &saveptr))
 		{
-			LED *prev_led = &_leds[j];
-
-			if (strcasecmp(led->device_name, prev_led->device_name) == 0)
-				led->port = prev_led->port;
-		}
+			char **tmp;
 
-		/* If not, initialize LED driver for the specified device */
-		if (!led->port)
-		{
-			led->port = led->leddrvr->init(led->device_name);
-			if (led->port)
+			if (check_ledspec(spec) != OK)
 			{
-				_ports[_num_ports] = led;
-				_num_ports++;
+				snprintf(_errmsg, sizeof(_errmsg),
+				         "%s:%u: Invalid LED specification \"%s\"!\n",
+				         path, line_no, spec);
+				goto fail;
 			}
-		}
-		if (!led->port)
-		{
-			fputs(led->leddrvr->errmsg(NULL), stderr);
-			exit(1);
-		}
 
-		/* Try to allocate specified pins */
-		pins_ok = FALSE;
-		if (led->leddrvr->alloc(led->port, led->prim_pin) == OK)
-		{
-			if (led->sec_pin)
+			tmp = realloc(list, (num + 1) * sizeof(char *));
+			if (!tmp || !(tmp[num] = strdup(spec)))
 			{
-				if (led->leddrvr->alloc(led->port, led->sec_pin) == OK)
-					pins_ok = TRUE;
+				if (tmp)
+					list = tmp;
+				snprintf(_errmsg, sizeof(_errmsg),
+				         "Could not allocate memory for configuration file \"%s\"!\n",
+				         path);
+				goto fail;
 			}
-			else
-				pins_ok = TRUE;
-		}
-		if (!pins_ok)
-		{
-			fprintf(stderr,
-			        "Error in LED specification \"%s\": %s!\n",
-			        argv[optind], led->leddrvr->errmsg(led->port));
-			exit(1);
+			list = tmp;
+			num++;
 		}
-
-		/* Finally, complete LED structure initialization */
-		led->ledstate = LEDSTATE_OFF;
 	}
+	if (ferror(f))
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not read configuration file \"%s\"!\n",
+		         path);
+		goto fail;
+	}
+	if (num == 0)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "No LED specifications found in configuration file \"%s\"!\n",
+		         path);
+		goto fail;
+	}
+	fclose(f);
+
+	*specs = list;
+	*num_specs = num;
+	return OK;
 
-	/* Install signal handler */
-	signal(SIGHUP, sig_handler);
-	signal(SIGINT, sig_handler);
-	signal(SIGABRT, sig_handler);
-	signal(SIGTERM, sig_handler);
-	signal(SIGUSR1, sig_handler);
-	signal(SIGUSR2, sig_handler);
+fail:
+	fclose(f);
+	free_config(list, num);
+	return ERR;
 }
 
 /*
-** Shutdown function.
+** free_config(specs, num_specs)
+**
+** Frees the "num_specs" LED specifications in "specs" as returned by read_config().
 */
-void shutdown(void)
+void free_config(char **specs, uint num_specs)
 {
 	int i;
 
-	/* Shutdown interface handlers and LED drivers */
-	for (i = 0; i < _num_ports; i++)
+	for (i = 0; i < num_specs; i++)
+		free(specs[i]);
+	free(specs);
+}
+
+/*
+** rc = index_ports()
+**
+** Rebuilds _port_index from the _ports array, eg. after its entries moved.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC index_ports(void)
+{
+	int i;
+
+	if (portindex_init(&_port_index, _num_ports) != OK)
 	{
-		LED *led = _ports[i];
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for port structures!\n");
+		return ERR;
+	}
 
-		(void)_leds[i].leddrvr->reset(_leds[i].port);
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
 
-		led->netifh->shutdown(led->netif);
-		led->leddrvr->shutdown(led->port);
+		if (ledport->device_name &&
+		    portindex_add(&_port_index, ledport->leddrvr, ledport->device_name,
+		                  ledport) != OK)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for port structures!\n");
+			return ERR;
+		}
 	}
+
+	return OK;
 }
 
 /*
-** sig_handler(sig)
+** rc = setup_led(led, spec)
+**
+** Sets up "led" according to the LED specification "spec": loads its network
+** interface handler and LED driver, initializes them and allocates its pins. Ports
+** not in use yet are added to the _ports array, which must have room for them, and
+** to _port_index. If anything fails, "led" is left released.
 **
-** Signal handler for all signals. Turns off all LEDs and instructs the main
-** routine to shut down.
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
 */
-void sig_handler(int sig)
+RC setup_led(LED *led, char *spec)
 {
-	_shutdown = 1;
-	signal(sig, sig_handler);
-}
+	assert(led && spec);
+
+	memset(led, 0, sizeof(LED));
+	led->prim_pinh = led->sec_pinh = ERR;
+
+	/* Split up LED specification */
+	led->spec = strdup(spec);
+	if (!led->spec ||
+	    split_ledspec(spec,
+	                  &led->netif_name, &led->netifh_name,
+	                  &led->leddrvr_name, &led->device_name,
+	                  &led->prim_pin, &led->sec_pin, &led->period) != OK)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Invalid LED specification \"%s\"!\n",
+		         spec);
+		release_led(led);
+		return ERR;
+	}
 
+	led->lit_state = LEDSTATE_PRIM;
+	led->brightness = BRIGHTNESS_MAX;
+	if (!led->period)
+		led->period = _sample_interval / 1000;
 
-/*
-** Main routine.
+	/* Use default name for network interface handler, if necessary */
+	if (!led->netifh_name)
+		led->netifh_name = DEFAULT_NETIFH;
+
+	/* Load specified network interface handler */
+	led->netifh = load_netifhandler(_plugin_dir, led->netifh_name);
+	if (!led->netifh)
+	{
+		release_led(led);
+		return ERR;
+	}
+
+	/* ...and initialize it */
+	led->netif = led->netifh->init(led->netif_name);
+	if (!led->netif)
+	{
+		snprintf(_errmsg, sizeof(_errmsg), "%s", led->netifh->errmsg(NULL));
+		release_led(led);
+		return ERR;
+	}
+
+	/* Load specified LED driver */
+	led->leddrvr = load_leddriver(_plugin_dir, led->leddrvr_name);
+	if (!led->leddrvr)
+	{
+		release_led(led);
+		return ERR;
+	}
+
+	/* Use the LED driver's default device, if necessary */
+	if (!led->device_name)
+		led->device_name = led->leddrvr->def_dev;
+
+	/* Check whether a PORT structure has already been initialized for
+	   this device */
+	led->ledport = portindex_find(&_port_index, led->leddrvr, led->device_name);
+	if (led->ledport)
+		led->port = led->ledport->port;
+
+	/* If not, initialize LED driver for the specified device */
+	if (!led->port)
+	{
+		LEDPORT *ledport = &_ports[_num_ports];
+
+		led->port = led->leddrvr->init(led->device_name);
+		if (!led->port)
+		{
+			snprintf(_errmsg, sizeof(_errmsg), "%s", led->leddrvr->errmsg(NULL));
+			release_led(led);
+			return ERR;
+		}
+
+		/* The port keeps its own copies of the names, as LEDs come and go */
+		led->ledport = ledport;
+		ledport->device_name = strdup(led->device_name);
+		ledport->leddrvr_name = strdup(led->leddrvr_name);
+		ledport->leddrvr = led->leddrvr;
+		ledport->port = led->port;
+		_num_ports++;
+		if (!ledport->device_name || !ledport->leddrvr_name ||
+		    portindex_add(&_port_index, led->leddrvr, ledport->device_name,
+		                  ledport) != OK)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for port structures!\n");
+			release_led(led);
+			return ERR;
+		}
+	}
+
+	/* Try to allocate specified pins */
+	led->prim_pinh = led->leddrvr->alloc(led->port, led->prim_pin, &led->prim_bit);
+	if (led->prim_pinh >= 0 && led->sec_pin)
+		led->sec_pinh = led->leddrvr->alloc(led->port, led->sec_pin, &led->sec_bit);
+	if (led->prim_pinh < 0 || (led->sec_pin && led->sec_pinh < 0))
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Error in LED specification \"%s\": %s!\n",
+		         spec, led->leddrvr->errmsg(led->port));
+		release_led(led);
+		return ERR;
+	}
+
+	/* Finally, complete LED structure initialization */
+	led->ledstate = LEDSTATE_OFF;
+
+	return OK;
+}
+
+/*
+** release_led(led)
+**
+** Releases everything set up for "led" by setup_led(): gives its pins back to the
+** LED driver, if it supports this, and shuts down its NETIF handle. The pins must
+** have been turned off already. Its port stays initialized, even if no other LED
+** uses it.
+*/
+void release_led(LED *led)
+{
+	assert(led);
+
+	if (led->port && led->leddrvr->release)
+	{
+		if (led->prim_pinh >= 0)
+			(void)led->leddrvr->release(led->port, led->prim_pinh);
+		if (led->sec_pinh >= 0)
+			(void)led->leddrvr->release(led->port, led->sec_pinh);
+	}
+
+	if (led->netif)
+		led->netifh->shutdown(led->netif);
+
+	/* All names point into a copy of the specification starting at "netif_name" */
+	free(led->netif_name);
+	free(led->spec);
+
+	memset(led, 0, sizeof(LED));
+}
+
+/*
+** rc = setup_netifgroups();
+**
+** Groups the configured LEDs by their network interface handlers in the
+** _netifgroups array, replacing the groups set up before, if any.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_netifgroups(void)
+{
+	NETIFGROUP *old_groups = _netifgroups;
+	uint num_old_groups = _num_netifgroups;
+	int i, j;
+
+	/* There can't be more groups than LEDs */
+	_netifgroups = calloc(_num_leds, sizeof(NETIFGROUP));
+	if (!_netifgroups)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for network interface handler groups!\n");
+		return ERR;
+	}
+	_num_netifgroups = 0;
+
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		NETIFGROUP *group;
+
+		/* Offloaded LEDs are never sampled */
+		if (led->offloaded)
+			continue;
+
+		/* Find the group for this LED's handler... */
+		for (j = 0; j < _num_netifgroups; j++)
+		{
+			if (_netifgroups[j].netifh == led->netifh)
+				break;
+		}
+		group = &_netifgroups[j];
+
+		/* ...or start a new one */
+		if (j == _num_netifgroups)
+		{
+			group->netifh = led->netifh;
+			group->leds = calloc(_num_leds, sizeof(LED *));
+			group->due = calloc(_num_leds, sizeof(LED *));
+			group->netifs = calloc(_num_leds, sizeof(NETIF *));
+			group->ledstates = calloc(_num_leds, sizeof(LEDSTATE *));
+			if (!group->leds || !group->due || !group->netifs || !group->ledstates)
+			{
+				snprintf(_errmsg, sizeof(_errmsg),
+				         "Could not allocate memory for network interface handler groups!\n");
+				return ERR;
+			}
+			_num_netifgroups++;
+		}
+
+		group->leds[group->num_leds++] = led;
+		led->netifgroup = group;
+	}
+
+	/* When reloading, groups of handlers still in use keep their histograms */
+	for (i = 0; i < num_old_groups; i++)
+	{
+		NETIFGROUP *old = &old_groups[i];
+
+		for (j = 0; j < _num_netifgroups; j++)
+		{
+			if (_netifgroups[j].netifh == old->netifh)
+				_netifgroups[j].col_hist = old->col_hist;
+		}
+		free(old->leds);
+		free(old->due);
+		free(old->netifs);
+		free(old->ledstates);
+	}
+	free(old_groups);
+
+	return OK;
+}
+
+/*
+** rc = setup_ports();
+**
+** Fills in the list of LEDs connected to each port in the _ports array,
+** allocates the frames and commits the current one.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_ports(void)
+{
+	uint *max_bits;
+	int i;
+
+	/* Find out how many LEDs are connected to each port and how large its frame
+	   must be to hold the bit positions the LED driver gave their pins */
+	max_bits = calloc(_num_ports, sizeof(uint));
+	if (!max_bits)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for port structures!\n");
+		return ERR;
+	}
+	for (i = 0; i < _num_ports; i++)
+		_ports[i].num_leds = 0;
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		uint *max_bit = &max_bits[led->ledport - _ports];
+
+		if (led->prim_bit >= *max_bit)
+			*max_bit = led->prim_bit + 1;
+		if (led->sec_pin && led->sec_bit >= *max_bit)
+			*max_bit = led->sec_bit + 1;
+
+		/* Offloaded LEDs' pins are no longer ours */
+		if (!led->offloaded)
+			led->ledport->num_leds++;
+	}
+
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+		uint words;
+		uint64_t *shadow;
+
+		if (!ledport->shadow)
+			ledport->commit_fd = ledport->polled_fd = -1;
+
+		/* The LED driver's init() function turned off all pins, so an empty shadow
+		   matches the hardware's state. When reloading, the shadow is kept. Frames
+		   never shrink, since LED drivers may still cover the bit positions of
+		   pins released. */
+		words = FRAME_WORDS(max_bits[i]);
+		if (words < ledport->frame_words)
+			words = ledport->frame_words;
+		shadow = calloc(words, sizeof(uint64_t));
+		if (shadow && ledport->shadow)
+			memcpy(shadow, ledport->shadow, ledport->frame_words * sizeof(uint64_t));
+		free(ledport->leds);
+		free(ledport->frame);
+		free(ledport->shadow);
+		free(ledport->valid);
+		ledport->frame_words = words;
+		ledport->leds = calloc(ledport->num_leds, sizeof(LED *));
+		ledport->frame = calloc(words, sizeof(uint64_t));
+		ledport->shadow = shadow;
+		ledport->valid = calloc(words, sizeof(uint64_t));
+		if ((ledport->num_leds && !ledport->leds) ||
+		    !ledport->frame || !ledport->shadow || !ledport->valid)
+		{
+			free(max_bits);
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for port structures!\n");
+			return ERR;
+		}
+		ledport->num_leds = 0;
+	}
+	free(max_bits);
+
+	/* Collect the LEDs connected to each port. We control exactly the pins
+	   allocated. */
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		LEDPORT *ledport = led->ledport;
+
+		if (led->offloaded)
+			continue;
+
+		ledport->leds[ledport->num_leds++] = led;
+		FRAME_SET(ledport->valid, led->prim_bit);
+		if (led->sec_pin)
+			FRAME_SET(ledport->valid, led->sec_bit);
+	}
+
+	/* Commit the last frame once, so that LED drivers that take pins over only on
+	   commit() (e.g. gpiochip) do so for pins just allocated, too */
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (!ledport->num_leds)
+			continue;
+
+		memcpy(ledport->frame, ledport->shadow, ledport->frame_words * sizeof(uint64_t));
+		if (ledport->leddrvr->set_frame(ledport->port, ledport->frame, ledport->valid) != OK ||
+		    ledport->leddrvr->commit(ledport->port) != OK)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Error committing pins on \"%s\": %s!\n",
+			         ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+	}
+
+	return OK;
+}
+
+/*
+** rc = setup_async();
+**
+** Prepares the ports for asynchronous commits, starting commit workers for ports
+** whose LED drivers cannot commit asynchronously themselves.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_async(void)
+{
+	int i;
+
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (ledport->leddrvr->submit && ledport->leddrvr->complete)
+			continue;
+
+		ledport->worker = commitworker_start(ledport->leddrvr, ledport->port,
+		                                     ledport->frame_words);
+		if (!ledport->worker)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** rc = setup_pwm();
+**
+** Prepares the ports for the software PWM engine.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_pwm(void)
+{
+	int i;
+
+	for (i = 0; i < _num_ports; i++)
+		if (pwm_setup_port(&_ports[i]) != OK)
+			return ERR;
+
+	return OK;
+}
+
+/*
+** offload_led(led);
+**
+** Hands "led" over to its LED driver's offload() function if its network interface
+** handler can describe its behavior in terms of the kernel's netdev LED trigger.
+** LEDs that cannot be offloaded keep being sampled.
+*/
+void offload_led(LED *led)
+{
+	OFFLOAD offload;
+
+	/* The trigger drives a single pin */
+	if (led->sec_pin || !led->netifh->offload || !led->leddrvr->offload)
+		return;
+
+	memset(&offload, 0, sizeof(offload));
+	if (led->netifh->offload(led->netif, &offload) != OK)
+		return;
+	offload.interval = led->period;
+
+	if (led->leddrvr->offload(led->port, led->prim_pinh, &offload) == OK)
+		led->offloaded = TRUE;
+	else
+		fprintf(stderr, "Sampling interface \"%s\" instead of offloading: %s",
+		        led->netif_name, led->leddrvr->errmsg(led->port));
+}
+
+/*
+** setup_schedule();
+**
+** Schedules every LED's first sample for right now, except for offloaded LEDs.
+** LEDs that were scheduled before (ie. when reloading the configuration) keep
+** their sampling period and next sample.
+*/
+void setup_schedule(void)
+{
+	uint64_t now = clock_ms();
+	int i;
+
+	timerwheel_init(&_wheel, now);
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+
+		if (led->offloaded)
+			continue;
+
+		if (!led->cur_period)
+			led->cur_period = led->period;
+		led->timer.data = led;
+		led->timer.next = NULL;
+		led->timer.pprev = NULL;
+		timerwheel_add(&_wheel, &led->timer,
+		               led->timer.expires > now ? led->timer.expires : now);
+	}
+}
+
+/*
+** rc = setup_profiling();
+**
+** Registers histograms for the time spent in each network interface handler group
+** and on each port that has none yet.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_profiling(void)
+{
+	int i;
+
+	for (i = 0; i < _num_netifgroups; i++)
+	{
+		NETIFGROUP *group = &_netifgroups[i];
+
+		if (group->col_hist)
+			continue;
+
+		group->col_hist = profile_register("ns", "col(%s)", group->leds[0]->netifh_name);
+		if (!group->col_hist)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for profiling!\n");
+			return ERR;
+		}
+	}
+
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (ledport->commit_hist)
+			continue;
+
+		ledport->commit_hist = profile_register("ns", "commit(%s:%s)",
+		                                        ledport->leddrvr_name,
+		                                        ledport->device_name);
+		if (!ledport->commit_hist)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not allocate memory for profiling!\n");
+			return ERR;
+		}
+	}
+
+	return OK;
+}
+
+/*
+** rc = setup_metrics();
+**
+** Starts serving metrics on _metrics_addr and registers the interfaces watched by
+** our LEDs with the rate estimator.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC setup_metrics(void)
+{
+	int i;
+
+	if (metrics_init(_metrics_addr, _epollfd) != OK)
+		return ERR;
+
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+
+		/* Offloaded LEDs' interfaces don't get sampled */
+		if (led->offloaded)
+			continue;
+
+		if (metrics_add_netif(led->netif_name, led->netifh_name,
+		                      led->netifh, led->netif) != OK)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** init(argc, argv);
+**
+** Initialization routine.
+**
+** exit() is used here instead of return codes since we not only decide on whether
+** to exit or not but also on the return code.
+*/
+void init(int argc, char **argv)
+{
+	int c, opt_idx = 0, i;
+	char **specs;
+	sigset_t sigs;
+	struct epoll_event ev;
+
+	log_init();
+
+	/* Process command line options */
+	while (1)
+	{
+		c = getopt_long(argc, argv, _short_opts, _long_opts, &opt_idx);
+		if (c < 0)
+			break;
+
+		switch (c)
+		{
+			/* -l, --led-drivers */
+			case 'l':
+			{
+				if (list_shobjs(_plugin_dir, "LED drivers", "leddriver",
+				                _builtin_leddrivers, filter_leddrivers,
+				                print_leddriver) == OK)
+					exit(0);
+				else
+					exit(1);
+			}
+			/* -i, --interface-handlers */
+			case 'i':
+			{
+				if (list_shobjs(_plugin_dir, "network interface handlers", "netifhandler",
+				                _builtin_netifhandlers, filter_netifhandlers,
+				                print_netifhandler) == OK)
+					exit(1);
+				else
+					exit(0);
+			}
+			/* -P, --plugin-dir */
+			case 'P':
+			{
+				_plugin_dir = optarg;
+				break;
+			}
+			/* -s, --sample-interval, -r, --render-interval */
+			case 's':
+			case 'r':
+			{
+				unsigned long ms;
+				char *end;
+
+				ms = strtoul(optarg, &end, 10);
+				if (*end || ms == 0 || ms > MAX_INTERVAL)
+				{
+					fprintf(stderr, "Invalid interval \"%s\"!\n", optarg);
+					exit(1);
+				}
+
+				if (c == 's')
+					_sample_interval = ms * 1000;
+				else
+					_render_interval = ms * 1000;
+				break;
+			}
+			/* -a, --async */
+			case 'a':
+			{
+				_async = TRUE;
+				break;
+			}
+			/* -o, --offload */
+			case 'o':
+			{
+				_offload = TRUE;
+				break;
+			}
+			/* -R, --realtime */
+			case 'R':
+			{
+				_realtime = TRUE;
+				if (optarg)
+				{
+					char *end;
+
+					_rt_prio = strtol(optarg, &end, 10);
+					if (*end || _rt_prio < sched_get_priority_min(SCHED_FIFO) ||
+					    _rt_prio > sched_get_priority_max(SCHED_FIFO))
+					{
+						fprintf(stderr, "Invalid priority \"%s\"!\n", optarg);
+						exit(1);
+					}
+				}
+				break;
+			}
+			/* -A, --affinity */
+			case 'A':
+			{
+				if (rt_parse_cpus(optarg, &_cpus) != OK)
+				{
+					fprintf(stderr, "Invalid CPU list \"%s\"!\n", optarg);
+					exit(1);
+				}
+				_pin_cpus = TRUE;
+				break;
+			}
+			/* -w, --pwm */
+			case 'w':
+			{
+				unsigned long hz;
+				char *end;
+
+				hz = strtoul(optarg, &end, 10);
+				if (*end || hz < PWM_MIN_HZ || hz > PWM_MAX_HZ)
+				{
+					fprintf(stderr, "Invalid refresh rate \"%s\"!\n", optarg);
+					exit(1);
+				}
+				_pwm_hz = hz;
+				break;
+			}
+			/* -p, --profile */
+			case 'p':
+			{
+				_profiling = TRUE;
+				break;
+			}
+			/* -m, --metrics */
+			case 'm':
+			{
+				_metrics_addr = optarg;
+				break;
+			}
+			/* -S, --status */
+			case 'S':
+			{
+				_status_name = optarg ? optarg : STATUS_DEFAULT_NAME;
+				if (_status_name[0] != '/' || !_status_name[1] ||
+				    strchr(_status_name + 1, '/'))
+				{
+					fprintf(stderr, "Invalid status page name \"%s\"!\n", optarg);
+					exit(1);
+				}
+				break;
+			}
+			/* -c, --config */
+			case 'c':
+			{
+				_config_file = optarg;
+				break;
+			}
+			/* -L, --log-level */
+			case 'L':
+			{
+				if (log_parse_level(optarg, &_log_level) != OK)
+				{
+					fputs(_errmsg, stderr);
+					exit(1);
+				}
+				break;
+			}
+			/* -V, --version */
+			case 'V':
+			{
+				printf(_prgbanner, PACKAGE_STRING);
+				printf("Compiled on %s %s\n", __DATE__, __TIME__);
+				exit(0);
+			}
+			/* --help, --usage */
+			case 'h':
+			{
+				printf(_prgbanner, PACKAGE_NAME, PACKAGE_VERSION);
+				printf(_help, argv[0], argv[0], argv[0], PACKAGE_LIBDIR,
+				       SLEEP_TIME / 1000, SLEEP_TIME / 1000,
+				       PWM_MIN_HZ, PWM_MAX_HZ, PWM_SLOTS, STATUS_DEFAULT_NAME);
+				exit(0);
+			}
+			/* Unknown option */
+			case '?':
+			{
+				/* getopt_long already printed an error message */
+				fprintf(stderr, "Try \"%s --help\" or \"%s --usage\" for more information.\n",
+				        argv[0], argv[0]);
+				exit(1);
+			}
+		}
+	}
+
+	/* The PWM thread is the only one committing to the ports */
+	if (_pwm_hz && _async)
+	{
+		fprintf(stderr, "--pwm and --async cannot be combined!\n");
+		exit(1);
+	}
+
+	/* The remaining arguments are assumed to be LED specifications, unless these
+	   come from a configuration file. Check that at least one such definition was
+	   given. */
+	if (_config_file)
+	{
+		if (optind < argc)
+		{
+			fprintf(stderr, "LED specifications cannot be given both on the command line and in a configuration file!\n");
+			exit(1);
+		}
+		if (read_config(_config_file, &specs, &_num_leds) != OK)
+		{
+			fputs(_errmsg, stderr);
+			exit(1);
+		}
+	}
+	else
+	{
+		specs = &argv[optind];
+		_num_leds = argc - optind;
+	}
+	if (_num_leds == 0)
+	{
+		fprintf(stderr, "No LED specifications given on command line!\n");
+		fprintf(stderr, "Try \"%s --help\" or \"%s --usage\" for more information.\n",
+		        argv[0], argv[0]);
+		exit(1);
+	}
+
+	/* Allocate memory for LED structures and _ports array. _num_leds is used here
+	   as an upper bound for the size of the _ports array. */
+	_leds = calloc(_num_leds, sizeof(LED));
+	_ports = calloc(_num_leds, sizeof(LEDPORT));
+	if (!_leds || !_ports || portindex_init(&_port_index, _num_leds) != OK)
+	{
+		fprintf(stderr, "Could not allocate memory for LED structures!\n");
+		exit(1);
+	}
+	_num_ports = 0;
+
+	/* Install shutdown routine */
+	atexit(shutdown);	
+
+	/* Process LED specifications */
+	for (i = 0; i < _num_leds; i++)
+	{
+		if (check_ledspec(specs[i]) != OK)
+		{
+			fprintf(stderr,
+			        "Invalid LED specification \"%s\"!\n",
+			        specs[i]);
+			fprintf(stderr,
+			        "Try \"%s --help\" or \"%s --usage\" for more information.\n",
+			        argv[0], argv[0]);
+			exit(1);
+		}
+
+		if (setup_led(&_leds[i], specs[i]) != OK)
+		{
+			fputs(_errmsg, stderr);
+			exit(1);
+		}
+	}
+	if (_config_file)
+		free_config(specs, _num_leds);
+
+	if (_offload)
+	{
+		for (i = 0; i < _num_leds; i++)
+			offload_led(&_leds[i]);
+	}
+
+	/* Set up the frames for all ports */
+	if (setup_ports() != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	if (_pwm_hz && setup_pwm() != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	/* Group LEDs by network interface handler */
+	if (setup_netifgroups() != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	if (_profiling && (profile_init() != OK || setup_profiling() != OK))
+	{
+		fprintf(stderr, "Could not allocate memory for profiling!\n");
+		exit(1);
+	}
+
+	/* We handle signals synchronously in the main loop: block them and have them
+	   delivered through a signalfd instead. Signals we inherited as ignored would
+	   never show up there, so restore their default disposition first. */
+	sigemptyset(&sigs);
+	for (i = 0; i < sizeof(_signals) / sizeof(_signals[0]); i++)
+	{
+		signal(_signals[i], SIG_DFL);
+		sigaddset(&sigs, _signals[i]);
+	}
+	if (sigprocmask(SIG_BLOCK, &sigs, NULL) == -1 ||
+	    (_signalfd = signalfd(-1, &sigs, SFD_CLOEXEC)) == -1)
+	{
+		fprintf(stderr, "Could not set up signal handling:\n%s!\n",
+		        strerror(errno));
+		exit(1);
+	}
+
+	/* Set up the timer for our ticks and the epoll instance the main loop waits on */
+	_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (_timerfd == -1 || _epollfd == -1)
+	{
+		fprintf(stderr, "Could not set up main loop:\n%s!\n",
+		        strerror(errno));
+		exit(1);
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = _timerfd;
+	if (epoll_ctl(_epollfd, EPOLL_CTL_ADD, _timerfd, &ev) == -1)
+	{
+		fprintf(stderr, "Could not set up main loop:\n%s!\n",
+		        strerror(errno));
+		exit(1);
+	}
+	ev.data.fd = _signalfd;
+	if (epoll_ctl(_epollfd, EPOLL_CTL_ADD, _signalfd, &ev) == -1)
+	{
+		fprintf(stderr, "Could not set up main loop:\n%s!\n",
+		        strerror(errno));
+		exit(1);
+	}
+
+	if (_metrics_addr && setup_metrics() != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	if (_status_name && status_init(_status_name, _leds, _num_leds) != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	_def_slack = _cur_slack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+	setup_schedule();
+
+	/* Threads inherit our CPU affinity, memory locking and scheduling policy as
+	   well */
+	if ((_pin_cpus && rt_set_affinity(&_cpus) != OK) ||
+	    (_realtime && rt_lock_memory() != OK) ||
+	    (_rt_prio && rt_set_priority(_rt_prio) != OK))
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+
+	/* Threads inherit our signal mask, so start them only now */
+	if (log_start() != OK || start_threads() != OK)
+	{
+		fputs(_errmsg, stderr);
+		exit(1);
+	}
+}
+
+/*
+** rc = start_threads()
+**
+** Starts the threads needed besides the main loop: commit workers, the renderer
+** and the PWM thread, as configured.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC start_threads(void)
+{
+	if (_async && setup_async() != OK)
+		return ERR;
+
+	if (_render_interval != _sample_interval && start_renderer() != OK)
+		return ERR;
+
+	if (_pwm_hz && pwm_start(_ports, _num_ports, _pwm_hz) != OK)
+		return ERR;
+
+	return OK;
+}
+
+/*
+** stop_threads()
+**
+** Stops all threads started by start_threads() and waits for commits in flight,
+** so that the main loop is the only one touching LEDs, ports and LED drivers.
+*/
+void stop_threads(void)
+{
+	int i;
+
+	/* Stop the renderer before it can touch the LED drivers again */
+	if (_render_efd != -1)
+	{
+		uint64_t val = 1;
+
+		__atomic_store_n(&_render_stop, TRUE, __ATOMIC_RELEASE);
+		(void)write(_render_efd, &val, sizeof(val));
+		pthread_join(_renderer, NULL);
+		close(_render_efd);
+		close(_render_tfd);
+		_render_efd = _render_tfd = -1;
+	}
+
+	/* Likewise the PWM thread, which it feeds */
+	pwm_stop();
+
+	/* Let commits in flight finish, dropping frames coalesced meanwhile */
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (ledport->worker)
+		{
+			/* This closes the worker's eventfd, which also takes it out of
+			   _epollfd */
+			commitworker_stop(ledport->worker);
+			ledport->worker = NULL;
+			ledport->commit_fd = ledport->polled_fd = -1;
+		}
+		else if (ledport->commit_fd != -1)
+		{
+			struct pollfd pfd = { ledport->commit_fd, POLLIN, 0 };
+
+			if (poll(&pfd, 1, COMMIT_TIMEOUT) == 1)
+				(void)ledport->leddrvr->complete(ledport->port);
+			ledport->commit_fd = -1;
+		}
+	}
+}
+
+/*
+** rc = reload(specs, num_specs)
+**
+** Switches over to the "num_specs" LED specifications in "specs". LEDs whose
+** specification is among them are kept as they are, along with their port, NETIF
+** handle, counters and schedule. The others' pins are turned off and released, and
+** LEDs for the new specifications are set up. Ports no LED uses anymore are shut
+** down. New LEDs that cannot be set up are skipped with an error message.
+**
+** All threads are stopped while the LEDs change.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg and the program should terminate.
+*/
+RC reload(char **specs, uint num_specs)
+{
+	LED *leds;
+	LEDPORT *ports;
+	int *old_idx, *port_idx;
+	BOOL *kept;
+	uint num_leds = 0, num_ports = 0, num_kept = 0, num_added = 0, num_removed = 0;
+	uint64_t t;
+	int i, j;
+
+	assert(specs && num_specs);
+
+	t = profile_now();
+
+	/* New ports are only needed for new LEDs, so there can't be more ports than
+	   now plus one per specification */
+	leds = calloc(num_specs, sizeof(LED));
+	ports = calloc(_num_ports + num_specs, sizeof(LEDPORT));
+	old_idx = calloc(num_specs, sizeof(int));
+	kept = calloc(_num_leds, sizeof(BOOL));
+	if (!leds || !ports || !old_idx || !kept)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for LED structures!\n");
+		return ERR;
+	}
+
+	/* Find the LEDs to keep. Duplicate specifications each need an LED of their
+	   own. */
+	for (i = 0; i < num_specs; i++)
+	{
+		old_idx[i] = -1;
+		for (j = 0; j < _num_leds; j++)
+		{
+			if (!kept[j] && strcmp(specs[i], _leds[j].spec) == 0)
+			{
+				kept[j] = TRUE;
+				old_idx[i] = j;
+				break;
+			}
+		}
+	}
+
+	stop_threads();
+
+	/* Turn off the pins of the LEDs to be removed */
+	for (i = 0; i < _num_ports; i++)
+		memcpy(_ports[i].frame, _ports[i].shadow, _ports[i].frame_words * sizeof(uint64_t));
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+
+		if (kept[i] || led->offloaded)
+			continue;
+
+		led->ledport->frame[led->prim_bit / 64] &= ~((uint64_t)1 << (led->prim_bit % 64));
+		if (led->sec_pin)
+			led->ledport->frame[led->sec_bit / 64] &= ~((uint64_t)1 << (led->sec_bit % 64));
+	}
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (memcmp(ledport->frame, ledport->shadow,
+		           ledport->frame_words * sizeof(uint64_t)) == 0)
+			continue;
+
+		if (ledport->leddrvr->set_frame(ledport->port, ledport->frame, ledport->valid) != OK ||
+		    ledport->leddrvr->commit(ledport->port) != OK)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Error turning off pins on \"%s\": %s!\n",
+			         ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+		memcpy(ledport->shadow, ledport->frame, ledport->frame_words * sizeof(uint64_t));
+	}
+
+	/* Then release them */
+	for (i = 0; i < _num_leds; i++)
+	{
+		if (kept[i])
+			continue;
+
+		if (_metrics_addr && !_leds[i].offloaded)
+			metrics_del_netif(_leds[i].netif);
+		release_led(&_leds[i]);
+		num_removed++;
+	}
+
+	/* Move the ports and the LEDs kept over to the new arrays */
+	memcpy(ports, _ports, _num_ports * sizeof(LEDPORT));
+	for (i = 0; i < num_specs; i++)
+	{
+		LED *led;
+
+		if (old_idx[i] == -1)
+			continue;
+
+		led = &leds[i];
+		*led = _leds[old_idx[i]];
+		led->ledport = &ports[led->ledport - _ports];
+		num_kept++;
+	}
+	free(_leds);
+	free(_ports);
+	_leds = leds;
+	_ports = ports;
+	if (index_ports() != OK)
+		return ERR;
+
+	/* Set up the new LEDs in their place, skipping those that fail */
+	for (i = 0; i < num_specs; i++)
+	{
+		LED *led = &_leds[num_leds];
+
+		if (old_idx[i] != -1)
+		{
+			if (num_leds != i)
+			{
+				*led = _leds[i];
+				memset(&_leds[i], 0, sizeof(LED));
+			}
+			num_leds++;
+			continue;
+		}
+
+		if (setup_led(led, specs[i]) != OK)
+		{
+			fputs(_errmsg, stderr);
+			continue;
+		}
+		if (_offload)
+			offload_led(led);
+		if (_metrics_addr && !led->offloaded &&
+		    metrics_add_netif(led->netif_name, led->netifh_name,
+		                      led->netifh, led->netif) != OK)
+			return ERR;
+
+		num_leds++;
+		num_added++;
+	}
+	_num_leds = num_leds;
+	free(old_idx);
+	free(kept);
+
+	if (_num_leds == 0)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "No LEDs left to control!\n");
+		return ERR;
+	}
+
+	/* Shut down ports no LED uses anymore, moving the others together.
+	   "port_idx" maps their old to their new positions (-1 if unused). */
+	port_idx = calloc(_num_ports, sizeof(int));
+	if (!port_idx)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not allocate memory for port structures!\n");
+		return ERR;
+	}
+	for (i = 0; i < _num_ports; i++)
+		port_idx[i] = -1;
+	for (i = 0; i < _num_leds; i++)
+		port_idx[_leds[i].ledport - _ports] = 0;
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (port_idx[i] == -1)
+		{
+			(void)ledport->leddrvr->reset(ledport->port);
+			ledport->leddrvr->shutdown(ledport->port);
+			free(ledport->leds);
+			free(ledport->frame);
+			free(ledport->shadow);
+			free(ledport->valid);
+			free(ledport->duty);
+			free(ledport->built_duty);
+			free(ledport->seq);
+			free(ledport->pwm_frame);
+			free(ledport->device_name);
+			free(ledport->leddrvr_name);
+			continue;
+		}
+
+		if (num_ports != i)
+			_ports[num_ports] = *ledport;
+		port_idx[i] = num_ports++;
+	}
+	for (i = 0; i < _num_leds; i++)
+		_leds[i].ledport = &_ports[port_idx[_leds[i].ledport - _ports]];
+	_num_ports = num_ports;
+	free(port_idx);
+
+	/* Rebuild everything derived from the LEDs */
+	if (index_ports() != OK ||
+	    setup_ports() != OK ||
+	    (_pwm_hz && setup_pwm() != OK) ||
+	    setup_netifgroups() != OK ||
+	    (_profiling && setup_profiling() != OK))
+		return ERR;
+
+	/* The status page's records follow the LEDs */
+	if (_status_name && status_reload(_leds, _num_leds) != OK)
+		return ERR;
+
+	setup_schedule();
+
+	if (start_threads() != OK)
+		return ERR;
+
+	LOG(LOGLEVEL_INFO, "Reloaded \"%s\": %u LEDs kept, %u added, %u removed in %.3f ms",
+	    _config_file, num_kept, num_added, num_removed, (profile_now() - t) / 1e6);
+
+	return OK;
+}
+
+/*
+** reload_config()
+**
+** Re-reads _config_file and applies it with reload(). If the file cannot be read,
+** the current configuration stays in effect. If applying it fails, the main loop is
+** told to shut down.
+*/
+void reload_config(void)
+{
+	char **specs;
+	uint num_specs;
+
+	if (read_config(_config_file, &specs, &num_specs) != OK)
+	{
+		fputs(_errmsg, stderr);
+		fprintf(stderr, "Keeping the current configuration.\n");
+		return;
+	}
+
+	if (reload(specs, num_specs) != OK)
+	{
+		fputs(_errmsg, stderr);
+		_shutdown = TRUE;
+	}
+
+	free_config(specs, num_specs);
+}
+
+/*
+** Shutdown function.
+*/
+void shutdown(void)
+{
+	int i;
+
+	if (_metrics_addr)
+		metrics_shutdown();
+	if (_status_name)
+		status_shutdown();
+
+	stop_threads();
+
+	/* Shutdown interface handlers... */
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+
+		if (led->netif)
+			led->netifh->shutdown(led->netif);
+	}
+
+	/* ...and LED drivers */
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		(void)ledport->leddrvr->reset(ledport->port);
+		ledport->leddrvr->shutdown(ledport->port);
+	}
+
+	log_shutdown();
+}
+
+/*
+** now = clock_ms()
+**
+** Returns the current CLOCK_MONOTONIC time in milliseconds.
+*/
+uint64_t clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+** rc = arm_tick(next)
+**
+** Arranges for the main loop's next tick to happen at "next" (CLOCK_MONOTONIC
+** milliseconds, UINT64_MAX for never).
+**
+** Up to _sample_interval ahead, the tick comes from _timerfd, which expires at
+** exactly that time. Further ahead, not much is going on: the timer is disarmed and
+** the tick comes from epoll_wait() timing out instead, which, unlike a timerfd,
+** honors our timer slack. The slack is raised along with the time until the tick so
+** the kernel can coalesce our wakeups with others'. In real-time mode, ticks always
+** come from _timerfd.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC arm_tick(uint64_t next)
+{
+	uint64_t now = clock_ms(), armed_at;
+	struct itimerspec its;
+	unsigned long slack;
+
+	_tick_interval = next > now ? (next - now) * 1000 : 0;
+
+	memset(&its, 0, sizeof(its));
+	if (next == UINT64_MAX)
+	{
+		/* Nothing to sample at all: wait for signals only */
+		_tick_interval = 0;
+		armed_at = 0;
+		_tick_timeout = -1;
+		slack = _def_slack;
+	}
+	else if (_tick_interval <= _sample_interval || _realtime)
+	{
+		its.it_value.tv_sec = next / 1000;
+		its.it_value.tv_nsec = (next % 1000) * 1000000;
+		armed_at = next;
+		_tick_timeout = -1;
+		slack = _def_slack;
+	}
+	else
+	{
+		armed_at = 0;
+		_tick_timeout = next - now;
+		slack = _tick_interval * 1000UL / IDLE_SLACK_DIV;
+	}
+
+	if (armed_at != _armed_at)
+	{
+		if (timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+		{
+			snprintf(_errmsg, sizeof(_errmsg),
+			         "Could not set up tick timer:\n%s!\n",
+			         strerror(errno));
+			return ERR;
+		}
+		_armed_at = armed_at;
+	}
+
+	/* Failing to adjust the slack merely costs some power */
+	if (slack != _cur_slack)
+	{
+		(void)prctl(PR_SET_TIMERSLACK, slack, 0, 0, 0);
+		_cur_slack = slack;
+	}
+
+	return OK;
+}
+
+/*
+** rc = sample(due, now, &overruns)
+**
+** Lets the network interface handlers examine the interfaces of the LEDs whose
+** timers are in the list "due", expired at "now", to determine the LEDs' states.
+** Then schedules their next samples. "overruns" receives the largest number of
+** samples skipped for any of these LEDs because we were late.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC sample(TIMER *due, uint64_t now, uint64_t *overruns)
+{
+	uint64_t t = 0;
+	TIMER *timer;
+	int i;
+
+	/* Sort the LEDs due into their groups */
+	for (i = 0; i < _num_netifgroups; i++)
+		_netifgroups[i].num_due = 0;
+
+	for (timer = due; timer; timer = timer->next)
+	{
+		LED *led = timer->data;
+		NETIFGROUP *group = led->netifgroup;
+
+		group->due[group->num_due] = led;
+		group->netifs[group->num_due] = led->netif;
+		group->ledstates[group->num_due] = &led->ledstate;
+		group->num_due++;
+
+		led->prev_state = led->ledstate;
+	}
+
+	/* Let all network interface handlers examine their interfaces */
+	for (i = 0; i < _num_netifgroups; i++)
+	{
+		NETIFGROUP *group = &_netifgroups[i];
+		int j;
+
+		if (!group->num_due)
+			continue;
+
+		if (_profiling)
+			t = profile_now();
+
+		/* Handlers that can examine all their interfaces at once get called only
+		   once */
+		if (group->netifh->col_batch)
+		{
+			LOG(LOGLEVEL_DEBUG, "Examining %u interfaces with \"%s\" at once",
+			    group->num_due, group->due[0]->netifh_name);
+
+			if (group->netifh->col_batch(group->netifs, group->ledstates,
+			                             group->num_due) != OK)
+			{
+				fprintf(stderr,
+				        "Error examining interfaces: %s!\n",
+				        group->netifh->errmsg(NULL));
+				return ERR;
+			}
+
+			if (_profiling)
+				hist_add(group->col_hist, profile_now() - t);
+			continue;
+		}
+
+		for (j = 0; j < group->num_due; j++)
+		{
+			LED *led = group->due[j];
+
+			LOG(LOGLEVEL_DEBUG, "Examining interface \"%s\" (netif %p, ledstate %p)",
+			    led->netif_name, led->netif, &led->ledstate);
+
+			/* Call this LED's interface handler's LED color function */
+			if (led->netifh->col(led->netif, &led->ledstate) != OK)
+			{
+				fprintf(stderr,
+				        "Error examining interface \"%s\": %s!\n",
+				        led->netif_name, led->netifh->errmsg(led->netif));
+				return ERR;
+			}
+		}
+
+		if (_profiling)
+			hist_add(group->col_hist, profile_now() - t);
+	}
+
+	/* Schedule the next samples */
+	*overruns = 0;
+	for (i = 0; i < _num_netifgroups; i++)
+	{
+		NETIFGROUP *group = &_netifgroups[i];
+		int j;
+
+		for (j = 0; j < group->num_due; j++)
+		{
+			LED *led = group->due[j];
+			uint max_period = MAX_SLEEP_TIME / 1000;
+			uint64_t missed;
+
+			/* Dimmed LEDs follow their interfaces' activity */
+			if (_pwm_hz && led->netifh->brightness)
+			{
+				uint brightness;
+
+				if (led->netifh->brightness(led->netif, &brightness) != OK)
+				{
+					fprintf(stderr,
+					        "Error examining interface \"%s\": %s!\n",
+					        led->netif_name, led->netifh->errmsg(led->netif));
+					return ERR;
+				}
+				led->brightness = brightness < BRIGHTNESS_MAX ? brightness : BRIGHTNESS_MAX;
+			}
+
+			missed = (now - led->timer.expires) / led->cur_period;
+			if (missed > *overruns)
+				*overruns = missed;
+
+			/* Back to the period configured on the first change, stretch it
+			   out while nothing happens */
+			led->active = led->ledstate != led->prev_state;
+			if (max_period < led->period)
+				max_period = led->period;
+			if (led->active)
+			{
+				led->cur_period = led->period;
+				led->idle_samples = 0;
+			}
+			else if (++led->idle_samples >= IDLE_TICKS && led->cur_period < max_period)
+			{
+				led->cur_period = led->cur_period * 2 < max_period ?
+				                  led->cur_period * 2 : max_period;
+				led->idle_samples = 0;
+			}
+
+			/* Samples are due at multiples of the period, so that LEDs with the
+			   same period get sampled in the same tick */
+			timerwheel_add(&_wheel, &led->timer,
+			               (now / led->cur_period + 1) * led->cur_period);
+		}
+	}
+
+	return OK;
+}
+
+/*
+** update_status(now)
+**
+** Updates the status page records of the LEDs sampled in the current tick, which
+** happened at "now" (CLOCK_MONOTONIC nanoseconds).
+*/
+void update_status(uint64_t now)
+{
+	int i, j;
+
+	for (i = 0; i < _num_netifgroups; i++)
+	{
+		NETIFGROUP *group = &_netifgroups[i];
+
+		for (j = 0; j < group->num_due; j++)
+		{
+			LED *led = group->due[j];
+			NETIFSTATS stats;
+			BOOL have_stats;
+
+			have_stats = led->netifh->stats && led->netifh->stats(led->netif, &stats) == OK;
+			status_update(led - _leds, led->ledstate, have_stats ? &stats : NULL, now);
+		}
+	}
+
+	status_tick(now);
+}
+
+/*
+** rc = submit_port(ledport)
+**
+** Starts committing the frame of "ledport" asynchronously.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC submit_port(LEDPORT *ledport)
+{
+	int fd;
+
+	if (_profiling)
+		ledport->submitted = profile_now();
+
+	if (ledport->worker)
+		fd = commitworker_submit(ledport->worker, ledport->frame, ledport->valid);
+	else
+	{
+		if (ledport->leddrvr->set_frame(ledport->port, ledport->frame, ledport->valid) != OK)
+		{
+			fprintf(stderr,
+			        "Error enabling pins on \"%s\": %s!\n",
+			        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+
+		fd = ledport->leddrvr->submit(ledport->port);
+		if (fd == ERR)
+		{
+			fprintf(stderr,
+			        "Error committing pins on \"%s\": %s!\n",
+			        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+	}
+
+	ledport->commit_fd = fd;
+	memcpy(ledport->shadow, ledport->frame, ledport->frame_words * sizeof(uint64_t));
+
+	/* Without a renderer thread, the main loop waits for the completion along with
+	   everything else */
+	if (_render_efd == -1 && fd != ledport->polled_fd)
+	{
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if (ledport->polled_fd != -1)
+			(void)epoll_ctl(_epollfd, EPOLL_CTL_DEL, ledport->polled_fd, NULL);
+		if (epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+		{
+			fprintf(stderr, "Could not wait for commit on \"%s\":\n%s!\n",
+			        ledport->device_name, strerror(errno));
+			return ERR;
+		}
+		ledport->polled_fd = fd;
+	}
+
+	return OK;
+}
+
+/*
+** rc = complete_port(ledport)
+**
+** Finishes the commit in flight on "ledport" once its file descriptor became
+** readable. If the port's frame changed meanwhile, it is submitted right away.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC complete_port(LEDPORT *ledport)
+{
+	RC rc;
+
+	if (ledport->worker)
+		rc = commitworker_complete(ledport->worker);
+	else
+		rc = ledport->leddrvr->complete(ledport->port);
+	ledport->commit_fd = -1;
+
+	if (rc != OK)
+	{
+		fprintf(stderr,
+		        "Error committing pins on \"%s\": %s!\n",
+		        ledport->device_name,
+		        ledport->worker ? ledport->worker->errmsg
+		                        : ledport->leddrvr->errmsg(ledport->port));
+		return ERR;
+	}
+
+	if (_profiling)
+		hist_add(ledport->commit_hist, profile_now() - ledport->submitted);
+
+	if (memcmp(ledport->frame, ledport->shadow,
+	           ledport->frame_words * sizeof(uint64_t)) != 0)
+		return submit_port(ledport);
+
+	return OK;
+}
+
+/*
+** rc = reap_commits(timeout, extra_fd, &extra_ready)
+**
+** Waits up to "timeout" milliseconds (-1: indefinitely, 0: not at all) for commits
+** in flight to finish and completes those that did. "extra_fd", if not -1, is
+** waited for as well, "extra_ready" being set if it became readable.
+**
+** Returns OK on success and ERR on failure.
 */
-int main(int argc, char **argv)
+RC reap_commits(int timeout, int extra_fd, BOOL *extra_ready)
+{
+	struct pollfd pfds[_num_ports + 1];
+	LEDPORT *ledports[_num_ports + 1];
+	int i, n = 0;
+
+	if (extra_ready)
+		*extra_ready = FALSE;
+
+	if (extra_fd != -1)
+	{
+		pfds[n].fd = extra_fd;
+		pfds[n].events = POLLIN;
+		ledports[n++] = NULL;
+	}
+
+	for (i = 0; i < _num_ports; i++)
+	{
+		if (_ports[i].commit_fd == -1)
+			continue;
+
+		pfds[n].fd = _ports[i].commit_fd;
+		pfds[n].events = POLLIN;
+		ledports[n++] = &_ports[i];
+	}
+
+	if (n == 0 || poll(pfds, n, timeout) <= 0)
+		return OK;
+
+	for (i = 0; i < n; i++)
+	{
+		if (!(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+			continue;
+
+		if (!ledports[i])
+			*extra_ready = TRUE;
+		else if (complete_port(ledports[i]) != OK)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** rc = render_pwm(&changed)
+**
+** Passes the LEDs' render states and brightnesses on to the PWM engine as duty
+** cycles of their pins. "changed" is set if any duty cycle changed.
+**
+** Returns OK.
+*/
+RC render_pwm(BOOL *changed)
 {
 	int i;
 
-	/* Initialize */
-	init(argc, argv);
+	for (i = 0; i < _num_ports; i++)
+		memset(_ports[i].duty, 0, _ports[i].frame_words * 64);
 
-	/* Loop until someone presses CTRL-C */
-	while (!_shutdown)
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		uint8_t duty = PWM_DUTY(led->render_brightness);
+
+		if (led->render_state == LEDSTATE_PRIM || led->render_state == LEDSTATE_BOTH)
+			led->ledport->duty[led->prim_bit] = duty;
+		if (led->sec_pin &&
+		    (led->render_state == LEDSTATE_SEC || led->render_state == LEDSTATE_BOTH))
+			led->ledport->duty[led->sec_bit] = duty;
+	}
+
+	for (i = 0; i < _num_ports; i++)
+		if (pwm_update(&_ports[i]))
+			*changed = TRUE;
+
+	return OK;
+}
+
+/*
+** rc = render(&changed)
+**
+** Passes the LEDs' render states on to the LED drivers. "changed" is set if the
+** pins enabled on any port changed.
+**
+** With asynchronous commits, ports still busy with a previous commit are skipped;
+** they get the frame current at the time the commit finishes. With software PWM,
+** the PWM thread commits instead (see render_pwm()).
+**
+** Returns OK on success and ERR on failure.
+*/
+RC render(BOOL *changed)
+{
+	uint64_t t = 0;
+	int i;
+
+	*changed = FALSE;
+
+	if (_async && reap_commits(0, -1, NULL) != OK)
+		return ERR;
+
+	if (_pwm_hz)
+		return render_pwm(changed);
+
+	/* Collect the pins to be enabled on each port in its frame */
+	for (i = 0; i < _num_ports; i++)
+		memset(_ports[i].frame, 0, _ports[i].frame_words * sizeof(uint64_t));
+
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+
+		if (led->render_state == LEDSTATE_PRIM || led->render_state == LEDSTATE_BOTH)
+			FRAME_SET(led->ledport->frame, led->prim_bit);
+		if (led->sec_pin &&
+		    (led->render_state == LEDSTATE_SEC || led->render_state == LEDSTATE_BOTH))
+			FRAME_SET(led->ledport->frame, led->sec_bit);
+	}
+
+	/* Commit each port whose frame differs from the last one committed */
+	for (i = 0; i < _num_ports; i++)
+	{
+		LEDPORT *ledport = &_ports[i];
+
+		if (memcmp(ledport->frame, ledport->shadow,
+		           ledport->frame_words * sizeof(uint64_t)) == 0)
+			continue;
+		*changed = TRUE;
+
+		if (_async)
+		{
+			if (ledport->commit_fd == -1 && submit_port(ledport) != OK)
+				return ERR;
+			continue;
+		}
+
+		if (_profiling)
+			t = profile_now();
+
+		/* Hand the frame to the LED driver... */
+		if (ledport->leddrvr->set_frame(ledport->port, ledport->frame, ledport->valid) != OK)
+		{
+			fprintf(stderr,
+			        "Error enabling pins on \"%s\": %s!\n",
+			        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+
+		/* ...and commit them to the hardware */
+		if (ledport->leddrvr->commit(ledport->port) != OK)
+		{
+			fprintf(stderr,
+			        "Error committing pins on \"%s\": %s!\n",
+			        ledport->device_name, ledport->leddrvr->errmsg(ledport->port));
+			return ERR;
+		}
+
+		if (_profiling)
+			hist_add(ledport->commit_hist, profile_now() - t);
+
+		memcpy(ledport->shadow, ledport->frame, ledport->frame_words * sizeof(uint64_t));
+	}
+
+	return OK;
+}
+
+/*
+** rc = tick(due, now, &changed, &overruns)
+**
+** Processes the LEDs due when sampling and rendering in lockstep: samples them (see
+** sample()) and renders the LED states. "changed" is set if the pins enabled on any
+** port changed.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC tick(TIMER *due, uint64_t now, BOOL *changed, uint64_t *overruns)
+{
+	int i;
+
+	if (sample(due, now, overruns) != OK)
+		return ERR;
+
+	for (i = 0; i < _num_leds; i++)
+	{
+		_leds[i].render_state = _leds[i].ledstate;
+		_leds[i].render_brightness = _leds[i].brightness;
+	}
+
+	return render(changed);
+}
+
+/*
+** publish(&changed)
+**
+** Hands the LED states determined by the last samples over to the renderer thread,
+** flagging LEDs whose state changed with their last sample with SAMPLE_ACTIVE.
+** "changed" is set if any published state changed, in which case the renderer gets
+** woken up.
+**
+** The states are guarded by a seqlock: we are its only writer and never wait for
+** the renderer, which retries reading if it overlapped with an update.
+*/
+void publish(BOOL *changed)
+{
+	uint seq = _publish_seq;
+	uint64_t val = 1;
+	int i;
+
+	*changed = FALSE;
+
+	__atomic_store_n(&_publish_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		uint8_t published = led->ledstate;
+
+		if (led->active)
+			published |= SAMPLE_ACTIVE;
+
+		if (published != led->published)
+		{
+			__atomic_store_n(&led->published, published, __ATOMIC_RELAXED);
+			*changed = TRUE;
+		}
+		if (led->brightness != led->published_brightness)
+		{
+			__atomic_store_n(&led->published_brightness, led->brightness, __ATOMIC_RELAXED);
+			*changed = TRUE;
+		}
+	}
+
+	__atomic_store_n(&_publish_seq, seq + 2, __ATOMIC_RELEASE);
+
+	if (*changed)
+		(void)write(_render_efd, &val, sizeof(val));
+}
+
+/*
+** active = fetch(phase)
+**
+** Fetches the LED states last published by the sampler and determines the states
+** to render in the blink phase "phase": LEDs with activity alternate between their
+** last lit state and off, all others show their sampled state.
+**
+** Returns TRUE if any LED is blinking.
+*/
+BOOL fetch(uint64_t phase)
+{
+	BOOL active = FALSE;
+	uint seq;
+	int i;
+
+	do
 	{
-		/* Process all LEDs watched */
+		seq = __atomic_load_n(&_publish_seq, __ATOMIC_ACQUIRE);
 		for (i = 0; i < _num_leds; i++)
 		{
-			RC rc = OK;
-			LED *led = &_leds[i];
+			_leds[i].fetched = __atomic_load_n(&_leds[i].published, __ATOMIC_RELAXED);
+			_leds[i].fetched_brightness = __atomic_load_n(&_leds[i].published_brightness,
+			                                              __ATOMIC_RELAXED);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((seq & 1) || seq != __atomic_load_n(&_publish_seq, __ATOMIC_RELAXED));
 
-			fprintf(stderr, "calling led->netifh->col() with led->netif: %p led->ledstate: %p\n",
-			        led->netif, &led->ledstate);
+	for (i = 0; i < _num_leds; i++)
+	{
+		LED *led = &_leds[i];
+		LEDSTATE state = led->fetched & ~SAMPLE_ACTIVE;
 
-			/* Call this LED's interface handler's LED color function */
-			if (led->netifh->col(led->netif, &led->ledstate) != OK)
+		led->render_brightness = led->fetched_brightness;
+		if (state != LEDSTATE_OFF)
+			led->lit_state = state;
+
+		if (led->fetched & SAMPLE_ACTIVE)
+		{
+			led->render_state = (phase & 1) ? LEDSTATE_OFF : led->lit_state;
+			active = TRUE;
+		}
+		else
+			led->render_state = state;
+	}
+
+	return active;
+}
+
+/*
+** rc = render_sleep(next)
+**
+** Sleeps until the CLOCK_MONOTONIC time "next", or less if stop_threads() asks us
+** to stop meanwhile. Wakeups by the sampler are consumed on the way, since fetch()
+** picks up the new states after the deadline anyway.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC render_sleep(const struct timespec *next)
+{
+	struct itimerspec its;
+	struct pollfd pfds[2];
+	uint64_t val;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value = *next;
+	if (timerfd_settime(_render_tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+		return ERR;
+
+	pfds[0].fd = _render_tfd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = _render_efd;
+	pfds[1].events = POLLIN;
+	while (1)
+	{
+		if (poll(pfds, 2, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return ERR;
+		}
+
+		if (pfds[1].revents & POLLIN)
+		{
+			(void)read(_render_efd, &val, sizeof(val));
+			if (__atomic_load_n(&_render_stop, __ATOMIC_ACQUIRE))
+				return OK;
+		}
+		if (pfds[0].revents & POLLIN)
+		{
+			(void)read(_render_tfd, &val, sizeof(val));
+			return OK;
+		}
+	}
+}
+
+/*
+** renderer(arg)
+**
+** Renderer thread: renders the published LED states every _render_interval
+** microseconds, at absolute deadlines so that the blink cadence does not drift
+** with the time spent in the LED drivers. While no LED is blinking, the output
+** cannot change until the sampler publishes new states, so we wait for that.
+*/
+void *renderer(void *arg)
+{
+	struct timespec next, now;
+	uint64_t phase = 0, val, skipped;
+	BOOL active, changed;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (!__atomic_load_n(&_render_stop, __ATOMIC_ACQUIRE))
+	{
+		active = fetch(phase++);
+		if (render(&changed) != OK)
+		{
+			/* Have the main loop shut us down */
+			kill(getpid(), SIGTERM);
+			break;
+		}
+
+		/* Wait for new states, but still complete commits meanwhile */
+		if (!active)
+		{
+			BOOL woken;
+
+			if (reap_commits(-1, _render_efd, &woken) != OK)
 			{
-				fprintf(stderr,
-				        "Error examining interface \"%s\": %s!\n",
-				        _leds[i].netif_name, _leds[i].netifh->errmsg(_leds[i].netif));
-				_shutdown = TRUE;
+				kill(getpid(), SIGTERM);
 				break;
 			}
+			if (woken)
+				(void)read(_render_efd, &val, sizeof(val));
+
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			continue;
+		}
+
+		/* Sleep until the next deadline. If we fell behind, skip the deadlines
+		   missed instead of rushing to catch up. */
+		next.tv_nsec += (long)_render_interval * 1000;
+		next.tv_sec += next.tv_nsec / 1000000000;
+		next.tv_nsec %= 1000000000;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		skipped = 0;
+		if (now.tv_sec > next.tv_sec ||
+		    (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+		{
+			skipped = TS_NS(now) - TS_NS(next);
+			skipped = skipped / ((uint64_t)_render_interval * 1000) + 1;
+			next = now;
+		}
+
+		if (render_sleep(&next) != OK)
+		{
+			kill(getpid(), SIGTERM);
+			break;
+		}
+		if (__atomic_load_n(&_render_stop, __ATOMIC_ACQUIRE))
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		jitter_add(&_render_jitter, TS_NS(now) - TS_NS(next), skipped);
+	}
+
+	return NULL;
+}
+
+/*
+** rc = start_renderer()
+**
+** Starts the renderer thread.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC start_renderer(void)
+{
+	int rc;
+
+	_render_stop = FALSE;
+	_render_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	_render_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (_render_efd == -1 || _render_tfd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set up renderer:\n%s!\n",
+		         strerror(errno));
+		if (_render_efd != -1)
+			close(_render_efd);
+		if (_render_tfd != -1)
+			close(_render_tfd);
+		_render_efd = _render_tfd = -1;
+		return ERR;
+	}
+
+	/* The thread inherits our signal mask, so signals still only arrive through
+	   _signalfd */
+	rc = pthread_create(&_renderer, NULL, renderer, NULL);
+	if (rc != 0)
+	{
+		close(_render_efd);
+		close(_render_tfd);
+		_render_efd = _render_tfd = -1;
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not start renderer thread:\n%s!\n",
+		         strerror(rc));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** Main routine.
+*/
+int main(int argc, char **argv)
+{
+	/* Initialize */
+	init(argc, argv);
+
+	/* Loop until someone presses CTRL-C */
+	while (!_shutdown)
+	{
+		struct epoll_event events[MAX_EVENTS];
+		int i, n;
+		BOOL changed, reloaded = FALSE;
+		uint64_t next, now, now_ns, overruns = 0, t = 0;
+		TIMER *due;
+
+		/* Wait for the next LED to become due or a signal */
+		next = timerwheel_next(&_wheel);
+		if (arm_tick(next) != OK)
+		{
+			fputs(_errmsg, stderr);
+			break;
+		}
+
+		n = epoll_wait(_epollfd, events, MAX_EVENTS, _tick_timeout);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
 
-			fprintf(stderr, ".");
+			fprintf(stderr, "epoll_wait() failed:\n%s!\n", strerror(errno));
+			break;
+		}
 
-			/* Enable LED pins as necessary */
-			if (led->ledstate == LEDSTATE_PRIM || led->ledstate == LEDSTATE_BOTH)
-				rc = led->leddrvr->enable(led->port, led->prim_pin);
-			if (led->sec_pin &&
-			    (led->ledstate == LEDSTATE_SEC || led->ledstate == LEDSTATE_BOTH))
-				rc |= led->leddrvr->enable(led->port, led->sec_pin);
-			if (rc != OK)
+		for (i = 0; i < n; i++)
+		{
+			if (events[i].data.fd == _timerfd)
 			{
-				fprintf(stderr,
-				        "Error enabling pins on \"%s\": %s!\n",
-				        led->device_name, led->leddrvr->errmsg(_leds[i].port));
-				_shutdown = TRUE;
-				break;
+				uint64_t expirations;
+
+				(void)read(_timerfd, &expirations, sizeof(expirations));
+			}
+			else if (events[i].data.fd == _signalfd)
+			{
+				struct signalfd_siginfo si;
+
+				if (read(_signalfd, &si, sizeof(si)) != sizeof(si))
+					continue;
+
+				/* SIGUSR2 asks for the profile and wakeup statistics,
+				   SIGHUP for re-reading the configuration file, if any,
+				   all other signals for termination */
+				if (si.ssi_signo == SIGHUP && _config_file)
+				{
+					reload_config();
+					reloaded = TRUE;
+				}
+				else if (si.ssi_signo != SIGUSR2)
+					_shutdown = TRUE;
+				else if (_profiling || _realtime)
+				{
+					if (_profiling)
+						profile_dump(stderr);
+					if (_realtime)
+						rt_dump(stderr);
+				}
+				else
+					fprintf(stderr, "Profiling not enabled (use --profile or --realtime)\n");
+			}
+			else if (!metrics_handle(events[i].data.fd, events[i].events))
+			{
+				/* Must be a commit finishing */
+				if (reap_commits(0, -1, NULL) != OK)
+					_shutdown = TRUE;
 			}
 		}
+		/* After a reload, the schedule starts over */
+		if (_shutdown || reloaded)
+			continue;
 
-		/* Walk over another time, this time committing the changes
-		   to the LED drivers */
-		for (i = 0; i < _num_leds; i++)
-		{
-			LED *led = &_leds[i];
+		/* Other events may have woken us up early */
+		now_ns = profile_now();
+		now = now_ns / 1000000;
+		if (now < next)
+			continue;
+		due = timerwheel_advance(&_wheel, now);
 
-			if (led->leddrvr->commit(led->port) != OK)
-				_shutdown = TRUE;
+		if (_profiling)
+			profile_tick_start();
+		if (_metrics_addr)
+			t = profile_now();
+
+		/* Either hand the samples over to the renderer thread or render them
+		   ourselves */
+		if (_render_efd != -1)
+		{
+			if (sample(due, now, &overruns) != OK)
+				break;
+			publish(&changed);
 		}
+		else if (tick(due, now, &changed, &overruns) != OK)
+			break;
+
+		if (_status_name)
+			update_status(now_ns);
+
+		/* Only ticks from _timerfd had an exact deadline */
+		if (_armed_at == next)
+			jitter_add(&_tick_jitter, now_ns - next * 1000000, overruns);
 
-		/* Sleep for a while */
-		usleep(SLEEP_TIME);
+		if (_profiling)
+			profile_tick_end(_sample_interval, overruns);
+		if (_metrics_addr)
+			metrics_tick(profile_now() - t, _tick_interval, changed, overruns);
 	}
 
 	return 0;
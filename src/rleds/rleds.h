@@ -20,12 +20,24 @@
 #include "../../config.h"
 #endif
 
+#include <stdint.h>
+#include <dirent.h>
+#include <time.h>
+
 #include "../common/base.h"
 #include "../common/netifhandlers.h"
 #include "../common/leddrivers.h"
 
-/* Maximum length of buffer for error messages */
-#define MAX_ERRMSG_LEN (PATH_MAX + 100)
+#include "plugins.h"
+#include "profile.h"
+#include "metrics.h"
+#include "commitworker.h"
+#include "timerwheel.h"
+#include "realtime.h"
+#include "pwm.h"
+#include "statuspage.h"
+#include "portindex.h"
+#include "log.h"
 
 /* Number of characters for indent in print_*() functions */
 #define PRINT_INDENT 20
@@ -33,50 +45,205 @@
 /* Name of the default network interface handler */
 #define DEFAULT_NETIFH "generic"
 
-/* Number of microseconds to sleep between each call to the power control
- functions (ie. minimum time a LED will light resp. stay off) */
+/* Default number of microseconds between two samples of the network interfaces resp.
+   two updates of the LEDs (ie. minimum time a LED will light resp. stay off) */
 #define SLEEP_TIME 25000
 
+/* Maximum sample resp. render interval accepted on the command line, in
+   milliseconds */
+#define MAX_INTERVAL 60000
+
+/* Maximum length of a line in the configuration file */
+#define MAX_CONFIG_LINE 1024
+
+/* While a LED does not change its state, its sampling period is doubled every
+   IDLE_TICKS samples up to MAX_SLEEP_TIME microseconds (or the period configured, if
+   longer). The first change brings it back to the period configured. */
+#define IDLE_TICKS 40
+#define MAX_SLEEP_TIME 1000000
+
+/* When the next sample is further ahead than the sample interval, the kernel may
+   delay our wakeup by this fraction of the time until then in order to coalesce it
+   with other timers */
+#define IDLE_SLACK_DIV 8
+
+/* How long to wait for commits in flight on shutdown, in milliseconds */
+#define COMMIT_TIMEOUT 1000
+
+/* Maximum number of events to fetch with a single epoll_wait() call */
+#define MAX_EVENTS 8
+
+/* Flag in a LED's published state: the LED's state changed with the last sample,
+   ie. there was activity on the interface */
+#define SAMPLE_ACTIVE 0x80
+
+/* Manipulation of the bitmasks used for frames */
+#define FRAME_WORDS(bits)	(((bits) + 63) / 64)
+#define FRAME_SET(frame, bit)	((frame)[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define FRAME_ISSET(frame, bit)	((frame)[(bit) / 64] & ((uint64_t)1 << ((bit) % 64)))
+
+/* A struct timespec in nanoseconds */
+#define TS_NS(ts) ((uint64_t)(ts).tv_sec * 1000000000 + (ts).tv_nsec)
+
+typedef struct _ledport LEDPORT;
+typedef struct _netifgroup NETIFGROUP;
+
 /*
 ** Management structure to keep tracks of the configured LEDs. Associates
 ** interface handlers and LED drivers.
 */
 typedef struct _led
 {
+	char		*spec;			/* LED specification this LED was set up from */
 	char		*netif_name;		/* Network interface name */
+	char		*netifh_name;		/* Handler name */
 	NETIFHANDLER	*netifh;		/* Associated handler */
 	NETIF		*netif;			/* Associated NETIF handle */
 	LEDSTATE	ledstate;		/* LED state */
+	BOOL		offloaded;		/* Driven by the kernel, not sampled */
+	NETIFGROUP	*netifgroup;		/* Group of LEDs with the same handler */
+
+	uint		period,			/* Sampling period configured... */
+			cur_period;		/* ...and currently used, in milliseconds */
+	uint		idle_samples;		/* Samples without change at "cur_period" */
+	TIMER		timer;			/* Schedules the next sample */
+	LEDSTATE	prev_state;		/* State before the last sample */
+	BOOL		active;			/* State changed with the last sample */
+	uint8_t		brightness;		/* Brightness as of the last sample (PWM only) */
+
+	/* Decoupled sampling and rendering only */
+	uint8_t		published,		/* Sampled state and SAMPLE_ACTIVE as published by */
+			fetched;		/* the sampler resp. fetched by the renderer */
+	uint8_t		published_brightness,	/* Same for the brightness */
+			fetched_brightness;
+	LEDSTATE	lit_state;		/* State an active LED blinks with */
+
+	LEDSTATE	render_state;		/* State to render... */
+	uint8_t		render_brightness;	/* ...and how bright (PWM only) */
 
 	char		*device_name;		/* Device name */
+	char		*leddrvr_name;		/* LED driver name */
 	LEDDRIVER	*leddrvr;		/* Associated LED driver */
 	PORT		*port;			/* Associated PORT handle */
+	LEDPORT		*ledport;		/* Associated port management structure */
 	char		*prim_pin,		/* Primary LED pin */
 			*sec_pin;		/* Secondary LED pin (may be NULL) */
+	int		prim_pinh,		/* Pin handles as returned by the LED driver */
+			sec_pinh;		/* (ERR if there is no secondary pin) */
+	uint		prim_bit,		/* Positions of the pins in the port's frame */
+			sec_bit;
 } LED;
 
+/*
+** Management structure for the ports LEDs are connected to. Each tick, the pins to be
+** enabled on a port are collected in its frame. The port is committed once per tick,
+** and only if its frame differs from the one committed last (the shadow).
+*/
+struct _ledport
+{
+	char		*device_name;		/* Device name */
+	char		*leddrvr_name;		/* LED driver name */
+	LEDDRIVER	*leddrvr;		/* Associated LED driver */
+	PORT		*port;			/* Associated PORT handle */
+
+	LED		**leds;			/* LEDs connected to this port */
+	uint		num_leds;		/* Number of entries in "leds" */
+
+	uint64_t	*frame,			/* Pins to be enabled during the current tick */
+			*shadow,		/* Pins enabled by the last commit */
+			*valid;			/* Pins allocated by our LEDs */
+	uint		frame_words;		/* Number of words in the masks above */
+
+	HISTOGRAM	*commit_hist;		/* Time spent committing (if profiling) */
+
+	/* Asynchronous commits only */
+	COMMITWORKER	*worker;		/* Commits for drivers without submit() */
+	int		commit_fd,		/* Readable on completion of the commit in
+						   flight (-1 if the port is idle) */
+			polled_fd;		/* Last "commit_fd" registered with _epollfd */
+	uint64_t	submitted;		/* When it was submitted (if profiling) */
+
+	/* Software PWM only */
+	uint8_t		*duty,			/* Duty cycle of each pin as rendered... */
+			*built_duty;		/* ...and as of the sequence built last */
+	uint64_t	*seq,			/* Frames of the PWM_SLOTS slots of a period */
+			*pwm_frame;		/* Frame of the slot being refreshed */
+	uint		seq_gen;		/* Seqlock sequence counter guarding "seq" */
+	BOOL		steady;			/* All pins are fully on or off */
+};
+
+/*
+** Groups all LEDs whose interfaces are watched by the same network interface
+** handler, so that handlers implementing col_batch() can be called once per
+** sampling round for all of them that are due.
+*/
+struct _netifgroup
+{
+	NETIFHANDLER	*netifh;		/* Network interface handler */
+	LED		**leds;			/* LEDs watched by it */
+	uint		num_leds;		/* Number of entries in "leds" */
+
+	LED		**due;			/* LEDs due in the current sampling round, */
+	NETIF		**netifs;		/* their NETIF handles... */
+	LEDSTATE	**ledstates;		/* ...and LED states (for col_batch()) */
+	uint		num_due;		/* Number of entries in the arrays above */
+
+	HISTOGRAM	*col_hist;		/* Time spent examining (if profiling) */
+};
+
 /* Function prototypes */
-void *load_shobj(char *path);
-LEDDRIVER *load_leddriver(char *dir, char *leddriver_name);
-NETIFHANDLER *load_netifhandler(char *dir, char *netifhandler_name);
 RC list_shobjs(char *dir,
                char *name,
-               char *struct_name,
+               char *kind,
+               const BUILTIN_PLUGIN *builtins,
                int (*filter_func)(const struct dirent *),
-               void (*print_func)(char *, void *));
+               void (*print_func)(char *, PLUGININFO *));
 int filter_leddrivers(const struct dirent *dirent);
-void print_leddriver(char *name, void *ifstruct);
+void print_leddriver(char *name, PLUGININFO *info);
 int filter_netifhandlers(const struct dirent *dirent);
-void print_netifhandler(char *name, void *ifstruct);
+void print_netifhandler(char *name, PLUGININFO *info);
 RC split_ledspec(char *spec,
                  char **if_name,
                  char **ifh_name,
                  char **leddrvr_name,
                  char **device,
                  char **prim_pin,
-                 char **sec_pin);
+                 char **sec_pin,
+                 uint *period);
+RC check_ledspec(char *spec);
+RC read_config(char *path, char ***specs, uint *num_specs);
+void free_config(char **specs, uint num_specs);
+RC index_ports(void);
+RC setup_led(LED *led, char *spec);
+void release_led(LED *led);
+RC setup_netifgroups(void);
+RC setup_ports(void);
+RC setup_profiling(void);
+RC setup_metrics(void);
+RC setup_async(void);
+RC setup_pwm(void);
+void offload_led(LED *led);
+void setup_schedule(void);
 void init(int argc, char **argv);
+RC start_threads(void);
+void stop_threads(void);
+RC reload(char **specs, uint num_specs);
+void reload_config(void);
 void shutdown(void);
-void sig_handler(int sig);
+uint64_t clock_ms(void);
+RC arm_tick(uint64_t next);
+RC sample(TIMER *due, uint64_t now, uint64_t *overruns);
+void update_status(uint64_t now);
+RC submit_port(LEDPORT *ledport);
+RC complete_port(LEDPORT *ledport);
+RC reap_commits(int timeout, int extra_fd, BOOL *extra_ready);
+RC render_pwm(BOOL *changed);
+RC render(BOOL *changed);
+RC tick(TIMER *due, uint64_t now, BOOL *changed, uint64_t *overruns);
+void publish(BOOL *changed);
+BOOL fetch(uint64_t phase);
+RC render_sleep(const struct timespec *next);
+void *renderer(void *arg);
+RC start_renderer(void);
 
 #endif /* _RLEDS_H */
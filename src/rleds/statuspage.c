@@ -0,0 +1,221 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Shared memory status page
+**
+** Publishes the LEDs' states and their interfaces' counters in a POSIX shared
+** memory object (see ../common/status.h), which other programs can map and read
+** without ever talking to us. The main loop is the only writer.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/base.h"
+
+#include "rleds.h"
+
+/* Name of the shared memory object (NULL if not created), its mapping and size */
+static char *_status_name;
+static STATUS_HEADER *_status;
+static size_t _status_size;
+
+/*
+** rc = status_init(name, leds, num_leds)
+**
+** Creates the shared memory object "name", replacing any left over by a previous
+** run, and fills in a record for each of the "num_leds" LEDs in "leds".
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC status_init(char *name, LED *leds, uint num_leds)
+{
+	STATUS_RECORD *records;
+	int fd, i;
+
+	assert(name && leds);
+
+	/* Readers must not see records of a previous run, so start with a new
+	   object */
+	(void)shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not create status page \"%s\":\n%s!\n",
+		         name, strerror(errno));
+		return ERR;
+	}
+
+	_status_size = sizeof(STATUS_HEADER) + num_leds * sizeof(STATUS_RECORD);
+	if (ftruncate(fd, _status_size) == -1 ||
+	    (_status = mmap(NULL, _status_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                    fd, 0)) == MAP_FAILED)
+	{
+		snprintf(_errmsg, sizeof(_errmsg),
+		         "Could not set up status page \"%s\":\n%s!\n",
+		         name, strerror(errno));
+		_status = NULL;
+		close(fd);
+		(void)shm_unlink(name);
+		return ERR;
+	}
+	close(fd);
+	_status_name = name;
+
+	/* The object is zero-filled, so only non-zero fields need to be set */
+	_status->version = STATUS_VERSION;
+	_status->header_size = sizeof(STATUS_HEADER);
+	_status->record_size = sizeof(STATUS_RECORD);
+	_status->num_records = num_leds;
+	_status->pid = getpid();
+	_status->started = profile_now();
+
+	records = (STATUS_RECORD *)(_status + 1);
+	for (i = 0; i < num_leds; i++)
+	{
+		STATUS_RECORD *rec = &records[i];
+
+		snprintf(rec->netif_name, sizeof(rec->netif_name), "%s", leds[i].netif_name);
+		snprintf(rec->netifh_name, sizeof(rec->netifh_name), "%s", leds[i].netifh_name);
+		if (leds[i].offloaded)
+			rec->flags = STATUS_OFFLOADED;
+	}
+
+	/* The page is valid once it carries the magic */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(_status->magic, STATUS_MAGIC, sizeof(_status->magic));
+
+	return OK;
+}
+
+/*
+** status_update(idx, ledstate, stats, now)
+**
+** Updates record "idx" after the LED was sampled at "now": its state became
+** "ledstate", its interface's counters are "stats" (NULL if unavailable).
+*/
+void status_update(uint idx, LEDSTATE ledstate, const NETIFSTATS *stats, uint64_t now)
+{
+	STATUS_RECORD *rec;
+	uint seq;
+
+	if (!_status)
+		return;
+
+	assert(idx < _status->num_records);
+
+	rec = &((STATUS_RECORD *)(_status + 1))[idx];
+	seq = rec->seq;
+
+	__atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	__atomic_store_n(&rec->ledstate, ledstate, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->samples, rec->samples + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&rec->sampled, now, __ATOMIC_RELAXED);
+	if (stats)
+	{
+		__atomic_store_n(&rec->flags, stats->up ? STATUS_UP : 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&rec->stats_sampled, stats->timestamp, __ATOMIC_RELAXED);
+		__atomic_store_n(&rec->rx_packets, stats->rx_packets, __ATOMIC_RELAXED);
+		__atomic_store_n(&rec->tx_packets, stats->tx_packets, __ATOMIC_RELAXED);
+		__atomic_store_n(&rec->rx_bytes, stats->rx_bytes, __ATOMIC_RELAXED);
+		__atomic_store_n(&rec->tx_bytes, stats->tx_bytes, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&rec->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+** status_tick(now)
+**
+** Accounts for a tick at "now", so that readers can tell that we are alive.
+*/
+void status_tick(uint64_t now)
+{
+	if (!_status)
+		return;
+
+	__atomic_store_n(&_status->ticks, _status->ticks + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&_status->updated, now, __ATOMIC_RELAXED);
+}
+
+/*
+** rc = status_reload(leds, num_leds)
+**
+** Makes the status page follow a reload that left the "num_leds" LEDs in "leds".
+** If every record still describes the same interface and handler, the page is kept
+** as it is, so that readers go on undisturbed. Otherwise it is replaced by a new
+** one.
+**
+** Returns OK on success and ERR on failure, in which case an error message can be
+** found in _errmsg.
+*/
+RC status_reload(LED *leds, uint num_leds)
+{
+	STATUS_RECORD *records;
+	char *name = _status_name;
+	int i;
+
+	assert(name && leds);
+
+	if (_status && _status->num_records == num_leds)
+	{
+		records = (STATUS_RECORD *)(_status + 1);
+		for (i = 0; i < num_leds; i++)
+		{
+			STATUS_RECORD *rec = &records[i];
+
+			if (strncmp(rec->netif_name, leds[i].netif_name, sizeof(rec->netif_name) - 1) != 0 ||
+			    strncmp(rec->netifh_name, leds[i].netifh_name, sizeof(rec->netifh_name) - 1) != 0 ||
+			    !(rec->flags & STATUS_OFFLOADED) != !leds[i].offloaded)
+				break;
+		}
+		if (i == num_leds)
+			return OK;
+	}
+
+	status_shutdown();
+	return status_init(name, leds, num_leds);
+}
+
+/*
+** status_shutdown()
+**
+** Removes the status page, marking it invalid for readers that still have it
+** mapped.
+*/
+void status_shutdown(void)
+{
+	if (!_status)
+		return;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(_status->magic, 0, sizeof(_status->magic));
+	munmap(_status, _status_size);
+	_status = NULL;
+	(void)shm_unlink(_status_name);
+}
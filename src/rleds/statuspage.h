@@ -0,0 +1,38 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the shared memory status page
+*/
+
+#ifndef _RLEDS_STATUSPAGE_H
+#define _RLEDS_STATUSPAGE_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdint.h>
+
+#include "../common/base.h"
+#include "../common/netifhandlers.h"
+#include "../common/status.h"
+
+struct _led;
+
+/* Function prototypes */
+RC status_init(char *name, struct _led *leds, uint num_leds);
+void status_update(uint idx, LEDSTATE ledstate, const NETIFSTATS *stats, uint64_t now);
+void status_tick(uint64_t now);
+RC status_reload(struct _led *leds, uint num_leds);
+void status_shutdown(void);
+
+#endif /* _RLEDS_STATUSPAGE_H */
@@ -0,0 +1,229 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Hierarchical timer wheel
+**
+** Level 0 holds the timers expiring within the next TW_SLOTS ticks, one slot per
+** tick. Each higher level holds timers further ahead, one slot per turn of the
+** level below. Whenever level n turns over, the timers in the next slot of level
+** n+1 are redistributed over the lower levels ("cascaded").
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#include "../common/base.h"
+
+#include "timerwheel.h"
+
+/* Slot of level "level" covering tick "t" */
+#define TW_INDEX(t, level) (((t) >> ((level) * TW_BITS)) & TW_MASK)
+
+/*
+** Links "timer" into the slot matching its expiry relative to "tw->now".
+*/
+static void place(TIMERWHEEL *tw, TIMER *timer)
+{
+	uint64_t delta;
+	TIMER **slot;
+	int level;
+
+	if (timer->expires < tw->now)
+		timer->expires = tw->now;
+	delta = timer->expires - tw->now;
+	if (delta > TW_MAX_DELTA)
+		timer->expires = tw->now + TW_MAX_DELTA;
+
+	for (level = 0; level < TW_LEVELS - 1; level++)
+	{
+		if (delta < (uint64_t)1 << ((level + 1) * TW_BITS))
+			break;
+	}
+
+	slot = &tw->slots[level][TW_INDEX(timer->expires, level)];
+	timer->next = *slot;
+	if (*slot)
+		(*slot)->pprev = &timer->next;
+	timer->pprev = slot;
+	*slot = timer;
+}
+
+/*
+** Redistributes the timers in slot "index" of level "level" over the lower levels.
+**
+** Returns "index", so that callers can tell whether this level turned over as well.
+*/
+static int cascade(TIMERWHEEL *tw, int level, int index)
+{
+	TIMER *timer = tw->slots[level][index], *next;
+
+	tw->slots[level][index] = NULL;
+	for (; timer; timer = next)
+	{
+		next = timer->next;
+		place(tw, timer);
+	}
+
+	return index;
+}
+
+/*
+** timerwheel_init(tw, now)
+**
+** Initializes the empty timer wheel "tw", with "now" being the current tick.
+*/
+void timerwheel_init(TIMERWHEEL *tw, uint64_t now)
+{
+	assert(tw);
+
+	memset(tw, 0, sizeof(*tw));
+	tw->now = now;
+}
+
+/*
+** timerwheel_add(tw, timer, expires)
+**
+** Schedules "timer" to expire at tick "expires". Timers expiring in the past expire
+** with the next tick processed, timers more than TW_MAX_DELTA ticks ahead after
+** TW_MAX_DELTA ticks. "timer" must not be scheduled already.
+*/
+void timerwheel_add(TIMERWHEEL *tw, TIMER *timer, uint64_t expires)
+{
+	assert(tw && timer && !timer->pprev);
+
+	timer->expires = expires;
+	place(tw, timer);
+	tw->count++;
+}
+
+/*
+** timerwheel_del(tw, timer)
+**
+** Unschedules "timer", if scheduled.
+*/
+void timerwheel_del(TIMERWHEEL *tw, TIMER *timer)
+{
+	assert(tw && timer);
+
+	if (!timer->pprev)
+		return;
+
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+	tw->count--;
+}
+
+/*
+** next = timerwheel_next(tw)
+**
+** Returns the tick at which the earliest timer scheduled expires or UINT64_MAX if
+** no timer is scheduled.
+*/
+uint64_t timerwheel_next(TIMERWHEEL *tw)
+{
+	uint64_t next = UINT64_MAX;
+	int level, i;
+
+	assert(tw);
+
+	if (!tw->count)
+		return UINT64_MAX;
+
+	/* Level 0 slots hold timers for exactly one tick each... */
+	for (i = 0; i < TW_SLOTS; i++)
+	{
+		if (tw->slots[0][(tw->now + i) & TW_MASK])
+		{
+			next = tw->now + i;
+			break;
+		}
+	}
+
+	/* ...while on higher levels, the first slot occupied holds the earliest timers
+	   of that level, in no particular order. These may still expire before those
+	   on level 0 if they were added when "now" was further back. The current slot
+	   comes first if it is about to be cascaded, otherwise last. */
+	for (level = 1; level < TW_LEVELS; level++)
+	{
+		BOOL turning = (tw->now & (((uint64_t)1 << (level * TW_BITS)) - 1)) == 0;
+
+		for (i = turning ? 0 : 1; i < (turning ? TW_SLOTS : TW_SLOTS + 1); i++)
+		{
+			TIMER *timer = tw->slots[level][(TW_INDEX(tw->now, level) + i) & TW_MASK];
+
+			if (!timer)
+				continue;
+
+			for (; timer; timer = timer->next)
+			{
+				if (timer->expires < next)
+					next = timer->expires;
+			}
+			break;
+		}
+	}
+
+	return next;
+}
+
+/*
+** expired = timerwheel_advance(tw, now)
+**
+** Processes all ticks up to and including "now".
+**
+** Returns the timers expired meanwhile, linked through their "next" members, or NULL
+** if none did. They are no longer scheduled.
+*/
+TIMER *timerwheel_advance(TIMERWHEEL *tw, uint64_t now)
+{
+	TIMER *expired = NULL;
+
+	assert(tw);
+
+	while (tw->now <= now)
+	{
+		int index = TW_INDEX(tw->now, 0), level;
+		TIMER *timer, *next;
+
+		/* Nothing scheduled, nothing to process */
+		if (!tw->count)
+		{
+			tw->now = now + 1;
+			break;
+		}
+
+		/* Cascade down from higher levels whenever a level turns over */
+		for (level = 1; level < TW_LEVELS && index == 0; level++)
+			index = cascade(tw, level, TW_INDEX(tw->now, level));
+
+		for (timer = tw->slots[0][TW_INDEX(tw->now, 0)]; timer; timer = next)
+		{
+			next = timer->next;
+			timer->pprev = NULL;
+			timer->next = expired;
+			expired = timer;
+			tw->count--;
+		}
+		tw->slots[0][TW_INDEX(tw->now, 0)] = NULL;
+
+		tw->now++;
+	}
+
+	return expired;
+}
@@ -0,0 +1,69 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Header file for the hierarchical timer wheel
+*/
+
+#ifndef _RLEDS_TIMERWHEEL_H
+#define _RLEDS_TIMERWHEEL_H
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../common/base.h"
+
+/* Each level has 2^TW_BITS slots, each slot of a level spanning a whole turn of
+   the level below. Time is counted in abstract ticks; with TW_LEVELS levels, timers
+   can be up to 2^(TW_BITS * TW_LEVELS) - 1 ticks ahead. */
+#define TW_BITS 6
+#define TW_LEVELS 4
+#define TW_SLOTS (1 << TW_BITS)
+#define TW_MASK (TW_SLOTS - 1)
+#define TW_MAX_DELTA (((uint64_t)1 << (TW_BITS * TW_LEVELS)) - 1)
+
+/*
+** A timer, to be embedded in the structure it schedules.
+*/
+typedef struct _timer
+{
+	struct _timer	*next,				/* Next timer in the same slot resp. */
+							/* in the list of expired timers */
+			**pprev;			/* Link pointing to us (NULL if not
+							   scheduled) */
+	uint64_t	expires;			/* Tick at which the timer expires */
+	void		*data;				/* Owner's data */
+} TIMER;
+
+/*
+** A hierarchical timer wheel. Adding and removing timers takes constant time,
+** advancing it constant time per tick plus the cost of moving timers down a level
+** when a slot of a higher level comes due.
+*/
+typedef struct _timerwheel
+{
+	uint64_t	now;				/* Next tick to be processed */
+	uint		count;				/* Number of timers scheduled */
+	TIMER		*slots[TW_LEVELS][TW_SLOTS];	/* Timers per level and slot */
+} TIMERWHEEL;
+
+/* Function prototypes */
+void timerwheel_init(TIMERWHEEL *tw, uint64_t now);
+void timerwheel_add(TIMERWHEEL *tw, TIMER *timer, uint64_t expires);
+void timerwheel_del(TIMERWHEEL *tw, TIMER *timer);
+uint64_t timerwheel_next(TIMERWHEEL *tw);
+TIMER *timerwheel_advance(TIMERWHEEL *tw, uint64_t now);
+
+#endif /* _RLEDS_TIMERWHEEL_H */
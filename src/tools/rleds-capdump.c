@@ -0,0 +1,217 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Decodes the capture files written by the capture LED driver
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/base.h"
+#include "../common/capture.h"
+
+const char *_help =
+        "Usage: %s [-s|-j] <capture file>\n\n"
+
+        "Prints the frames recorded in a capture file written by the \"capture\" LED\n"
+        "driver, oldest first: frame number, milliseconds since the previous frame,\n"
+        "CLOCK_MONOTONIC timestamp in seconds and the pins enabled.\n\n"
+
+        "Options:\n"
+        "  -s, --stats               only print frame rate and inter-frame jitter\n"
+        "  -j, --json                the same as a JSON object\n";
+
+/* Command line arguments */
+const char *_short_opts = "sjh";
+struct option _long_opts[] =
+{
+	{ "stats",		no_argument,		NULL,	's' },
+	{ "json",		no_argument,		NULL,	'j' },
+	{ "help",		no_argument,		NULL,	'h' },
+	{ NULL,			0,			NULL,	0 }
+};
+
+/*
+** Prints the pins enabled in "frame", which holds "num_pins" pins, to stdout.
+*/
+void print_frame(const uint64_t *frame, uint num_pins)
+{
+	uint i;
+	BOOL any = FALSE;
+
+	for (i = 0; i < num_pins; i++)
+	{
+		if (frame[i / 64] & ((uint64_t)1 << (i % 64)))
+		{
+			printf(any ? ",%u" : " %u", i);
+			any = TRUE;
+		}
+	}
+	if (!any)
+		printf(" -");
+	printf("\n");
+}
+
+/*
+** Main routine.
+*/
+int main(int argc, char **argv)
+{
+	const CAPTURE_HEADER *header;
+	const CAPTURE_RECORD *records;
+	struct stat st;
+	BOOL stats_only = FALSE, json = FALSE;
+	uint64_t frames, first, n, prev_ts = 0, count = 0;
+	double sum = 0, sumsq = 0, min = 0, max = 0;
+	void *map;
+	int c, fd;
+
+	while ((c = getopt_long(argc, argv, _short_opts, _long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 's':
+				stats_only = TRUE;
+				break;
+			case 'j':
+				stats_only = json = TRUE;
+				break;
+			case 'h':
+				printf(_help, argv[0]);
+				return 0;
+			default:
+				fprintf(stderr, _help, argv[0]);
+				return 1;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, _help, argv[0]);
+		return 1;
+	}
+
+	/* Map the capture file */
+	fd = open(argv[optind], O_RDONLY);
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		fprintf(stderr, "Could not open \"%s\":\n%s!\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	if (st.st_size < sizeof(CAPTURE_HEADER))
+	{
+		fprintf(stderr, "\"%s\" is not a capture file!\n", argv[optind]);
+		return 1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "Could not map \"%s\":\n%s!\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	header = map;
+
+	/* Check that we understand it */
+	if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != CAPTURE_VERSION ||
+	    header->header_size != sizeof(CAPTURE_HEADER) ||
+	    header->record_size != sizeof(CAPTURE_RECORD) ||
+	    header->num_pins > CAPTURE_MAX_PINS ||
+	    st.st_size < sizeof(CAPTURE_HEADER) +
+	                 (uint64_t)header->num_records * sizeof(CAPTURE_RECORD))
+	{
+		fprintf(stderr, "\"%s\" is not a capture file of version %d!\n",
+		        argv[optind], CAPTURE_VERSION);
+		return 1;
+	}
+	records = (const CAPTURE_RECORD *)(header + 1);
+
+	/* Walk the ring, oldest frame first */
+	frames = __atomic_load_n(&header->frames, __ATOMIC_ACQUIRE);
+	first = frames > header->num_records ? frames - header->num_records : 0;
+	for (n = first; n < frames; n++)
+	{
+		const CAPTURE_RECORD *rec = &records[n % header->num_records];
+		uint64_t ts, frame[CAPTURE_FRAME_WORDS];
+
+		/* Skip records being overwritten as we look at them */
+		if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != n + 1)
+			continue;
+		ts = rec->timestamp;
+		memcpy(frame, rec->frame, sizeof(frame));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != n + 1)
+			continue;
+
+		if (count)
+		{
+			double dt = (ts - prev_ts) / 1e3;
+
+			sum += dt;
+			sumsq += dt * dt;
+			if (count == 1 || dt < min)
+				min = dt;
+			if (count == 1 || dt > max)
+				max = dt;
+		}
+
+		if (!stats_only)
+		{
+			printf("%8llu %10.3f %12.3f", (unsigned long long)n,
+			       (ts - (count ? prev_ts : ts)) / 1e6, ts / 1e9);
+			print_frame(frame, header->num_pins);
+		}
+
+		prev_ts = ts;
+		count++;
+	}
+
+	/* Summarize */
+	if (json)
+	{
+		double avg = count > 1 ? sum / (count - 1) : 0;
+
+		printf("{\"frames_total\": %llu, \"frames\": %llu, \"fps\": %.3f, "
+		       "\"interval_us\": {\"min\": %.1f, \"avg\": %.1f, \"max\": %.1f, "
+		       "\"stddev\": %.1f}}\n",
+		       (unsigned long long)frames, (unsigned long long)count,
+		       avg ? 1e6 / avg : 0, min, avg, max,
+		       count > 1 ? sqrt(fmax(sumsq / (count - 1) - avg * avg, 0)) : 0);
+		return 0;
+	}
+
+	printf("%llu frames total, %llu in file", (unsigned long long)frames,
+	       (unsigned long long)count);
+	if (count > 1)
+	{
+		double avg = sum / (count - 1);
+
+		printf(", %.2f frames/s\n"
+		       "inter-frame time [us]: min %.1f, avg %.1f, max %.1f, stddev %.1f",
+		       1e6 / avg, min, avg, max, sqrt(fmax(sumsq / (count - 1) - avg * avg, 0)));
+	}
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,427 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Synthetic network interface statistics generator
+**
+** Builds a tree mimicking /sys/class/net, i.e. <dir>/<interface>/statistics/
+** {rx,tx}_{packets,bytes}, for any number of fake interfaces and keeps updating the counters
+** at a configurable packet rate. Interfaces go down (their statistics files are
+** emptied and removed, as happens to a sysfs attribute held open when its device is
+** unregistered) and up again at a configurable flap rate.
+**
+** Point the "generic" network interface handler at the tree with RLEDS_SYSFS_NET or
+** bind-mount it over /sys/class/net.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/stat.h>
+#include <sys/mount.h>
+#include <sys/resource.h>
+
+#include "../common/base.h"
+
+/* Defaults for the command line options */
+#define DEF_NUM_NETIFS 1000
+#define DEF_NAME_PREFIX "vlan"
+#define DEF_PPS 20.0
+#define DEF_FLAP_RATE 0.0
+#define DEF_DOWN_TIME 2000
+#define DEF_INTERVAL 10
+
+/* Length of buffer for counter values (enough for a 64-bit counter plus newline) */
+#define COUNTER_BUFLEN 24
+
+/* Size of each fake packet in bytes */
+#define PACKET_SIZE 600
+
+/* The statistics files we maintain */
+typedef enum _counter
+{
+	RX_PACKETS,
+	TX_PACKETS,
+	RX_BYTES,
+	TX_BYTES,
+	NUM_COUNTERS
+} COUNTER;
+const char *_counter_names[NUM_COUNTERS] = { "rx_packets", "tx_packets", "rx_bytes", "tx_bytes" };
+
+/* State of a fake interface */
+typedef struct _fakenetif
+{
+	char		*paths[NUM_COUNTERS];		/* Paths of its statistics files */
+	int		fds[NUM_COUNTERS];		/* Their descriptors (-1 while down) */
+	double		rate;				/* Packets per second in each direction */
+	double		pending;			/* Packets accumulated but not yet counted */
+	unsigned long long
+			packets;			/* Current packet count in each direction */
+	uint64_t	up_at;				/* While down, when to come back up */
+} FAKENETIF;
+
+const char *_help =
+        "Usage: %s [<options>] <directory>\n\n"
+
+        "Builds a fake /sys/class/net tree in <directory> and keeps updating the\n"
+        "interfaces' packet and byte counters until interrupted.\n\n"
+
+        "Options:\n"
+        "  -n, --count <n>           number of interfaces (default: %d)\n"
+        "  -p, --prefix <name>       interface name prefix (default: \"%s\")\n"
+        "  -r, --rate <pps>          average packets per second and interface in each\n"
+        "                            direction (default: %.0f)\n"
+        "  -f, --flap-rate <rate>    average down events per second and interface\n"
+        "                            (default: %.0f)\n"
+        "  -d, --down-time <ms>      how long an interface stays down (default: %d)\n"
+        "  -i, --interval <ms>       update interval (default: %d)\n"
+        "  -t, --tmpfs               mount a tmpfs on <directory> first\n"
+        "  -s, --seed <n>            random seed (default: 1)\n";
+
+/* Command line arguments */
+const char *_short_opts = "n:p:r:f:d:i:ts:h";
+struct option _long_opts[] =
+{
+	{ "count",		required_argument,	NULL,	'n' },
+	{ "prefix",		required_argument,	NULL,	'p' },
+	{ "rate",		required_argument,	NULL,	'r' },
+	{ "flap-rate",		required_argument,	NULL,	'f' },
+	{ "down-time",		required_argument,	NULL,	'd' },
+	{ "interval",		required_argument,	NULL,	'i' },
+	{ "tmpfs",		no_argument,		NULL,	't' },
+	{ "seed",		required_argument,	NULL,	's' },
+	{ "help",		no_argument,		NULL,	'h' },
+	{ NULL,			0,			NULL,	0 }
+};
+
+/* Set when we should terminate */
+volatile sig_atomic_t _shutdown = 0;
+
+/*
+** Signal handler.
+*/
+void sig_handler(int sig)
+{
+	_shutdown = 1;
+}
+
+/*
+** Returns the current CLOCK_MONOTONIC time in milliseconds.
+*/
+uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+** Writes the counter value "val" to "fd" (whose name is "path").
+**
+** Counters only grow, so overwriting the old value in place never leaves stale
+** digits behind and never exposes an empty file to readers.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC write_counter(int fd, char *path, unsigned long long val)
+{
+	char buf[COUNTER_BUFLEN];
+	int len;
+
+	len = snprintf(buf, sizeof(buf), "%llu\n", val);
+	if (pwrite(fd, buf, len, 0) != len)
+	{
+		fprintf(stderr, "Could not write \"%s\":\n%s!\n", path, strerror(errno));
+		return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** Writes the current counter values of "netif".
+**
+** Returns OK on success and ERR on failure.
+*/
+RC write_counters(FAKENETIF *netif)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		unsigned long long val = netif->packets;
+
+		if (i == RX_BYTES || i == TX_BYTES)
+			val *= PACKET_SIZE;
+		if (write_counter(netif->fds[i], netif->paths[i], val) != OK)
+			return ERR;
+	}
+
+	return OK;
+}
+
+/*
+** Creates the statistics files of "netif" and writes its current counter values.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC netif_up(FAKENETIF *netif)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		netif->fds[i] = open(netif->paths[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (netif->fds[i] == -1)
+		{
+			fprintf(stderr, "Could not create \"%s\":\n%s!\n",
+			        netif->paths[i], strerror(errno));
+			return ERR;
+		}
+	}
+
+	return write_counters(netif);
+}
+
+/*
+** Takes "netif" down: empties its statistics files, so that readers holding them open
+** notice, and removes them, so that opening them fails.
+*/
+void netif_down(FAKENETIF *netif)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++)
+	{
+		(void)ftruncate(netif->fds[i], 0);
+		close(netif->fds[i]);
+		unlink(netif->paths[i]);
+		netif->fds[i] = -1;
+	}
+}
+
+/*
+** Raises our limit for open files so that we can hold "count" of them.
+**
+** Returns OK on success and ERR on failure.
+*/
+RC raise_nofile(rlim_t count)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+		return ERR;
+	if (rl.rlim_cur >= count)
+		return OK;
+
+	if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < count)
+	{
+		fprintf(stderr, "Need %lu open files, but the limit is %lu!\n",
+		        (unsigned long)count, (unsigned long)rl.rlim_max);
+		return ERR;
+	}
+	rl.rlim_cur = count;
+
+	return setrlimit(RLIMIT_NOFILE, &rl) == -1 ? ERR : OK;
+}
+
+/*
+** Main routine.
+*/
+int main(int argc, char **argv)
+{
+	int num_netifs = DEF_NUM_NETIFS, down_time = DEF_DOWN_TIME, interval = DEF_INTERVAL;
+	char *prefix = DEF_NAME_PREFIX, *dir;
+	double pps = DEF_PPS, flap_rate = DEF_FLAP_RATE;
+	BOOL tmpfs = FALSE;
+	unsigned int seed = 1;
+	FAKENETIF *netifs;
+	struct timespec next;
+	uint64_t last;
+	int c, i;
+
+	while ((c = getopt_long(argc, argv, _short_opts, _long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				num_netifs = atoi(optarg);
+				break;
+			case 'p':
+				prefix = optarg;
+				break;
+			case 'r':
+				pps = atof(optarg);
+				break;
+			case 'f':
+				flap_rate = atof(optarg);
+				break;
+			case 'd':
+				down_time = atoi(optarg);
+				break;
+			case 'i':
+				interval = atoi(optarg);
+				break;
+			case 't':
+				tmpfs = TRUE;
+				break;
+			case 's':
+				seed = atoi(optarg);
+				break;
+			case 'h':
+				printf(_help, argv[0], DEF_NUM_NETIFS, DEF_NAME_PREFIX, DEF_PPS,
+				       DEF_FLAP_RATE, DEF_DOWN_TIME, DEF_INTERVAL);
+				return 0;
+			default:
+				fprintf(stderr, "Try \"%s --help\" for more information.\n", argv[0]);
+				return 1;
+		}
+	}
+	if (optind != argc - 1 || num_netifs <= 0 || interval <= 0 || pps < 0 || flap_rate < 0)
+	{
+		fprintf(stderr, "Try \"%s --help\" for more information.\n", argv[0]);
+		return 1;
+	}
+	dir = argv[optind];
+	srand(seed);
+
+	/* Prepare the root directory */
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+	{
+		fprintf(stderr, "Could not create \"%s\":\n%s!\n", dir, strerror(errno));
+		return 1;
+	}
+	if (tmpfs && mount("rleds-netgen", dir, "tmpfs", 0, "mode=0755") == -1)
+	{
+		fprintf(stderr, "Could not mount tmpfs on \"%s\":\n%s!\n", dir, strerror(errno));
+		return 1;
+	}
+
+	if (raise_nofile(NUM_COUNTERS * num_netifs + 16) != OK)
+		return 1;
+
+	/* Build the tree */
+	netifs = calloc(num_netifs, sizeof(FAKENETIF));
+	if (!netifs)
+	{
+		fprintf(stderr, "Could not allocate memory for %d interfaces!\n", num_netifs);
+		return 1;
+	}
+	for (i = 0; i < num_netifs; i++)
+	{
+		FAKENETIF *netif = &netifs[i];
+		char path[PATH_MAX];
+		int j;
+
+		snprintf(path, sizeof(path), "%s/%s%d", dir, prefix, i);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/%s%d/statistics", dir, prefix, i);
+		if (mkdir(path, 0755) == -1 && errno != EEXIST)
+		{
+			fprintf(stderr, "Could not create \"%s\":\n%s!\n", path, strerror(errno));
+			return 1;
+		}
+
+		for (j = 0; j < NUM_COUNTERS; j++)
+		{
+			snprintf(path, sizeof(path), "%s/%s%d/statistics/%s",
+			         dir, prefix, i, _counter_names[j]);
+			netif->paths[j] = strdup(path);
+			if (!netif->paths[j])
+			{
+				fprintf(stderr, "Could not allocate memory for %d interfaces!\n",
+				        num_netifs);
+				return 1;
+			}
+		}
+
+		/* Spread the rates between half and one and a half times the average, and
+		   the counters' phases, so that not all interfaces tick in lockstep */
+		netif->rate = pps * (0.5 + (double)rand() / RAND_MAX);
+		netif->pending = (double)rand() / RAND_MAX;
+
+		if (netif_up(netif) != OK)
+			return 1;
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	signal(SIGHUP, sig_handler);
+
+	/* Update the counters every "interval" milliseconds */
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	last = now_ms();
+	while (!_shutdown)
+	{
+		uint64_t now;
+		double dt;
+
+		next.tv_nsec += interval * 1000000L;
+		while (next.tv_nsec >= 1000000000L)
+		{
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) != 0)
+			continue;
+
+		now = now_ms();
+		dt = (now - last) / 1000.0;
+		last = now;
+
+		for (i = 0; i < num_netifs; i++)
+		{
+			FAKENETIF *netif = &netifs[i];
+
+			/* Bring interfaces that were down long enough back up... */
+			if (netif->fds[RX_PACKETS] == -1)
+			{
+				if (now >= netif->up_at && netif_up(netif) != OK)
+					return 1;
+				continue;
+			}
+
+			/* ...and take others down at random */
+			if (flap_rate > 0 && (double)rand() / RAND_MAX < flap_rate * dt)
+			{
+				netif_down(netif);
+				netif->up_at = now + down_time;
+				continue;
+			}
+
+			/* Count the packets that arrived since the last update */
+			netif->pending += netif->rate * dt;
+			if (netif->pending < 1)
+				continue;
+
+			netif->packets += (unsigned long long)netif->pending;
+			netif->pending -= (unsigned long long)netif->pending;
+			if (write_counters(netif) != OK)
+				return 1;
+		}
+	}
+
+	return 0;
+}
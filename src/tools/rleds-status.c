@@ -0,0 +1,299 @@
+/*
+** rleds - Router LED control program
+** Copyright (c) 2006 by Pieter Hollants <pieter@hollants.com>
+**
+** This program is licensed under the GNU General Public License, version 2,
+** as published by the Free Software Foundation and available in the file
+** COPYING and the Internet location http://www.gnu.org/licenses/gpl.html.
+**
+** This program is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+** or FITNESS FOR A PARTICULAR PURPOSE.
+**
+** Prints the status page published by rleds
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../../config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/base.h"
+#include "../common/status.h"
+
+const char *_help =
+        "Usage: %s [-j] [-w <ms>] [<name>]\n\n"
+
+        "Prints the LED states and interface counters rleds publishes in the shared\n"
+        "memory object <name> (default: %s) when started with --status: LED\n"
+        "number, interface, handler, LED state, link, seconds since the last sample\n"
+        "and the rx/tx packet and byte counters.\n\n"
+
+        "Options:\n"
+        "  -j, --json                print a JSON object instead\n"
+        "  -w, --watch <ms>          print again every <ms> milliseconds\n";
+
+/* Command line arguments */
+const char *_short_opts = "jw:h";
+struct option _long_opts[] =
+{
+	{ "json",		no_argument,		NULL,	'j' },
+	{ "watch",		required_argument,	NULL,	'w' },
+	{ "help",		no_argument,		NULL,	'h' },
+	{ NULL,			0,			NULL,	0 }
+};
+
+/* Names of the LED states */
+const char *_ledstates[] = { "off", "prim", "sec", "both" };
+
+/*
+** Copies the record "rec" to "copy", retrying until the copy is consistent.
+*/
+void read_record(const STATUS_RECORD *rec, STATUS_RECORD *copy)
+{
+	uint32_t seq;
+
+	do
+	{
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		copy->ledstate = __atomic_load_n(&rec->ledstate, __ATOMIC_RELAXED);
+		copy->flags = __atomic_load_n(&rec->flags, __ATOMIC_RELAXED);
+		copy->samples = __atomic_load_n(&rec->samples, __ATOMIC_RELAXED);
+		copy->sampled = __atomic_load_n(&rec->sampled, __ATOMIC_RELAXED);
+		copy->stats_sampled = __atomic_load_n(&rec->stats_sampled, __ATOMIC_RELAXED);
+		copy->rx_packets = __atomic_load_n(&rec->rx_packets, __ATOMIC_RELAXED);
+		copy->tx_packets = __atomic_load_n(&rec->tx_packets, __ATOMIC_RELAXED);
+		copy->rx_bytes = __atomic_load_n(&rec->rx_bytes, __ATOMIC_RELAXED);
+		copy->tx_bytes = __atomic_load_n(&rec->tx_bytes, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}
+	while ((seq & 1) || seq != __atomic_load_n(&rec->seq, __ATOMIC_RELAXED));
+
+	copy->seq = seq;
+	memcpy(copy->netif_name, rec->netif_name, sizeof(copy->netif_name));
+	memcpy(copy->netifh_name, rec->netifh_name, sizeof(copy->netifh_name));
+	copy->netif_name[sizeof(copy->netif_name) - 1] = '\0';
+	copy->netifh_name[sizeof(copy->netifh_name) - 1] = '\0';
+}
+
+/*
+** Prints the status page "header" to stdout, as JSON if "json" is set.
+*/
+void print_status(const STATUS_HEADER *header, BOOL json)
+{
+	const STATUS_RECORD *records = (const STATUS_RECORD *)(header + 1);
+	struct timespec ts;
+	uint64_t now;
+	uint i;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	if (json)
+		printf("{\"pid\": %u, \"ticks\": %llu, \"age\": %.3f, \"leds\": [",
+		       header->pid,
+		       (unsigned long long)__atomic_load_n(&header->ticks, __ATOMIC_RELAXED),
+		       (now - __atomic_load_n(&header->updated, __ATOMIC_RELAXED)) / 1e9);
+	else
+		printf("pid %u, %llu ticks, last %.3f s ago\n", header->pid,
+		       (unsigned long long)__atomic_load_n(&header->ticks, __ATOMIC_RELAXED),
+		       (now - __atomic_load_n(&header->updated, __ATOMIC_RELAXED)) / 1e9);
+
+	for (i = 0; i < header->num_records; i++)
+	{
+		STATUS_RECORD rec;
+		const char *state;
+		double age;
+
+		read_record(&records[i], &rec);
+		state = rec.ledstate < 4 ? _ledstates[rec.ledstate] : "?";
+		age = rec.sampled ? (now - rec.sampled) / 1e9 : -1;
+
+		if (json)
+		{
+			printf("%s{\"netif\": \"%s\", \"handler\": \"%s\", \"state\": \"%s\", "
+			       "\"up\": %s, \"offloaded\": %s, \"samples\": %llu, \"age\": %.3f, "
+			       "\"rx_packets\": %llu, \"tx_packets\": %llu, "
+			       "\"rx_bytes\": %llu, \"tx_bytes\": %llu}",
+			       i ? ", " : "", rec.netif_name, rec.netifh_name, state,
+			       rec.flags & STATUS_UP ? "true" : "false",
+			       rec.flags & STATUS_OFFLOADED ? "true" : "false",
+			       (unsigned long long)rec.samples, age,
+			       (unsigned long long)rec.rx_packets, (unsigned long long)rec.tx_packets,
+			       (unsigned long long)rec.rx_bytes, (unsigned long long)rec.tx_bytes);
+			continue;
+		}
+
+		printf("%3u %-16s %-12s %-4s %-9s", i, rec.netif_name, rec.netifh_name, state,
+		       rec.flags & STATUS_OFFLOADED ? "offloaded" :
+		       rec.flags & STATUS_UP ? "up" : "down");
+		if (rec.sampled)
+			printf(" %8.3f", age);
+		else
+			printf(" %8s", "-");
+		printf(" rx %llu/%llu tx %llu/%llu\n",
+		       (unsigned long long)rec.rx_packets, (unsigned long long)rec.rx_bytes,
+		       (unsigned long long)rec.tx_packets, (unsigned long long)rec.tx_bytes);
+	}
+
+	if (json)
+		printf("]}\n");
+	fflush(stdout);
+}
+
+/*
+** header = map_status(name, &st, quiet)
+**
+** Maps the status page "name" read-only and checks that we understand it. "st"
+** receives its stat() data. Unless "quiet" is set, failures are reported on stderr.
+**
+** Returns the page's header on success and NULL on failure.
+*/
+const STATUS_HEADER *map_status(const char *name, struct stat *st, BOOL quiet)
+{
+	const STATUS_HEADER *header;
+	void *map;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd == -1 || fstat(fd, st) == -1)
+	{
+		if (!quiet)
+			fprintf(stderr, "Could not open \"%s\":\n%s!\n", name, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return NULL;
+	}
+	if (st->st_size < sizeof(STATUS_HEADER))
+	{
+		if (!quiet)
+			fprintf(stderr, "\"%s\" is not a status page!\n", name);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		if (!quiet)
+			fprintf(stderr, "Could not map \"%s\":\n%s!\n", name, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	header = map;
+
+	/* Check that we understand it */
+	if (memcmp(header->magic, STATUS_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != STATUS_VERSION ||
+	    header->header_size != sizeof(STATUS_HEADER) ||
+	    header->record_size != sizeof(STATUS_RECORD) ||
+	    st->st_size < sizeof(STATUS_HEADER) +
+	                  (uint64_t)header->num_records * sizeof(STATUS_RECORD))
+	{
+		if (!quiet)
+			fprintf(stderr, "\"%s\" is not a status page of version %d!\n",
+			        name, STATUS_VERSION);
+		munmap(map, st->st_size);
+		return NULL;
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return header;
+}
+
+/*
+** Main routine.
+*/
+int main(int argc, char **argv)
+{
+	const STATUS_HEADER *header;
+	char *name = STATUS_DEFAULT_NAME;
+	BOOL json = FALSE;
+	unsigned long watch = 0;
+	struct stat st;
+	char *end;
+	int c;
+
+	while ((c = getopt_long(argc, argv, _short_opts, _long_opts, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'j':
+				json = TRUE;
+				break;
+			case 'w':
+				watch = strtoul(optarg, &end, 10);
+				if (*end || watch == 0)
+				{
+					fprintf(stderr, "Invalid interval \"%s\"!\n", optarg);
+					return 1;
+				}
+				break;
+			case 'h':
+				printf(_help, argv[0], STATUS_DEFAULT_NAME);
+				return 0;
+			default:
+				fprintf(stderr, _help, argv[0], STATUS_DEFAULT_NAME);
+				return 1;
+		}
+	}
+	if (optind < argc - 1)
+	{
+		fprintf(stderr, _help, argv[0], STATUS_DEFAULT_NAME);
+		return 1;
+	}
+	if (optind == argc - 1)
+		name = argv[optind];
+
+	/* Map the status page */
+	header = map_status(name, &st, FALSE);
+	if (!header)
+		return 1;
+
+	/* From here on, the page is only read from memory */
+	while (1)
+	{
+		const STATUS_HEADER *new_header;
+		struct stat new_st;
+		int fd;
+
+		print_status(header, json);
+		if (!watch)
+			break;
+		usleep(watch * 1000);
+
+		/* Reloading rleds' configuration replaces the page by a new one under the
+		   same name, so follow it. While the new one is still being created, we
+		   keep the old one and try again next time. */
+		fd = shm_open(name, O_RDONLY, 0);
+		if (fd == -1)
+			continue;
+		if (fstat(fd, &new_st) == -1 ||
+		    (new_st.st_dev == st.st_dev && new_st.st_ino == st.st_ino))
+		{
+			close(fd);
+			continue;
+		}
+		close(fd);
+
+		new_header = map_status(name, &new_st, TRUE);
+		if (!new_header)
+			continue;
+		munmap((void *)header, st.st_size);
+		header = new_header;
+		st = new_st;
+	}
+
+	return 0;
+}